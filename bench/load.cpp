@@ -0,0 +1,527 @@
+#include "hash-service/hash.h"
+#include "hash-service/hashers.h"
+#include "hash-service/metrics.h"
+#include "hash-service/runtime.h"
+
+#include <asio.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+	constexpr const char signature[] = "signature: bench.load [--host=<address>] [--port=<port>] "
+									   "[--connections=<count>] [--lines=<count per connection>] "
+									   "[--size=fixed:<bytes>|uniform:<min>,<max>|lognormal:<median>,<sigma>] "
+									   "[--pipeline=<lines in flight per connection>] [--threads=<count>] "
+									   "[--hash=<algorithm>] [--verify=on|off] [--seed=<number>] "
+									   "[--server-pid=<pid>] [--format=text|json]\n"
+									   "sizes accept the K, M and G suffixes, e.g. --size=fixed:4G\n";
+
+	using clock_type = std::chrono::steady_clock;
+	using tcp = asio::ip::tcp;
+
+	/**
+	 * @brief Distribution of the line sizes, excluding the terminator.
+	 */
+	struct size_distribution
+	{
+		enum class kind {
+			fixed,
+			uniform,
+			lognormal
+		};
+
+		kind type = kind::fixed;
+		uint64_t a = 64;
+		uint64_t b = 64;
+		double sigma = 0;
+
+		[[nodiscard]] uint64_t operator()(std::mt19937_64 &rng) const {
+			switch (type)
+			{
+			case kind::uniform:
+				return std::uniform_int_distribution<uint64_t>(a, b)(rng);
+			case kind::lognormal:
+				return uint64_t(std::lognormal_distribution<double>(std::log(double(a)), sigma)(rng));
+			default:
+				return a;
+			}
+		}
+	};
+
+	struct options
+	{
+		std::string host = "127.0.0.1";
+		uint16_t port = 23;
+		size_t connections = 16;
+		uint64_t lines = 10000;
+		size_distribution size{};
+		size_t pipeline = 64;
+		size_t threads = 1;
+		hs::hash_algorithm algorithm = hs::hash_algorithm::sha256;
+		bool verify = true;
+		uint64_t seed = 815;
+		std::optional<int> serverPid;
+		bool json = false;
+	};
+
+	/**
+	 * @throws std::invalid_argument if an argument is not recognized or has an invalid value
+	 */
+	options parse_options(int argc, char **argv);
+
+	/**
+	 * @brief Printable bytes the lines are cut from. Lines longer than the block wrap around.
+	 */
+	const std::string &payload_block() {
+		static const std::string block = [] {
+			std::string s(size_t(1) << 20, '\0');
+			std::mt19937 rng{42};
+			for (auto &ch : s)
+				ch = char('a' + rng() % 26);
+			return s;
+		}();
+		return block;
+	}
+
+	/**
+	 * @brief Results of a thread, merged at the end.
+	 */
+	struct results
+	{
+		uint64_t lines = 0;
+		uint64_t bytesSent = 0;
+		uint64_t mismatches = 0;
+		uint64_t errors = 0;
+		hs::histogram_snapshot latency{};
+
+		void merge(const results &other) {
+			lines += other.lines;
+			bytesSent += other.bytesSent;
+			mismatches += other.mismatches;
+			errors += other.errors;
+			for (size_t i = 0; i < hs::detail::log_buckets::count; ++i)
+			{
+				if (const uint64_t n = other.latency.bucket(i))
+					latency.add(i, n);
+			}
+			latency.add_sum(other.latency.sum());
+		}
+	};
+
+	/**
+	 * @brief Client connection pipelining lines of random sizes and checking the responses in order.
+	 *
+	 * At most `pipeline` lines are sent, but not answered yet. Lines are cut from `payload_block()`
+	 * and hashed while being written, so that lines of any size need a constant amount of memory.
+	 * The latency of a line is measured from writing its first byte to reading its response.
+	 *
+	 * Runs on a single-threaded io_context: no synchronization is needed.
+	 */
+	template <typename Hasher>
+	class connection : public std::enable_shared_from_this<connection<Hasher>>
+	{
+		constexpr static size_t response_size = Hasher::digest_length * 2 + 1;
+		constexpr static size_t write_size = 64 * 1024;
+		constexpr static size_t read_size = 64 * 1024;
+
+	 public:
+		connection(asio::io_context &ioContext, const options &opts, uint64_t seed, results &res)
+			: _socket(ioContext),
+			  _opts(opts),
+			  _rng(seed),
+			  _results(res)
+		{
+			_writeBuffer.reserve(write_size);
+		}
+
+		void start(const tcp::endpoint &endpoint) {
+			_socket.async_connect(endpoint, [self = this->shared_from_this()](asio::error_code err) {
+				if (err)
+				{
+					self->fail("connect", err);
+					return;
+				}
+				self->_socket.set_option(tcp::no_delay(true));
+				self->writing();
+				self->reading();
+			});
+		}
+
+	 private:
+		struct pending_line
+		{
+			clock_type::time_point sent;
+			// set once the line has been written entirely
+			std::array<uint8_t, response_size> expected{};
+		};
+
+		void fail(std::string_view what, const asio::error_code &err) {
+			++_results.errors;
+			std::cerr << "connection " << what << " error: " << err.message() << '\n';
+			asio::error_code ignored{};
+			_socket.close(ignored);
+		}
+
+		/**
+		 * @brief Appends bytes of the lines to the write buffer, starting new lines while the pipeline allows.
+		 */
+		void fill() {
+			const std::string &block = payload_block();
+			while (_writeBuffer.size() < write_size)
+			{
+				if (!_lineRemaining)
+				{
+					if (_linesStarted == _opts.lines || _pending.size() >= _opts.pipeline)
+						return;
+
+					++_linesStarted;
+					_lineRemaining = _opts.size(_rng) + 1;
+					_lineOffset = size_t(_rng() % block.size());
+					_pending.push_back(pending_line{clock_type::now()});
+					if (_opts.verify)
+						_hash = Hasher::create();
+				}
+
+				if (_lineRemaining == 1)
+				{
+					_writeBuffer.push_back('\n');
+					_lineRemaining = 0;
+					if (_hash)
+					{
+						const auto digest = _hash->finalize();
+						const auto hex = hs::to_hex(*digest);
+						std::copy(hex.begin(), hex.end(), _pending.back().expected.begin());
+						_pending.back().expected.back() = '\n';
+						_hash.reset();
+					}
+					continue;
+				}
+
+				const size_t size = size_t(std::min<uint64_t>({_lineRemaining - 1, write_size - _writeBuffer.size(),
+															   block.size() - _lineOffset}));
+				const std::string_view bytes = std::string_view(block).substr(_lineOffset, size);
+				_writeBuffer.insert(_writeBuffer.end(), bytes.begin(), bytes.end());
+				if (_hash)
+					_hash->update(bytes);
+				_lineRemaining -= size;
+				_lineOffset = (_lineOffset + size) % block.size();
+			}
+		}
+
+		void writing() {
+			if (_writing)
+				return;
+
+			fill();
+			if (_writeBuffer.empty())
+				return;
+
+			_writing = true;
+			_results.bytesSent += _writeBuffer.size();
+			asio::async_write(_socket, asio::buffer(_writeBuffer),
+				[self = this->shared_from_this()](asio::error_code err, size_t /*bytesWritten*/) {
+				self->_writing = false;
+				if (err)
+				{
+					if (err != asio::error::operation_aborted)
+						self->fail("write", err);
+					return;
+				}
+
+				self->_writeBuffer.clear();
+				self->writing();
+			});
+		}
+
+		void reading() {
+			_socket.async_read_some(asio::buffer(_readBuffer),
+				[self = this->shared_from_this()](asio::error_code err, size_t bytesRead) {
+				if (err)
+				{
+					if (err != asio::error::operation_aborted)
+						self->fail("read", err);
+					return;
+				}
+
+				if (!self->responses_received(bytesRead))
+					return;
+				self->writing();
+				self->reading();
+			});
+		}
+
+		/**
+		 * @return `false` if all the responses have been received or the server has responded unexpectedly.
+		 */
+		bool responses_received(size_t bytesRead) {
+			const auto now = clock_type::now();
+			for (size_t i = 0; i < bytesRead; ++i)
+			{
+				_response[_responseSize++] = _readBuffer[i];
+				if (_responseSize < response_size)
+					continue;
+
+				_responseSize = 0;
+				if (_pending.empty() || _response.back() != '\n')
+				{
+					fail("protocol", asio::error::invalid_argument);
+					return false;
+				}
+
+				const pending_line &line = _pending.front();
+				if (_opts.verify && _response != line.expected)
+					++_results.mismatches;
+				_results.latency.add(hs::detail::log_buckets::index(hs::metrics::elapsed_ns(line.sent, now)), 1);
+				_results.latency.add_sum(hs::metrics::elapsed_ns(line.sent, now));
+				_pending.pop_front();
+				++_results.lines;
+			}
+
+			if (_linesStarted == _opts.lines && _pending.empty() && !_lineRemaining)
+			{
+				asio::error_code ignored{};
+				_socket.shutdown(tcp::socket::shutdown_both, ignored);
+				_socket.close(ignored);
+				return false;
+			}
+			return true;
+		}
+
+		tcp::socket _socket;
+		const options &_opts;
+		std::mt19937_64 _rng;
+		results &_results;
+
+		std::vector<uint8_t> _writeBuffer;
+		bool _writing = false;
+		uint64_t _linesStarted = 0;
+		// bytes of the current line left to write, including the terminator
+		uint64_t _lineRemaining = 0;
+		size_t _lineOffset = 0;
+		std::optional<Hasher> _hash;
+		std::deque<pending_line> _pending;
+
+		std::array<uint8_t, read_size> _readBuffer{};
+		std::array<uint8_t, response_size> _response{};
+		size_t _responseSize = 0;
+	};
+
+	/**
+	 * @return "VmRSS" and "VmHWM" of the process in KiB, zeros if not available.
+	 */
+	std::pair<uint64_t, uint64_t> process_rss(int pid) {
+		std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+		uint64_t rss = 0, peak = 0;
+		std::string line{};
+		while (std::getline(status, line))
+		{
+			std::istringstream ss(line);
+			std::string name{};
+			uint64_t value = 0;
+			ss >> name >> value;
+			if (name == "VmRSS:")
+				rss = value;
+			else if (name == "VmHWM:")
+				peak = value;
+		}
+		return {rss, peak};
+	}
+
+	template <typename Hasher>
+	results run(const options &opts, tcp::endpoint endpoint) {
+		hs::runtime runtime{hs::runtime_config{hs::runtime_mode::sharded, opts.threads}};
+		std::vector<results> threadResults(runtime.shards());
+		for (size_t i = 0; i < opts.connections; ++i)
+		{
+			const size_t shard = i % runtime.shards();
+			auto conn = std::make_shared<connection<Hasher>>(runtime.context(shard), opts, opts.seed + i,
+															 threadResults[shard]);
+			conn->start(endpoint);
+		}
+		runtime.run();
+
+		results total{};
+		for (const auto &res : threadResults)
+			total.merge(res);
+		return total;
+	}
+
+	void report(const options &opts, const results &res, std::chrono::duration<double> elapsed) {
+		const double seconds = elapsed.count();
+		const auto &latency = res.latency;
+		const auto us = [](uint64_t ns) { return double(ns) / 1000.0; };
+		const auto [rss, peakRss] = opts.serverPid ? process_rss(*opts.serverPid) : std::pair<uint64_t, uint64_t>{};
+
+		std::ostringstream out{};
+		if (opts.json)
+		{
+			out << "{\"connections\":" << opts.connections << ",\"lines\":" << res.lines
+				<< ",\"bytes_sent\":" << res.bytesSent << ",\"seconds\":" << seconds
+				<< ",\"lines_per_second\":" << double(res.lines) / seconds
+				<< ",\"mib_per_second\":" << double(res.bytesSent) / seconds / (1 << 20)
+				<< ",\"latency_us\":{\"p50\":" << us(latency.quantile(0.5)) << ",\"p99\":" << us(latency.quantile(0.99))
+				<< ",\"p999\":" << us(latency.quantile(0.999)) << ",\"max\":" << us(latency.max()) << "}"
+				<< ",\"server_rss_kib\":" << rss << ",\"server_peak_rss_kib\":" << peakRss
+				<< ",\"mismatches\":" << res.mismatches << ",\"errors\":" << res.errors << "}\n";
+		}
+		else
+		{
+			out << "connections: " << opts.connections << ", lines: " << res.lines << ", bytes sent: " << res.bytesSent
+				<< ", elapsed: " << seconds << " s\n"
+				<< "throughput: " << double(res.lines) / seconds << " lines/s, "
+				<< double(res.bytesSent) / seconds / (1 << 20) << " MiB/s\n"
+				<< "latency (us): p50 " << us(latency.quantile(0.5)) << ", p99 " << us(latency.quantile(0.99))
+				<< ", p999 " << us(latency.quantile(0.999)) << ", max " << us(latency.max()) << '\n';
+			if (opts.serverPid)
+				out << "server RSS: " << rss << " KiB, peak: " << peakRss << " KiB\n";
+			out << "mismatches: " << res.mismatches << ", errors: " << res.errors << '\n';
+		}
+		std::cout << out.str();
+	}
+}
+
+int main(int argc, char **argv) {
+	try {
+		const options opts = parse_options(argc, argv);
+		const tcp::endpoint endpoint{asio::ip::make_address(opts.host), opts.port};
+
+		const auto started = clock_type::now();
+		const results res = hs::visit_hash_algorithm(opts.algorithm, [&](auto tag) {
+			return run<typename decltype(tag)::type>(opts, endpoint);
+		});
+		report(opts, res, clock_type::now() - started);
+
+		const bool complete = res.lines == opts.connections * opts.lines;
+		return complete && !res.mismatches && !res.errors ? 0 : 1;
+	}
+	catch (const std::invalid_argument &e)
+	{
+		std::cerr << "invalid argument: " << e.what() << '\n' << signature;
+		return 2;
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "unexpected error: " << e.what() << '\n';
+		return 2;
+	}
+}
+
+namespace {
+	uint64_t parse_size(std::string_view value) {
+		size_t end = 0;
+		const std::string s{value};
+		uint64_t size = std::stoull(s, &end);
+		const std::string_view suffix = value.substr(end);
+		if (suffix == "K")
+			size <<= 10;
+		else if (suffix == "M")
+			size <<= 20;
+		else if (suffix == "G")
+			size <<= 30;
+		else if (!suffix.empty())
+			throw std::invalid_argument("size: " + s);
+		return size;
+	}
+
+	size_distribution parse_size_distribution(std::string_view value) {
+		const size_t iColon = value.find(':');
+		const std::string_view type = value.substr(0, iColon),
+			params = iColon == std::string_view::npos ? std::string_view() : value.substr(iColon + 1);
+		const size_t iComma = params.find(',');
+
+		size_distribution dist{};
+		if (type == "fixed" && !params.empty() && iComma == std::string_view::npos)
+		{
+			dist.a = dist.b = parse_size(params);
+			return dist;
+		}
+		if (iComma == std::string_view::npos)
+			throw std::invalid_argument("--size=" + std::string(value));
+
+		if (type == "uniform")
+		{
+			dist.type = size_distribution::kind::uniform;
+			dist.a = parse_size(params.substr(0, iComma));
+			dist.b = parse_size(params.substr(iComma + 1));
+			if (dist.a > dist.b)
+				throw std::invalid_argument("--size=" + std::string(value));
+			return dist;
+		}
+		if (type == "lognormal")
+		{
+			dist.type = size_distribution::kind::lognormal;
+			dist.a = std::max<uint64_t>(1, parse_size(params.substr(0, iComma)));
+			dist.sigma = std::stod(std::string(params.substr(iComma + 1)));
+			return dist;
+		}
+		throw std::invalid_argument("--size=" + std::string(value));
+	}
+
+	bool parse_switch(std::string_view name, std::string_view value) {
+		if (value == "on")
+			return true;
+		if (value == "off")
+			return false;
+		throw std::invalid_argument(std::string(name) + "=" + std::string(value));
+	}
+
+	options parse_options(int argc, char **argv) {
+		options opts{};
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string_view arg{argv[i]};
+			const size_t iEq = arg.find('=');
+			const std::string_view name = arg.substr(0, iEq),
+				value = iEq == std::string_view::npos ? std::string_view() : arg.substr(iEq + 1);
+
+			if (name == "--host")
+				opts.host = std::string(value);
+			else if (name == "--port")
+				opts.port = uint16_t(std::stoi(std::string(value)));
+			else if (name == "--connections")
+				opts.connections = std::stoul(std::string(value));
+			else if (name == "--lines")
+				opts.lines = std::stoull(std::string(value));
+			else if (name == "--size")
+				opts.size = parse_size_distribution(value);
+			else if (name == "--pipeline")
+				opts.pipeline = std::max<size_t>(1, std::stoul(std::string(value)));
+			else if (name == "--threads")
+				opts.threads = std::max<size_t>(1, std::stoul(std::string(value)));
+			else if (name == "--hash")
+			{
+				const auto algorithm = hs::parse_hash_algorithm(value);
+				if (!algorithm)
+					throw std::invalid_argument("unknown or unsupported hash algorithm: " + std::string(value));
+				opts.algorithm = *algorithm;
+			}
+			else if (name == "--verify")
+				opts.verify = parse_switch(name, value);
+			else if (name == "--seed")
+				opts.seed = std::stoull(std::string(value));
+			else if (name == "--server-pid")
+				opts.serverPid = std::stoi(std::string(value));
+			else if (name == "--format" && (value == "text" || value == "json"))
+				opts.json = value == "json";
+			else
+				throw std::invalid_argument(std::string(arg));
+		}
+		return opts;
+	}
+}
@@ -0,0 +1,310 @@
+#include "hash-service/buffer.h"
+#include "hash-service/hash.h"
+#include "hash-service/hex.h"
+#include "hash-service/output.h"
+#include "hash-service/sha256.h"
+#include "hash-service/sha256_batch.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+	constexpr int64_t max_line_size = int64_t(64) << 20;
+
+	/**
+	 * @return `size` printable bytes, no terminators.
+	 */
+	std::string_view payload(size_t size) {
+		static const std::string data = [] {
+			std::string s(size_t(max_line_size), '\0');
+			uint32_t state = 815;
+			for (auto &ch : s)
+			{
+				state = state * 1664525u + 1013904223u;
+				ch = char('a' + (state >> 24) % 26);
+			}
+			return s;
+		}();
+		return std::string_view(data).substr(0, size);
+	}
+
+	/**
+	 * @return '\n'-terminated lines of `lineSize` bytes, at least `minSize` bytes in total.
+	 */
+	std::string make_stream(size_t lineSize, size_t minSize) {
+		std::string stream{};
+		const std::string_view line = payload(lineSize);
+		while (stream.size() < minSize)
+			stream.append(line).push_back('\n');
+		return stream;
+	}
+
+	// line sizes from 8 B to 64 MiB, chunk sizes of the receive buffer and of the offload threshold
+	void line_and_chunk_sizes(benchmark::internal::Benchmark *b) {
+		for (int64_t line = 8; line <= max_line_size; line *= 8)
+			for (int64_t chunk : {int64_t(2048), int64_t(64 * 1024)})
+				b->Args({line, chunk});
+		b->Args({max_line_size, 2048});
+		b->Args({max_line_size, 64 * 1024});
+	}
+
+	/**
+	 * @brief `update()` chunk by chunk and `finalize()` of a single line.
+	 */
+	template <typename Hasher>
+	void BM_HashLine(benchmark::State &state) {
+		const std::string_view line = payload(size_t(state.range(0)));
+		const auto chunkSize = size_t(state.range(1));
+		auto hash = Hasher::create();
+		if (!hash)
+		{
+			state.SkipWithError("Hasher::create() failed");
+			return;
+		}
+
+		for (auto _ : state)
+		{
+			for (size_t offset = 0; offset < line.size(); offset += chunkSize)
+				hash->update(line.substr(offset, chunkSize));
+			auto digest = hash->finalize();
+			benchmark::DoNotOptimize(digest);
+		}
+		state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+		state.SetItemsProcessed(int64_t(state.iterations()));
+	}
+	BENCHMARK_TEMPLATE(BM_HashLine, hs::sha256_hash)->Apply(line_and_chunk_sizes)->UseRealTime();
+	BENCHMARK_TEMPLATE(BM_HashLine, hs::evp_sha256_hash)->Apply(line_and_chunk_sizes)->UseRealTime();
+	BENCHMARK_TEMPLATE(BM_HashLine, hs::sha512_256_hash)->Apply(line_and_chunk_sizes)->UseRealTime();
+
+	/**
+	 * @brief A line entirely within the receive buffer hashed at once, by each kernel.
+	 */
+	void BM_Sha256OneShot(benchmark::State &state) {
+		const std::string_view line = payload(size_t(state.range(0)));
+		const auto k = hs::sha256_native_hash::kernel(state.range(1));
+		if (!hs::sha256_native_hash::supported(k))
+		{
+			state.SkipWithError("kernel is not supported by the CPU");
+			return;
+		}
+
+		for (auto _ : state)
+		{
+			auto digest = hs::sha256_native_hash::hash(k, line);
+			benchmark::DoNotOptimize(digest);
+		}
+		state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+		state.SetItemsProcessed(int64_t(state.iterations()));
+	}
+	BENCHMARK(BM_Sha256OneShot)->ArgsProduct({{16, 64, 256, 1024, 4096},
+											 {int64_t(hs::sha256_native_hash::kernel::portable),
+											  int64_t(hs::sha256_native_hash::kernel::avx2),
+											  int64_t(hs::sha256_native_hash::kernel::sha_ni)}})->UseRealTime();
+
+	/**
+	 * @brief Short lines hashed side by side, see `session::hash_batch()`.
+	 */
+	void BM_Sha256Batch(benchmark::State &state) {
+		const auto lineSize = size_t(state.range(0));
+		constexpr size_t lines = 64;
+		const std::vector<std::string_view> messages(lines, payload(lineSize));
+		std::vector<hs::sha256_batch::digest> digests(lines);
+
+		for (auto _ : state)
+		{
+			hs::sha256_batch::hash(messages.data(), messages.size(), digests.data());
+			benchmark::DoNotOptimize(digests.data());
+		}
+		state.SetBytesProcessed(int64_t(state.iterations() * lines * lineSize));
+		state.SetItemsProcessed(int64_t(state.iterations() * lines));
+	}
+	BENCHMARK(BM_Sha256Batch)->RangeMultiplier(4)->Range(8, 512);
+
+	/**
+	 * @brief Short lines of a receive as hashed by the session, from a lone line to full groups.
+	 */
+	void BM_Sha256Messages(benchmark::State &state) {
+		const auto lineSize = size_t(state.range(0));
+		const auto lines = size_t(state.range(1));
+		const std::vector<std::string_view> messages(lines, payload(lineSize));
+		std::vector<hs::sha256_batch::digest> digests(lines);
+
+		for (auto _ : state)
+		{
+			hs::sha256_messages(messages.data(), messages.size(), digests.data());
+			benchmark::DoNotOptimize(digests.data());
+		}
+		state.SetBytesProcessed(int64_t(state.iterations() * lines * lineSize));
+		state.SetItemsProcessed(int64_t(state.iterations() * lines));
+	}
+	BENCHMARK(BM_Sha256Messages)->ArgsProduct({{16, 512}, {1, 3, 16, 64}});
+
+	void BM_ToHex(benchmark::State &state) {
+		std::array<uint8_t, 32> digest{};
+		std::iota(digest.begin(), digest.end(), uint8_t(0));
+
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(digest);
+			auto hex = hs::to_hex(digest);
+			benchmark::DoNotOptimize(hex);
+		}
+		state.SetBytesProcessed(int64_t(state.iterations() * digest.size()));
+	}
+	BENCHMARK(BM_ToHex);
+
+	/**
+	 * @brief Hex lines of a batch of digests written into a single buffer, as queued by the session.
+	 */
+	void BM_HexLines(benchmark::State &state) {
+		const auto kernel = hs::hex_encoder::kernel(state.range(0));
+		if (!hs::hex_encoder::supported(kernel))
+		{
+			state.SkipWithError("not supported by the CPU");
+			return;
+		}
+
+		const auto count = size_t(state.range(1));
+		std::vector<std::array<uint8_t, 32>> digests(count);
+		for (size_t i = 0; i < count; ++i)
+			std::iota(digests[i].begin(), digests[i].end(), uint8_t(i));
+		std::vector<uint8_t> out(count * hs::hex_encoder::line_size<32>);
+
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(digests.data());
+			hs::hex_encoder::encode_lines(kernel, digests.data(), count, out.data());
+			benchmark::DoNotOptimize(out.data());
+		}
+		state.SetItemsProcessed(int64_t(state.iterations() * count));
+	}
+	BENCHMARK(BM_HexLines)->ArgsProduct({{int64_t(hs::hex_encoder::kernel::scalar),
+										 int64_t(hs::hex_encoder::kernel::ssse3),
+										 int64_t(hs::hex_encoder::kernel::avx2)},
+										{1, 64}})->ArgNames({"kernel", "lines"});
+
+	constexpr size_t receive_size = 2048;
+	constexpr size_t stream_size = 1 << 20;
+
+	/**
+	 * @brief Feeds the stream into the buffer as receives of `receive_size` bytes,
+	 * invoking `consume(chunk, lineComplete)` for every chunk and `consumed()` once a receive is consumed.
+	 */
+	template <typename F, typename G>
+	void frame(std::string_view stream, hs::line_buffer<receive_size> &buffer, F &&consume, G &&consumed) {
+		for (size_t offset = 0; offset < stream.size(); offset += receive_size)
+		{
+			const size_t received = std::min(receive_size, stream.size() - offset);
+			std::memcpy(buffer.data(), stream.data() + offset, received);
+			buffer.commit(received);
+			while (!buffer.empty())
+			{
+				const auto [chunk, lineComplete] = buffer.next_chunk('\n');
+				consume(chunk, lineComplete);
+			}
+			consumed();
+		}
+	}
+
+	/**
+	 * @brief Line scanning of the receive buffer alone.
+	 */
+	void BM_LineBuffer(benchmark::State &state) {
+		const std::string stream = make_stream(size_t(state.range(0)), stream_size);
+		hs::line_buffer<receive_size> buffer{};
+
+		for (auto _ : state)
+		{
+			size_t lines = 0;
+			frame(stream, buffer, [&lines](std::string_view chunk, bool lineComplete) {
+				benchmark::DoNotOptimize(chunk.data());
+				lines += lineComplete;
+			}, []{});
+			benchmark::DoNotOptimize(lines);
+		}
+		state.SetBytesProcessed(int64_t(state.iterations() * stream.size()));
+	}
+	BENCHMARK(BM_LineBuffer)->RangeMultiplier(8)->Range(8, 1 << 20);
+
+	void BM_OutputQueue(benchmark::State &state) {
+		const auto lines = size_t(state.range(0));
+		hs::output_queue output{65};
+		std::array<uint8_t, 65> hexLine{};
+
+		for (auto _ : state)
+		{
+			for (size_t i = 0; i < lines; ++i)
+				output.push(hexLine);
+			benchmark::DoNotOptimize(output.begin_write().data());
+			output.end_write();
+		}
+		state.SetItemsProcessed(int64_t(state.iterations() * lines));
+	}
+	BENCHMARK(BM_OutputQueue)->RangeMultiplier(8)->Range(1, 512);
+
+	/**
+	 * @brief Encoding state without sockets: framing, batching of short lines, hashing, hex encoding into the queue
+	 * of the responses, as done by `session::encoding()` for a stream of lines of the given size.
+	 */
+	void BM_Encoding(benchmark::State &state) {
+		constexpr size_t batch_line_limit = 512;
+		const std::string stream = make_stream(size_t(state.range(0)), std::max(stream_size, size_t(state.range(0)) + 1));
+		hs::line_buffer<receive_size> buffer{};
+		hs::output_queue output{65};
+		std::vector<std::string_view> batchLines{};
+		std::vector<hs::sha256_batch::digest> batchDigests{};
+		auto hash = hs::sha256_hash::create();
+		if (!hash)
+		{
+			state.SkipWithError("sha256_hash::create() failed");
+			return;
+		}
+
+		const auto queue = [&output](const auto *digests, size_t count) {
+			hs::hex_encoder::encode_lines(digests, count, output.append(count * hs::hex_encoder::line_size<32>));
+		};
+		const auto hashBatch = [&] {
+			if (batchLines.empty())
+				return;
+			batchDigests.resize(batchLines.size());
+			hs::sha256_batch::hash(batchLines.data(), batchLines.size(), batchDigests.data());
+			queue(batchDigests.data(), batchDigests.size());
+			batchLines.clear();
+		};
+
+		for (auto _ : state)
+		{
+			bool lineInProgress = false;
+			frame(stream, buffer, [&](std::string_view chunk, bool lineComplete) {
+				if (lineComplete && !lineInProgress && chunk.size() <= batch_line_limit)
+				{
+					batchLines.push_back(chunk);
+					return;
+				}
+
+				hashBatch();
+				hash->update(chunk);
+				lineInProgress = !lineComplete;
+				if (lineComplete)
+				{
+					const auto digest = hash->finalize();
+					queue(&*digest, 1);
+				}
+			}, hashBatch);
+			benchmark::DoNotOptimize(output.begin_write().data());
+			output.end_write();
+		}
+		state.SetBytesProcessed(int64_t(state.iterations() * stream.size()));
+	}
+	BENCHMARK(BM_Encoding)->RangeMultiplier(8)->Range(8, 1 << 20);
+}
+
+BENCHMARK_MAIN();
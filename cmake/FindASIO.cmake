@@ -25,6 +25,12 @@ find_path(ASIO_INCLUDE_DIR
 #        NO_DEFAULT_PATH
         )
 
+# e.g. 101800 for 1.18.0
+if (ASIO_INCLUDE_DIR AND EXISTS "${ASIO_INCLUDE_DIR}/asio/version.hpp")
+    file(STRINGS "${ASIO_INCLUDE_DIR}/asio/version.hpp" ASIO_VERSION_LINE REGEX "^#define ASIO_VERSION [0-9]+")
+    string(REGEX REPLACE "^#define ASIO_VERSION ([0-9]+).*" "\\1" ASIO_VERSION_NUMBER "${ASIO_VERSION_LINE}")
+endif ()
+
 include(FindPackageHandleStandardArgs)
 find_package_handle_standard_args(ASIO
         REQUIRED_VARS ASIO_INCLUDE_DIR
@@ -0,0 +1,34 @@
+find_path(BLAKE3_INCLUDE_DIR
+        NAMES
+        blake3.h
+        HINTS
+        $ENV{BLAKE3_ROOT}
+        ${BLAKE3_ROOT}
+        PATH_SUFFIXES
+        include
+        )
+
+find_library(BLAKE3_LIBRARY
+        NAMES
+        blake3
+        HINTS
+        $ENV{BLAKE3_ROOT}
+        ${BLAKE3_ROOT}
+        PATH_SUFFIXES
+        lib
+        )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(BLAKE3
+        REQUIRED_VARS BLAKE3_INCLUDE_DIR BLAKE3_LIBRARY
+        FAIL_MESSAGE "BLAKE3 was not found")
+
+if (${BLAKE3_FOUND})
+    if (NOT TARGET BLAKE3::BLAKE3)
+        add_library(BLAKE3::BLAKE3 UNKNOWN IMPORTED)
+        set_target_properties(BLAKE3::BLAKE3 PROPERTIES
+                IMPORTED_LOCATION ${BLAKE3_LIBRARY}
+                INTERFACE_INCLUDE_DIRECTORIES ${BLAKE3_INCLUDE_DIR})
+        message(STATUS "BLAKE3 include dir: ${BLAKE3_INCLUDE_DIR}")
+    endif()
+endif ()
@@ -0,0 +1,34 @@
+find_path(LIBURING_INCLUDE_DIR
+        NAMES
+        liburing.h
+        HINTS
+        $ENV{LIBURING_ROOT}
+        ${LIBURING_ROOT}
+        PATH_SUFFIXES
+        include
+        )
+
+find_library(LIBURING_LIBRARY
+        NAMES
+        uring
+        HINTS
+        $ENV{LIBURING_ROOT}
+        ${LIBURING_ROOT}
+        PATH_SUFFIXES
+        lib
+        )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibUring
+        REQUIRED_VARS LIBURING_INCLUDE_DIR LIBURING_LIBRARY
+        FAIL_MESSAGE "liburing was not found")
+
+if (${LibUring_FOUND})
+    if (NOT TARGET LibUring::LibUring)
+        add_library(LibUring::LibUring UNKNOWN IMPORTED)
+        set_target_properties(LibUring::LibUring PROPERTIES
+                IMPORTED_LOCATION ${LIBURING_LIBRARY}
+                INTERFACE_INCLUDE_DIRECTORIES ${LIBURING_INCLUDE_DIR})
+        message(STATUS "liburing include dir: ${LIBURING_INCLUDE_DIR}")
+    endif()
+endif ()
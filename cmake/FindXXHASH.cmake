@@ -0,0 +1,34 @@
+find_path(XXHASH_INCLUDE_DIR
+        NAMES
+        xxhash.h
+        HINTS
+        $ENV{XXHASH_ROOT}
+        ${XXHASH_ROOT}
+        PATH_SUFFIXES
+        include
+        )
+
+find_library(XXHASH_LIBRARY
+        NAMES
+        xxhash
+        HINTS
+        $ENV{XXHASH_ROOT}
+        ${XXHASH_ROOT}
+        PATH_SUFFIXES
+        lib
+        )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(XXHASH
+        REQUIRED_VARS XXHASH_INCLUDE_DIR XXHASH_LIBRARY
+        FAIL_MESSAGE "XXHASH was not found")
+
+if (${XXHASH_FOUND})
+    if (NOT TARGET XXHASH::XXHASH)
+        add_library(XXHASH::XXHASH UNKNOWN IMPORTED)
+        set_target_properties(XXHASH::XXHASH PROPERTIES
+                IMPORTED_LOCATION ${XXHASH_LIBRARY}
+                INTERFACE_INCLUDE_DIRECTORIES ${XXHASH_INCLUDE_DIR})
+        message(STATUS "XXHASH include dir: ${XXHASH_INCLUDE_DIR}")
+    endif()
+endif ()
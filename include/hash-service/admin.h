@@ -0,0 +1,156 @@
+#pragma once
+
+#include "hash-service/logging.h"
+#include "hash-service/metrics.h"
+#include "hash-service/trace.h"
+
+#include <asio.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace hs {
+	/**
+	 * @brief Local HTTP endpoint exposing the server metrics.
+	 *
+	 * Listens to the loopback interface only. Serves a single request per connection:
+	 * - `GET /metrics` the Prometheus text format
+	 * - `GET /metrics.json` a JSON object
+	 * - `GET /trace` the latest tracepoints as a Chrome trace, if tracing is compiled in, see `trace_json()`
+	 *
+	 * Scrapes are rare: a snapshot is merged and formatted on the I/O thread serving the request.
+	 */
+	class admin_server
+	{
+		using tcp = asio::ip::tcp;
+
+	 public:
+		struct config
+		{
+			uint16_t port;
+			const metrics *source;
+			leveled_logger logger;
+		};
+
+		/**
+		 * Constructor.
+		 * Upon instantiation begins asynchronously accepting new tcp connections.
+		 * @throws asio::system_error if failed to listen to the port
+		 */
+		admin_server(asio::io_context &executor, const config &conf)
+			: _acceptor(executor, tcp::endpoint(asio::ip::address_v4::loopback(), conf.port)),
+			  _strand(executor.get_executor()),
+			  _metrics(conf.source),
+			  _logger(conf.logger)
+		{
+			_logger.message("admin endpoint listening to port: ", _acceptor.local_endpoint().port());
+			accepting();
+		}
+
+		admin_server(const admin_server&) = delete;
+		admin_server& operator=(const admin_server&) = delete;
+
+		/**
+		 * Stops accepting. Requests in progress are completed.
+		 */
+		void stop() {
+			asio::post(_strand, [this]{
+			  _stopped = true;
+			  asio::error_code errorCode{};
+			  _acceptor.cancel(errorCode);
+			});
+		}
+
+	 private:
+		constexpr static size_t max_request_size = 8 * 1024;
+
+		struct request
+		{
+			explicit request(tcp::socket &&socket)
+				: socket(std::move(socket)),
+				  input(max_request_size)
+			{}
+
+			tcp::socket socket;
+			asio::streambuf input;
+			std::string response;
+		};
+
+		void accepting() noexcept {
+			const char *func_name = __func__;
+			_acceptor.async_accept(asio::bind_executor(_strand, [this, func_name](asio::error_code err, tcp::socket socket){
+			  if (_stopped || err == asio::error::operation_aborted)
+				  return;
+
+			  if (err)
+				  _logger.error("admin_server::", func_name, ": error: ", err);
+			  else
+				  serving(std::make_shared<request>(std::move(socket)));
+			  accepting();
+			}));
+		}
+
+		void serving(std::shared_ptr<request> req) noexcept {
+			auto &socket = req->socket;
+			auto &input = req->input;
+			asio::async_read_until(socket, input, "\r\n\r\n",
+				[this, req = std::move(req)](asio::error_code err, size_t /*bytesRead*/) mutable {
+				if (err)
+					return;
+
+				const auto data = req->input.data();
+				const std::string head{asio::buffers_begin(data), asio::buffers_end(data)};
+				req->response = respond(head.substr(0, head.find("\r\n")));
+
+				auto &socket = req->socket;
+				const auto buffer = asio::buffer(req->response);
+				asio::async_write(socket, buffer, [req = std::move(req)](asio::error_code, size_t) {
+					asio::error_code errorCode{};
+					req->socket.shutdown(tcp::socket::shutdown_both, errorCode);
+				});
+			});
+		}
+
+		/**
+		 * @param requestLine e.g. "GET /metrics HTTP/1.1"
+		 * @return complete HTTP response.
+		 */
+		[[nodiscard]] std::string respond(std::string_view requestLine) const {
+			const size_t iPath = requestLine.find(' ');
+			const size_t iVersion = requestLine.find(' ', iPath + 1);
+			const std::string_view method = requestLine.substr(0, iPath),
+				path = iPath == std::string_view::npos ? std::string_view() : requestLine.substr(iPath + 1, iVersion - iPath - 1);
+
+			if (method != "GET")
+				return make_response("405 Method Not Allowed", "text/plain", "method not allowed\n");
+			if (path == "/metrics")
+				return make_response("200 OK", "text/plain; version=0.0.4", to_prometheus(_metrics->snapshot()));
+			if (path == "/metrics.json")
+				return make_response("200 OK", "application/json", to_json(_metrics->snapshot()));
+			if (tracing_compiled && path == "/trace")
+				return make_response("200 OK", "application/json", trace_json());
+			return make_response("404 Not Found", "text/plain", "not found\n");
+		}
+
+		static std::string make_response(std::string_view status, std::string_view contentType, const std::string &body) {
+			std::string response{};
+			response.append("HTTP/1.1 ").append(status).append("\r\n")
+				.append("Content-Type: ").append(contentType).append("\r\n")
+				.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n")
+				.append("Connection: close\r\n\r\n")
+				.append(body);
+			return response;
+		}
+
+		tcp::acceptor _acceptor;
+		// serializes accepting with stop()
+		asio::strand<asio::io_context::executor_type> _strand;
+		bool _stopped = false;
+		const metrics *_metrics;
+		leveled_logger _logger;
+	};
+}
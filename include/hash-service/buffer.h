@@ -0,0 +1,310 @@
+#pragma once
+
+#include "hash-service/buffer_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+	/**
+	 * A chunk of a line extracted from the buffer.
+	 */
+	struct line_chunk
+	{
+		std::string_view data; // never includes the terminator
+		bool complete; // `true` if the terminator has been consumed
+	};
+
+	/**
+	 * Sizing of the receive buffers borrowed from `buffer_pool`.
+	 * A session's buffer starts at `min_size`, doubles after every receive filling it up, up to `max_size`,
+	 * and halves after every receive filling less than a quarter of it.
+	 */
+	struct receive_policy
+	{
+		size_t min_size = buffer_pool::min_size;
+		size_t max_size = 256 * 1024; // rounded up to a power of two, `buffer_pool::max_size` at most
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_receive_policy
+		{
+			constexpr receive_policy operator()(const Config&) const noexcept {
+				return receive_policy{};
+			}
+		};
+
+		template <typename Config>
+		struct _get_receive_policy<Config, std::void_t<decltype(std::declval<Config>().receive)>>
+		{
+			constexpr receive_policy operator()(const Config& c) const noexcept {
+				return c.receive;
+			}
+		};
+
+		/**
+		 * @brief Read cursor over the received bytes of a buffer.
+		 */
+		class line_cursor
+		{
+		 public:
+			void commit(size_t bytes) noexcept {
+				_begin = 0;
+				_end = bytes;
+			}
+
+			[[nodiscard]] size_t pending() const noexcept {
+				return _end - _begin;
+			}
+
+			[[nodiscard]] bool empty() const noexcept {
+				return _begin == _end;
+			}
+
+			[[nodiscard]] std::string_view pending_data(const uint8_t *storage) const noexcept {
+				return std::string_view(reinterpret_cast<const char*>(storage) + _begin, pending());
+			}
+
+			void consume(size_t bytes) noexcept {
+				_begin += bytes;
+				if (_begin >= _end)
+					_begin = _end = 0;
+			}
+
+			line_chunk next_chunk(const uint8_t *storage, char term, size_t limit) noexcept {
+				const auto *iBegin = reinterpret_cast<const char*>(storage) + _begin;
+				const size_t bytes = std::min(pending(), limit);
+				const auto *iTerm = static_cast<const char*>(std::memchr(iBegin, term, bytes));
+				if (!iTerm)
+				{
+					consume(bytes);
+					return line_chunk{std::string_view(iBegin, bytes), false};
+				}
+
+				const size_t dataLength = size_t(iTerm - iBegin);
+				_begin += dataLength + 1;
+				if (_begin == _end)
+					_begin = _end = 0;
+				return line_chunk{std::string_view(iBegin, dataLength), true};
+			}
+
+		 private:
+			size_t _begin = 0,
+				_end = 0;
+		};
+	}
+
+	template <typename Config>
+	constexpr static receive_policy get_receive_policy(const Config &c) noexcept {
+		return detail::_get_receive_policy<std::decay_t<Config>>{}(c);
+	}
+
+	/**
+	 * @brief Receive buffer with a read cursor.
+	 *
+	 * The buffer is filled by a single receive operation (`data()`/`capacity()` + `commit()`),
+	 * then consumed chunk by chunk with `next_chunk()`. Every call returns either a complete line
+	 * (terminator found) or the trailing part of a line that is continued by the next receive.
+	 * Consumed bytes are never moved: the cursor advances and the buffer is rewound
+	 * once everything has been consumed.
+	 *
+	 * The terminator is located with `std::memchr`, which is vectorized by the standard library.
+	 *
+	 * @tparam Capacity size of the underlying storage
+	 */
+	template <size_t Capacity>
+	class line_buffer
+	{
+	 public:
+		constexpr static size_t buffer_capacity = Capacity;
+
+		/**
+		 * @return pointer to the storage to receive data into. Valid only when the buffer is empty.
+		 */
+		[[nodiscard]] uint8_t *data() noexcept {
+			return _storage.data();
+		}
+
+		[[nodiscard]] constexpr size_t capacity() const noexcept {
+			return Capacity;
+		}
+
+		/**
+		 * @brief Makes `bytes` received bytes available for reading, resetting the cursor.
+		 */
+		void commit(size_t bytes) noexcept {
+			_cursor.commit(bytes < Capacity ? bytes : Capacity);
+		}
+
+		/**
+		 * @return number of bytes that have not been consumed yet.
+		 */
+		[[nodiscard]] size_t pending() const noexcept {
+			return _cursor.pending();
+		}
+
+		[[nodiscard]] bool empty() const noexcept {
+			return _cursor.empty();
+		}
+
+		/**
+		 * @brief Consumes bytes up to and including the next terminator.
+		 * If no terminator is found, consumes all the pending bytes.
+		 * @param term line terminator
+		 * @param limit bytes to scan at most: if no terminator is found within them, consumes only them
+		 * @return consumed chunk. `data` is empty if the buffer is empty or the line is empty.
+		 */
+		line_chunk next_chunk(char term = '\n', size_t limit = SIZE_MAX) noexcept {
+			return _cursor.next_chunk(_storage.data(), term, limit);
+		}
+
+		/**
+		 * @return the bytes that have not been consumed yet, for the caller to consume without scanning.
+		 */
+		[[nodiscard]] std::string_view pending_data() const noexcept {
+			return _cursor.pending_data(_storage.data());
+		}
+
+		/**
+		 * @brief Consumes `bytes` of `pending_data()`. Consumed bytes stay valid until the next `commit()`.
+		 */
+		void consume(size_t bytes) noexcept {
+			_cursor.consume(bytes);
+		}
+
+	 private:
+		std::array<uint8_t, Capacity> _storage{};
+		detail::line_cursor _cursor;
+	};
+
+	/**
+	 * @brief `line_buffer` whose storage is borrowed from `buffer_pool` only while there are bytes to consume.
+	 *
+	 * `acquire()` borrows storage of the current target size before a receive, `release()` returns it once
+	 * everything has been consumed, so that idle sessions hold no receive buffer.
+	 * The target size adapts to the traffic according to the `receive_policy`.
+	 *
+	 * Not thread-safe: must be accessed from the session's strand.
+	 */
+	class pooled_line_buffer
+	{
+	 public:
+		explicit pooled_line_buffer(const receive_policy &policy = {}) noexcept
+			: _minSize(detail::buffer_free_lists::round_up(policy.min_size)),
+			  _maxSize(detail::buffer_free_lists::round_up(policy.max_size < policy.min_size ? policy.min_size
+																							  : policy.max_size)),
+			  _targetSize(_minSize)
+		{}
+
+		/**
+		 * @brief Borrows storage of `target_size()` bytes, unless the buffer already holds some.
+		 * @throws std::bad_alloc
+		 */
+		void acquire() {
+			if (!_storage)
+				_storage = buffer_pool::acquire(_targetSize);
+		}
+
+		/**
+		 * @brief Returns the storage to the pool. No-op unless everything has been consumed.
+		 */
+		void release() noexcept {
+			if (empty())
+				_storage.reset();
+		}
+
+		/**
+		 * @brief Hands the storage over to the caller, so that chunks referring to it outlive the next receive.
+		 * @pre `empty()`
+		 * @return the storage, empty if none has been acquired.
+		 */
+		[[nodiscard]] pooled_buffer detach() noexcept {
+			return std::move(_storage);
+		}
+
+		[[nodiscard]] bool acquired() const noexcept {
+			return bool(_storage);
+		}
+
+		/**
+		 * @return pointer to the storage to receive data into. Valid only when the buffer is empty.
+		 * @pre `acquired()`
+		 */
+		[[nodiscard]] uint8_t *data() noexcept {
+			return _storage.data();
+		}
+
+		/**
+		 * @return size of the acquired storage, 0 if none.
+		 */
+		[[nodiscard]] size_t capacity() const noexcept {
+			return _storage.size();
+		}
+
+		/**
+		 * @return size of the storage to be acquired next.
+		 */
+		[[nodiscard]] size_t target_size() const noexcept {
+			return _targetSize;
+		}
+
+		/**
+		 * @brief Makes `bytes` received bytes available for reading, resetting the cursor, and adapts the target size.
+		 */
+		void commit(size_t bytes) noexcept {
+			const size_t size = capacity();
+			if (bytes >= size)
+			{
+				bytes = size;
+				if (_targetSize < _maxSize)
+					_targetSize *= 2;
+			}
+			else if (bytes < size / 4 && _targetSize > _minSize)
+				_targetSize /= 2;
+			_cursor.commit(bytes);
+		}
+
+		[[nodiscard]] size_t pending() const noexcept {
+			return _cursor.pending();
+		}
+
+		[[nodiscard]] bool empty() const noexcept {
+			return _cursor.empty();
+		}
+
+		/**
+		 * @brief See `line_buffer::next_chunk()`.
+		 */
+		line_chunk next_chunk(char term = '\n', size_t limit = SIZE_MAX) noexcept {
+			return _cursor.next_chunk(_storage.data(), term, limit);
+		}
+
+		/**
+		 * @brief See `line_buffer::pending_data()`.
+		 */
+		[[nodiscard]] std::string_view pending_data() const noexcept {
+			return _cursor.pending_data(_storage.data());
+		}
+
+		/**
+		 * @brief See `line_buffer::consume()`.
+		 */
+		void consume(size_t bytes) noexcept {
+			_cursor.consume(bytes);
+		}
+
+	 private:
+		pooled_buffer _storage;
+		detail::line_cursor _cursor;
+		size_t _minSize,
+			_maxSize,
+			_targetSize;
+	};
+}
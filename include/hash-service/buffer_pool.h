@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <new>
+#include <utility>
+
+namespace hs {
+	/**
+	 * @brief Process-wide usage of the receive buffers, see `buffer_pool`.
+	 */
+	struct buffer_pool_stats
+	{
+		uint64_t buffers_in_use = 0;
+		uint64_t bytes_in_use = 0;
+		// high-water mark of `bytes_in_use`
+		uint64_t peak_bytes_in_use = 0;
+		// bytes kept by the per-thread free lists
+		uint64_t bytes_cached = 0;
+	};
+
+	namespace detail {
+		struct buffer_pool_counters
+		{
+			std::atomic<uint64_t> buffersInUse{0};
+			std::atomic<uint64_t> bytesInUse{0};
+			std::atomic<uint64_t> peakBytesInUse{0};
+			std::atomic<uint64_t> bytesCached{0};
+
+			void acquired(size_t size) noexcept {
+				buffersInUse.fetch_add(1, std::memory_order_relaxed);
+				const uint64_t inUse = bytesInUse.fetch_add(size, std::memory_order_relaxed) + size;
+				uint64_t peak = peakBytesInUse.load(std::memory_order_relaxed);
+				while (inUse > peak && !peakBytesInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed))
+				{}
+			}
+
+			void released(size_t size) noexcept {
+				buffersInUse.fetch_sub(1, std::memory_order_relaxed);
+				bytesInUse.fetch_sub(size, std::memory_order_relaxed);
+			}
+		};
+
+		inline buffer_pool_counters &buffer_counters() noexcept {
+			static buffer_pool_counters counters{};
+			return counters;
+		}
+
+		/**
+		 * @brief Per-thread free lists of receive buffers, a list per power-of-two size class.
+		 * A class keeps at most `max(min_cached_buffers, max_cached_bytes / size)` buffers.
+		 */
+		class buffer_free_lists
+		{
+		 public:
+			constexpr static size_t min_size = 2 * 1024;
+			constexpr static size_t max_size = 1024 * 1024;
+			constexpr static size_t classes = 10;
+			constexpr static size_t max_cached_bytes = 1024 * 1024;
+			constexpr static size_t min_cached_buffers = 2;
+
+			static_assert(min_size << (classes - 1) == max_size);
+
+			buffer_free_lists() = default;
+			buffer_free_lists(const buffer_free_lists&) = delete;
+			buffer_free_lists& operator=(const buffer_free_lists&) = delete;
+
+			~buffer_free_lists() {
+				for (size_t iClass = 0; iClass < classes; ++iClass)
+				{
+					free_list &list = _lists[iClass];
+					while (list.head)
+					{
+						free_buffer *next = list.head->next;
+						::operator delete(list.head);
+						list.head = next;
+					}
+					buffer_counters().bytesCached.fetch_sub(list.count * class_size(iClass), std::memory_order_relaxed);
+				}
+			}
+
+			/**
+			 * @return the smallest class size not less than `size`, clamped to [`min_size`, `max_size`].
+			 */
+			constexpr static size_t round_up(size_t size) noexcept {
+				return class_size(class_of(size));
+			}
+
+			[[nodiscard]] void *acquire(size_t size) {
+				free_list &list = _lists[class_of(size)];
+				if (!list.head)
+					return ::operator new(size);
+
+				free_buffer *buffer = list.head;
+				list.head = buffer->next;
+				--list.count;
+				buffer_counters().bytesCached.fetch_sub(size, std::memory_order_relaxed);
+				return buffer;
+			}
+
+			void release(void *p, size_t size) noexcept {
+				free_list &list = _lists[class_of(size)];
+				if (list.count >= std::max(min_cached_buffers, max_cached_bytes / size))
+				{
+					::operator delete(p);
+					return;
+				}
+
+				auto *buffer = static_cast<free_buffer*>(p);
+				buffer->next = list.head;
+				list.head = buffer;
+				++list.count;
+				buffer_counters().bytesCached.fetch_add(size, std::memory_order_relaxed);
+			}
+
+		 private:
+			struct free_buffer
+			{
+				free_buffer *next;
+			};
+
+			struct free_list
+			{
+				free_buffer *head = nullptr;
+				size_t count = 0;
+			};
+
+			constexpr static size_t class_of(size_t size) noexcept {
+				size_t iClass = 0;
+				while (iClass + 1 < classes && class_size(iClass) < size)
+					++iClass;
+				return iClass;
+			}
+
+			constexpr static size_t class_size(size_t iClass) noexcept {
+				return min_size << iClass;
+			}
+
+			std::array<free_list, classes> _lists{};
+		};
+
+		// set once the thread's free lists are destroyed: buffers released later during the thread's exit are freed
+		inline thread_local bool bufferFreeListsDestroyed = false;
+
+		struct thread_buffer_free_lists : buffer_free_lists
+		{
+			~thread_buffer_free_lists() {
+				bufferFreeListsDestroyed = true;
+			}
+		};
+
+		inline buffer_free_lists *this_thread_buffer_free_lists() noexcept {
+			if (bufferFreeListsDestroyed)
+				return nullptr;
+			thread_local thread_buffer_free_lists lists{};
+			return &lists;
+		}
+	}
+
+	/**
+	 * @brief Receive buffer borrowed from `buffer_pool`, returned to the pool of the releasing thread.
+	 */
+	class pooled_buffer
+	{
+	 public:
+		pooled_buffer() noexcept = default;
+
+		pooled_buffer(const pooled_buffer&) = delete;
+		pooled_buffer& operator=(const pooled_buffer&) = delete;
+
+		pooled_buffer(pooled_buffer &&other) noexcept
+			: _data(std::exchange(other._data, nullptr)),
+			  _size(std::exchange(other._size, 0))
+		{}
+
+		pooled_buffer& operator=(pooled_buffer &&other) noexcept {
+			if (this != &other)
+			{
+				reset();
+				_data = std::exchange(other._data, nullptr);
+				_size = std::exchange(other._size, 0);
+			}
+			return *this;
+		}
+
+		~pooled_buffer() {
+			reset();
+		}
+
+		[[nodiscard]] uint8_t *data() const noexcept {
+			return _data;
+		}
+
+		[[nodiscard]] size_t size() const noexcept {
+			return _size;
+		}
+
+		explicit operator bool() const noexcept {
+			return _data != nullptr;
+		}
+
+		/**
+		 * @brief Returns the buffer to the calling thread's pool.
+		 */
+		void reset() noexcept {
+			if (!_data)
+				return;
+
+			detail::buffer_counters().released(_size);
+			if (auto *lists = detail::this_thread_buffer_free_lists())
+				lists->release(_data, _size);
+			else
+				::operator delete(_data);
+			_data = nullptr;
+			_size = 0;
+		}
+
+	 private:
+		friend class buffer_pool;
+
+		pooled_buffer(uint8_t *data, size_t size) noexcept
+			: _data(data),
+			  _size(size)
+		{}
+
+		uint8_t *_data = nullptr;
+		size_t _size = 0;
+	};
+
+	/**
+	 * @brief Pool of receive buffers.
+	 *
+	 * Buffers are recycled through per-thread free lists by power-of-two size classes from 2 KiB to 1 MiB,
+	 * so that only sessions with data to process hold a buffer. Usage is accounted process-wide.
+	 *
+	 * @threadsafe All the member functions may be called from multiple threads.
+	 */
+	class buffer_pool
+	{
+	 public:
+		constexpr static size_t min_size = detail::buffer_free_lists::min_size;
+		constexpr static size_t max_size = detail::buffer_free_lists::max_size;
+
+		/**
+		 * @return a buffer of at least `size` bytes, of `max_size` at most.
+		 * @throws std::bad_alloc
+		 */
+		[[nodiscard]] static pooled_buffer acquire(size_t size) {
+			const size_t rounded = detail::buffer_free_lists::round_up(size);
+			auto *lists = detail::this_thread_buffer_free_lists();
+			void *data = lists ? lists->acquire(rounded) : ::operator new(rounded);
+			detail::buffer_counters().acquired(rounded);
+			return pooled_buffer(static_cast<uint8_t*>(data), rounded);
+		}
+
+		[[nodiscard]] static buffer_pool_stats stats() noexcept {
+			const auto &counters = detail::buffer_counters();
+			return buffer_pool_stats{counters.buffersInUse.load(std::memory_order_relaxed),
+									 counters.bytesInUse.load(std::memory_order_relaxed),
+									 counters.peakBytesInUse.load(std::memory_order_relaxed),
+									 counters.bytesCached.load(std::memory_order_relaxed)};
+		}
+	};
+}
@@ -0,0 +1,455 @@
+#pragma once
+
+#include "hash-service/hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	namespace detail {
+		constexpr std::array<char, 4> checkpoint_magic{'H', 'S', 'C', '1'};
+		// magic, state, byte count, tail
+		constexpr size_t checkpoint_record_size = checkpoint_magic.size() + 8 * 4 + 8 + 64;
+
+		inline std::array<uint8_t, checkpoint_record_size> serialize(const sha256_checkpoint &cp) noexcept {
+			std::array<uint8_t, checkpoint_record_size> record{};
+			uint8_t *p = record.data();
+			for (char c : checkpoint_magic)
+				*p++ = uint8_t(c);
+			for (uint32_t word : cp.state)
+				for (int shift = 24; shift >= 0; shift -= 8)
+					*p++ = uint8_t(word >> shift);
+			for (int shift = 56; shift >= 0; shift -= 8)
+				*p++ = uint8_t(cp.bytes >> shift);
+			for (uint8_t byte : cp.tail)
+				*p++ = byte;
+			return record;
+		}
+
+		inline std::optional<sha256_checkpoint> deserialize(const std::array<uint8_t, checkpoint_record_size> &record) noexcept {
+			const uint8_t *p = record.data();
+			for (char c : checkpoint_magic)
+				if (*p++ != uint8_t(c))
+					return std::nullopt;
+
+			sha256_checkpoint cp{};
+			for (uint32_t &word : cp.state)
+				for (int i = 0; i < 4; ++i)
+					word = word << 8 | *p++;
+			for (int i = 0; i < 8; ++i)
+				cp.bytes = cp.bytes << 8 | *p++;
+			for (uint8_t &byte : cp.tail)
+				byte = *p++;
+			return cp;
+		}
+	}
+
+	/**
+	 * @brief Bounded store of the checkpoints of long lines, by resume token.
+	 *
+	 * Keeps the most recently stored `capacity` checkpoints in memory. The least recently used ones are
+	 * spilled to files of the `directory`, if set, and dropped otherwise. At most `disk_capacity` files
+	 * are written, the oldest ones are removed first. Spilled checkpoints survive a restart of the server.
+	 *
+	 * The mutex only guards the memory. Files are written and removed by `flush()`, that the sessions leave
+	 * to the compute pool, and read by `get()` out of the mutex. Evicted checkpoints are kept until written.
+	 *
+	 * @threadsafe All the member functions may be called from multiple threads.
+	 */
+	class checkpoint_store
+	{
+	 public:
+		constexpr static size_t token_length = 32;
+
+		struct config
+		{
+			size_t capacity = 1024;
+			// checkpoints are not spilled if empty
+			std::string directory;
+			size_t disk_capacity = 64 * 1024;
+		};
+
+		explicit checkpoint_store(config conf)
+			: _config(std::move(conf))
+		{}
+
+		checkpoint_store(const checkpoint_store&) = delete;
+		checkpoint_store& operator=(const checkpoint_store&) = delete;
+
+		~checkpoint_store() {
+			flush();
+		}
+
+		/**
+		 * @return a new random token, `token_length` lowercase hex characters.
+		 */
+		[[nodiscard]] static std::string make_token() {
+			constexpr const char hexDigits[] = "0123456789abcdef";
+			std::random_device device{};
+			std::string token(token_length, '0');
+			for (size_t i = 0; i < token_length; i += 8)
+			{
+				const uint32_t bits = device();
+				for (size_t j = 0; j < 8; ++j)
+					token[i + j] = hexDigits[(bits >> (j * 4)) & 0x0F];
+			}
+			return token;
+		}
+
+		/**
+		 * @return `true` if the token might have been made by `make_token()`. Tokens come from the clients.
+		 */
+		[[nodiscard]] static bool valid_token(std::string_view token) noexcept {
+			if (token.size() != token_length)
+				return false;
+			for (char c : token)
+				if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+					return false;
+			return true;
+		}
+
+		/**
+		 * @brief Stores the checkpoint, replacing the previous one of the token.
+		 * The files of the evicted checkpoints are written by the next `flush()`.
+		 * @return `false` if the token is invalid or the checkpoint could not be stored.
+		 */
+		bool put(std::string_view token, const sha256_checkpoint &cp) noexcept {
+			if (!valid_token(token))
+				return false;
+
+			try
+			{
+				std::lock_guard lock{_mutex};
+				const std::string key{token};
+				if (const auto iEntry = _index.find(key); iEntry != _index.end())
+				{
+					iEntry->second->checkpoint = cp;
+					_entries.splice(_entries.begin(), _entries, iEntry->second);
+					return true;
+				}
+
+				_entries.push_front(entry{key, cp});
+				try
+				{
+					_index.emplace(key, _entries.begin());
+				}
+				catch (...)
+				{
+					_entries.pop_front();
+					throw;
+				}
+				// the evicted or spilled checkpoint of the token is outdated
+				_evicted.erase(key);
+				if (forget_file(key))
+					_unlinked.insert(key);
+
+				while (_entries.size() > _config.capacity)
+				{
+					const entry &oldest = _entries.back();
+					if (spilling())
+						_evicted.insert_or_assign(oldest.token, evicted_entry{oldest.checkpoint, ++_evictions});
+					_index.erase(oldest.token);
+					_entries.pop_back();
+				}
+				return true;
+			}
+			catch (...)
+			{
+				return false;
+			}
+		}
+
+		/**
+		 * @return the checkpoint of the token, `std::nullopt` if unknown or dropped.
+		 */
+		[[nodiscard]] std::optional<sha256_checkpoint> get(std::string_view token) noexcept {
+			if (!valid_token(token))
+				return std::nullopt;
+
+			try
+			{
+				const std::string key{token};
+				{
+					std::lock_guard lock{_mutex};
+					if (const auto iEntry = _index.find(key); iEntry != _index.end())
+					{
+						_entries.splice(_entries.begin(), _entries, iEntry->second);
+						return iEntry->second->checkpoint;
+					}
+					if (const auto iEvicted = _evicted.find(key); iEvicted != _evicted.end())
+						return iEvicted->second.checkpoint;
+					if (_config.directory.empty() || _unlinked.count(key))
+						return std::nullopt;
+				}
+
+				auto cp = load(key);
+				if (cp)
+				{
+					std::lock_guard lock{_mutex};
+					if (!_unlinked.count(key))
+						track_file(key);
+				}
+				return cp;
+			}
+			catch (...)
+			{
+				return std::nullopt;
+			}
+		}
+
+		/**
+		 * @brief Removes the checkpoint of the token, e.g. once its line is complete.
+		 * Its file is removed by the next `flush()`.
+		 */
+		void erase(std::string_view token) noexcept {
+			if (!valid_token(token))
+				return;
+
+			try
+			{
+				std::lock_guard lock{_mutex};
+				const std::string key{token};
+				if (const auto iEntry = _index.find(key); iEntry != _index.end())
+				{
+					_entries.erase(iEntry->second);
+					_index.erase(iEntry);
+				}
+				_evicted.erase(key);
+				forget_file(key);
+				// possibly written by a previous run
+				if (!_config.directory.empty())
+					_unlinked.insert(key);
+			}
+			catch (...)
+			{}
+		}
+
+		/**
+		 * @return `true` if files are to be written or removed by `flush()`.
+		 */
+		[[nodiscard]] bool flush_due() const noexcept {
+			std::lock_guard lock{_mutex};
+			return !_evicted.empty() || !_unlinked.empty();
+		}
+
+		/**
+		 * @brief Writes the files of the evicted checkpoints and removes the outdated ones.
+		 * Blocks on file I/O: to be called out of the I/O threads if possible.
+		 */
+		void flush() noexcept {
+			try
+			{
+				// the files are written and removed in the order of the requests
+				std::lock_guard files{_fileMutex};
+				for (;;)
+				{
+					std::vector<std::string> unlinked{};
+					std::vector<std::pair<std::string, evicted_entry>> evicted{};
+					{
+						std::lock_guard lock{_mutex};
+						unlinked.assign(_unlinked.cbegin(), _unlinked.cend());
+						evicted.assign(_evicted.cbegin(), _evicted.cend());
+					}
+					if (unlinked.empty() && evicted.empty())
+						return;
+
+					for (const auto &token : unlinked)
+						remove_file(token);
+					{
+						std::lock_guard lock{_mutex};
+						for (const auto &token : unlinked)
+							_unlinked.erase(token);
+					}
+
+					for (const auto &[token, e] : evicted)
+					{
+						const bool written = write_file(token, e.checkpoint);
+						std::lock_guard lock{_mutex};
+						// unless stored or evicted again meanwhile
+						if (const auto iEvicted = _evicted.find(token);
+							iEvicted != _evicted.end() && iEvicted->second.generation == e.generation)
+							_evicted.erase(iEvicted);
+						if (written)
+							track_file(token);
+					}
+				}
+			}
+			catch (...)
+			{}
+		}
+
+		/**
+		 * @return number of the checkpoints in memory.
+		 */
+		[[nodiscard]] size_t size() const noexcept {
+			std::lock_guard lock{_mutex};
+			return _entries.size();
+		}
+
+	 private:
+		struct entry
+		{
+			std::string token;
+			sha256_checkpoint checkpoint;
+		};
+
+		struct evicted_entry
+		{
+			sha256_checkpoint checkpoint;
+			// tells a checkpoint evicted again while its file is being written
+			uint64_t generation;
+		};
+
+		[[nodiscard]] bool spilling() const noexcept {
+			return !_config.directory.empty() && _config.disk_capacity;
+		}
+
+		[[nodiscard]] std::filesystem::path file_path(const std::string &token) const {
+			return std::filesystem::path(_config.directory) / token;
+		}
+
+		bool write_file(const std::string &token, const sha256_checkpoint &cp) const {
+			// written aside and renamed, so that a crash never leaves a truncated checkpoint
+			const auto path = file_path(token);
+			auto tmpPath = path;
+			tmpPath += ".tmp";
+			{
+				const auto record = detail::serialize(cp);
+				std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+				file.write(reinterpret_cast<const char*>(record.data()), std::streamsize(record.size()));
+				if (!file)
+					return false;
+			}
+			std::error_code errorCode{};
+			std::filesystem::rename(tmpPath, path, errorCode);
+			return !errorCode;
+		}
+
+		/**
+		 * @brief Makes the file of the token the most recent one, the oldest ones beyond `disk_capacity` are removed.
+		 */
+		void track_file(const std::string &token) {
+			if (!spilling())
+				return;
+
+			if (const auto iFile = _spilledIndex.find(token); iFile != _spilledIndex.end())
+			{
+				_spilled.splice(_spilled.end(), _spilled, iFile->second);
+			}
+			else
+			{
+				_spilled.push_back(token);
+				try
+				{
+					_spilledIndex.emplace(token, std::prev(_spilled.end()));
+				}
+				catch (...)
+				{
+					_spilled.pop_back();
+					throw;
+				}
+			}
+
+			while (_spilled.size() > _config.disk_capacity)
+			{
+				_unlinked.insert(_spilled.front());
+				_spilledIndex.erase(_spilled.front());
+				_spilled.pop_front();
+			}
+		}
+
+		/**
+		 * @return `true` if the token had a file, no longer counted.
+		 */
+		bool forget_file(const std::string &token) noexcept {
+			const auto iFile = _spilledIndex.find(token);
+			if (iFile == _spilledIndex.end())
+				return false;
+			_spilled.erase(iFile->second);
+			_spilledIndex.erase(iFile);
+			return true;
+		}
+
+		std::optional<sha256_checkpoint> load(const std::string &token) const {
+			std::array<uint8_t, detail::checkpoint_record_size> record{};
+			{
+				std::ifstream file(file_path(token), std::ios::binary);
+				file.read(reinterpret_cast<char*>(record.data()), std::streamsize(record.size()));
+				if (!file)
+					return std::nullopt;
+			}
+			return detail::deserialize(record);
+		}
+
+		void remove_file(const std::string &token) const {
+			std::error_code errorCode{};
+			std::filesystem::remove(file_path(token), errorCode);
+		}
+
+		config _config;
+		mutable std::mutex _mutex;
+		// the most recently stored or used first
+		std::list<entry> _entries;
+		std::unordered_map<std::string, std::list<entry>::iterator> _index;
+		// evicted checkpoints whose files are to be written
+		std::unordered_map<std::string, evicted_entry> _evicted;
+		uint64_t _evictions = 0;
+		// tokens whose files are to be removed
+		std::unordered_set<std::string> _unlinked;
+		// tokens of the files written or loaded, the oldest first
+		std::list<std::string> _spilled;
+		std::unordered_map<std::string, std::list<std::string>::iterator> _spilledIndex;
+		// held by `flush()`, never under `_mutex`
+		std::mutex _fileMutex;
+	};
+
+	/**
+	 * Checkpointing of long lines, requires a checkpointable Hasher, see `is_checkpointable`.
+	 */
+	struct checkpoint_policy
+	{
+		// lines are not checkpointed if not set
+		checkpoint_store *store = nullptr;
+		// bytes of a line between its checkpoints, `0` disables checkpointing
+		uint64_t interval = uint64_t(1) << 30;
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_checkpoint_policy
+		{
+			constexpr checkpoint_policy operator()(const Config&) const noexcept {
+				return checkpoint_policy{};
+			}
+		};
+
+		template <typename Config>
+		struct _get_checkpoint_policy<Config, std::void_t<decltype(std::declval<Config>().checkpoints)>>
+		{
+			constexpr checkpoint_policy operator()(const Config& c) const noexcept {
+				return c.checkpoints;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static checkpoint_policy get_checkpoint_policy(const Config &c) noexcept {
+		return detail::_get_checkpoint_policy<std::decay_t<Config>>{}(c);
+	}
+}
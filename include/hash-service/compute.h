@@ -0,0 +1,45 @@
+#pragma once
+
+#include <asio.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+	/**
+	 * Offloading of hashing from I/O threads.
+	 */
+	struct compute_policy
+	{
+		// hashing stays on the I/O threads if not set
+		asio::thread_pool *pool = nullptr;
+		// bytes of a line after which its chunks are hashed by the pool
+		size_t threshold = 64 * 1024;
+		// receive buffers of a line being hashed by the pool, while the next one is received. `1` disables the overlap
+		size_t max_in_flight = 2;
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_compute_policy
+		{
+			constexpr compute_policy operator()(const Config&) const noexcept {
+				return compute_policy{};
+			}
+		};
+
+		template <typename Config>
+		struct _get_compute_policy<Config, std::void_t<decltype(std::declval<Config>().compute)>>
+		{
+			constexpr compute_policy operator()(const Config& c) const noexcept {
+				return c.compute;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static compute_policy get_compute_policy(const Config &c) noexcept {
+		return detail::_get_compute_policy<std::decay_t<Config>>{}(c);
+	}
+}
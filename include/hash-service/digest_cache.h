@@ -0,0 +1,293 @@
+#pragma once
+
+#include "hash-service/hex.h"
+#include "hash-service/sha256_batch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	namespace detail {
+		/**
+		 * @brief Fast 64-bit hash of a short line, 8 bytes per step and a murmur3 finalizer.
+		 * Seeded, so that the clients cannot make the lines of a shard collide on purpose.
+		 */
+		inline uint64_t line_hash(std::string_view line, uint64_t seed) noexcept {
+			constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+			uint64_t h = seed ^ (line.size() * k);
+			const char *p = line.data();
+			size_t n = line.size();
+			for (; n >= 8; p += 8, n -= 8)
+			{
+				uint64_t word;
+				std::memcpy(&word, p, 8);
+				h = (h ^ word) * k;
+				h ^= h >> 29;
+			}
+			if (n)
+			{
+				uint64_t word = 0;
+				std::memcpy(&word, p, n);
+				h = (h ^ word) * k;
+				h ^= h >> 29;
+			}
+
+			h ^= h >> 33;
+			h *= 0xFF51AFD7ED558CCDull;
+			h ^= h >> 33;
+			h *= 0xC4CEB9FE1A85EC53ull;
+			h ^= h >> 33;
+			return h;
+		}
+	}
+
+	/**
+	 * @brief Memory-bounded cache of the hex responses of short lines, in front of SHA-256.
+	 *
+	 * Entries are looked up by a seeded 64-bit hash of the line and confirmed by comparing its bytes,
+	 * a hit copies the `'\n'`-terminated hex digest straight into the output.
+	 * Lines are distributed between shards by their hash, every shard has its own mutex and a fixed number
+	 * of slots allocated upfront. A full shard evicts with CLOCK: a hit marks its slot as referenced,
+	 * the hand skips and clears referenced slots and evicts the first unreferenced one.
+	 *
+	 * @threadsafe All the member functions may be called from multiple threads.
+	 */
+	class digest_cache
+	{
+	 public:
+		constexpr static size_t response_size = hex_encoder::line_size<std::tuple_size_v<sha256_batch::digest>>;
+
+		struct config
+		{
+			// bytes of the slots and their index, approximately
+			size_t capacity = 64 * 1024 * 1024;
+			// longer lines are not cached
+			size_t max_line = 64;
+			// rounded up to a power of two
+			size_t shards = 16;
+		};
+
+		explicit digest_cache(config conf)
+			: _maxLine(conf.max_line),
+			  _seed(make_seed()),
+			  _shardMask(shard_count(conf.shards) - 1),
+			  _shards(std::make_unique<shard[]>(_shardMask + 1))
+		{
+			const size_t shardCount = _shardMask + 1;
+			const size_t slotCost = _maxLine + response_size + sizeof(slot) + index_entry_overhead;
+			const size_t slots = std::max<size_t>(conf.capacity / shardCount / slotCost, 1);
+			for (size_t i = 0; i < shardCount; ++i)
+				_shards[i].init(slots, _maxLine + response_size);
+		}
+
+		digest_cache(const digest_cache&) = delete;
+		digest_cache& operator=(const digest_cache&) = delete;
+
+		/**
+		 * @return the longest line cached.
+		 */
+		[[nodiscard]] size_t max_line() const noexcept {
+			return _maxLine;
+		}
+
+		/**
+		 * @brief Copies the cached response of the line, if any.
+		 * @param response `response_size` bytes
+		 * @return `true` on a hit.
+		 */
+		bool find(std::string_view line, uint8_t *response) noexcept {
+			if (line.size() > _maxLine)
+				return false;
+
+			const uint64_t h = detail::line_hash(line, _seed);
+			shard &s = shard_of(h);
+			std::lock_guard lock{s.mutex};
+			const auto iEntry = s.index.find(h);
+			if (iEntry == s.index.end())
+				return false;
+
+			slot &entry = s.slots[iEntry->second];
+			const uint8_t *data = s.slot_data(iEntry->second);
+			if (entry.lineSize != line.size() || std::memcmp(data, line.data(), line.size()) != 0)
+				return false;
+
+			entry.referenced = true;
+			std::memcpy(response, data + _maxLine, response_size);
+			return true;
+		}
+
+		/**
+		 * @brief Caches the response of the line, evicting an entry of its shard if full.
+		 * @param response `response_size` bytes
+		 */
+		void insert(std::string_view line, const uint8_t *response) noexcept {
+			if (line.size() > _maxLine)
+				return;
+
+			const uint64_t h = detail::line_hash(line, _seed);
+			shard &s = shard_of(h);
+			std::lock_guard lock{s.mutex};
+			uint32_t iSlot;
+			if (const auto iEntry = s.index.find(h); iEntry != s.index.end())
+			{
+				// the same line or a colliding one: the latest wins
+				iSlot = iEntry->second;
+			}
+			else
+			{
+				iSlot = s.evict();
+				try
+				{
+					s.index.emplace(h, iSlot);
+				}
+				catch (...)
+				{
+					return;
+				}
+			}
+
+			slot &entry = s.slots[iSlot];
+			entry.hash = h;
+			entry.lineSize = uint32_t(line.size());
+			entry.used = true;
+			entry.referenced = false;
+			uint8_t *data = s.slot_data(iSlot);
+			std::memcpy(data, line.data(), line.size());
+			std::memcpy(data + _maxLine, response, response_size);
+		}
+
+		/**
+		 * @return number of the lines the cache may hold.
+		 */
+		[[nodiscard]] size_t slots() const noexcept {
+			return (_shardMask + 1) * _shards[0].slots.size();
+		}
+
+		/**
+		 * @return number of the cached lines.
+		 */
+		[[nodiscard]] size_t size() const noexcept {
+			size_t entries = 0;
+			for (size_t i = 0; i <= _shardMask; ++i)
+			{
+				std::lock_guard lock{_shards[i].mutex};
+				entries += _shards[i].index.size();
+			}
+			return entries;
+		}
+
+	 private:
+		// node and bucket of `std::unordered_map`
+		constexpr static size_t index_entry_overhead = 48;
+
+		struct slot
+		{
+			uint64_t hash = 0;
+			uint32_t lineSize = 0;
+			bool used = false;
+			bool referenced = false;
+		};
+
+		struct alignas(64) shard
+		{
+			mutable std::mutex mutex;
+			std::vector<slot> slots;
+			// line bytes followed by the response, `stride` bytes per slot
+			std::unique_ptr<uint8_t[]> storage;
+			size_t stride = 0;
+			std::unordered_map<uint64_t, uint32_t> index;
+			// CLOCK hand
+			uint32_t hand = 0;
+
+			void init(size_t count, size_t slotStride) {
+				slots.resize(count);
+				stride = slotStride;
+				storage = std::make_unique<uint8_t[]>(count * slotStride);
+				index.reserve(count);
+			}
+
+			uint8_t *slot_data(uint32_t iSlot) noexcept {
+				return storage.get() + size_t(iSlot) * stride;
+			}
+
+			/**
+			 * @return a free slot, unlinked from the index.
+			 */
+			uint32_t evict() noexcept {
+				while (true)
+				{
+					const uint32_t iSlot = hand;
+					hand = uint32_t((hand + 1) % slots.size());
+					slot &entry = slots[iSlot];
+					if (!entry.used)
+						return iSlot;
+					if (entry.referenced)
+					{
+						entry.referenced = false;
+						continue;
+					}
+
+					index.erase(entry.hash);
+					entry.used = false;
+					return iSlot;
+				}
+			}
+		};
+
+		static uint64_t make_seed() {
+			std::random_device device{};
+			return uint64_t(device()) << 32 | device();
+		}
+
+		constexpr static size_t shard_count(size_t shards) noexcept {
+			size_t count = 1;
+			while (count < shards)
+				count *= 2;
+			return count;
+		}
+
+		shard &shard_of(uint64_t h) const noexcept {
+			// the low bits pick the bucket of the index
+			return _shards[(h >> 40) & _shardMask];
+		}
+
+		size_t _maxLine;
+		uint64_t _seed;
+		size_t _shardMask;
+		std::unique_ptr<shard[]> _shards;
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_digest_cache
+		{
+			constexpr digest_cache *operator()(const Config&) const noexcept {
+				return nullptr;
+			}
+		};
+
+		template <typename Config>
+		struct _get_digest_cache<Config, std::void_t<decltype(std::declval<Config>().digests)>>
+		{
+			constexpr digest_cache *operator()(const Config& c) const noexcept {
+				return c.digests;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static digest_cache *get_digest_cache(const Config &c) noexcept {
+		return detail::_get_digest_cache<std::decay_t<Config>>{}(c);
+	}
+}
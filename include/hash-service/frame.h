@@ -0,0 +1,202 @@
+#pragma once
+
+#include "hash-service/buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+	/**
+	 * @brief Wire protocol of a listening port.
+	 *
+	 * `text`: requests are '\n'-terminated lines, responses are '\n'-terminated hex digests.
+	 * `binary`: requests are length-prefixed frames, responses are raw digests, see `frame_reader`.
+	 */
+	enum class wire_protocol
+	{
+		text,
+		binary
+	};
+
+	/**
+	 * @return the protocol by its name: `text` or `binary`, `std::nullopt` if unknown.
+	 */
+	inline std::optional<wire_protocol> parse_wire_protocol(std::string_view name) noexcept {
+		if (name == "text")
+			return wire_protocol::text;
+		if (name == "binary")
+			return wire_protocol::binary;
+		return std::nullopt;
+	}
+
+	/**
+	 * Optional id of a binary request, echoed before its digest.
+	 */
+	struct request_id
+	{
+		uint64_t value = 0;
+		bool present = false;
+	};
+
+	namespace detail {
+		// LEB128 of a 64-bit value
+		constexpr size_t max_varint_size = 10;
+
+		constexpr size_t varint_size(uint64_t value) noexcept {
+			size_t size = 1;
+			while (value >= 0x80)
+			{
+				value >>= 7;
+				++size;
+			}
+			return size;
+		}
+
+		/**
+		 * @param out `varint_size(value)` bytes
+		 * @return pointer past the last written byte.
+		 */
+		inline uint8_t *write_varint(uint64_t value, uint8_t *out) noexcept {
+			while (value >= 0x80)
+			{
+				*out++ = uint8_t(value | 0x80);
+				value >>= 7;
+			}
+			*out++ = uint8_t(value);
+			return out;
+		}
+
+		template <typename Config, typename = void>
+		struct _get_wire_protocol
+		{
+			constexpr wire_protocol operator()(const Config&) const noexcept {
+				return wire_protocol::text;
+			}
+		};
+
+		template <typename Config>
+		struct _get_wire_protocol<Config, std::void_t<decltype(std::declval<Config>().protocol)>>
+		{
+			constexpr wire_protocol operator()(const Config& c) const noexcept {
+				return c.protocol;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static wire_protocol get_wire_protocol(const Config &c) noexcept {
+		return detail::_get_wire_protocol<std::decay_t<Config>>{}(c);
+	}
+
+	/**
+	 * @brief Incremental parser of binary requests.
+	 *
+	 * A request is a varint header `length << 1 | has_id`, a varint id if `has_id` is set, then `length` bytes
+	 * of the message. Varints are unsigned LEB128. Any number of requests may be sent back to back, e.g. in a single
+	 * segment. The response of a request is its varint id, if any, followed by the raw digest.
+	 *
+	 * Messages are delimited by their length: they are never scanned and may contain any byte.
+	 * Like `line_buffer::next_chunk()`, `next()` returns either a complete message or the part of a message
+	 * continued by the next receive.
+	 */
+	class frame_reader
+	{
+	 public:
+		/**
+		 * @brief Consumes the bytes of the next request from `pending`.
+		 * @param pending received bytes
+		 * @param consumed set to the number of bytes consumed
+		 * @return the consumed chunk of the message, `std::nullopt` if all the `pending` bytes have been consumed
+		 * without reaching a message byte or its end, or if the header is malformed, see `failed()`.
+		 */
+		std::optional<line_chunk> next(std::string_view pending, size_t &consumed) noexcept {
+			consumed = 0;
+			while (true)
+			{
+				if (_state == state::payload)
+				{
+					const size_t bytes = _remaining < pending.size() - consumed ? size_t(_remaining)
+																			  : pending.size() - consumed;
+					if (!bytes && _remaining)
+						return std::nullopt;
+
+					const std::string_view data = pending.substr(consumed, bytes);
+					consumed += bytes;
+					_remaining -= bytes;
+					if (_remaining)
+						return line_chunk{data, false};
+					_state = state::header;
+					return line_chunk{data, true};
+				}
+
+				if (_state == state::failed || consumed == pending.size())
+					return std::nullopt;
+
+				const uint8_t byte = uint8_t(pending[consumed++]);
+				// the 10th byte holds the 64th bit only
+				if (_shift == 63 && byte > 1)
+				{
+					_state = state::failed;
+					return std::nullopt;
+				}
+				_varint |= uint64_t(byte & 0x7F) << _shift;
+				if (byte & 0x80)
+				{
+					_shift += 7;
+					continue;
+				}
+
+				const uint64_t value = std::exchange(_varint, 0);
+				_shift = 0;
+				if (_state == state::header)
+				{
+					_remaining = value >> 1;
+					_id = request_id{};
+					if (value & 1)
+					{
+						_state = state::id;
+						continue;
+					}
+				}
+				else
+				{
+					_id = request_id{value, true};
+				}
+				_state = state::payload;
+			}
+		}
+
+		/**
+		 * @return id of the latest request whose header has been consumed.
+		 */
+		[[nodiscard]] request_id id() const noexcept {
+			return _id;
+		}
+
+		/**
+		 * @return `true` if a malformed header has been received. The reader consumes nothing afterwards.
+		 */
+		[[nodiscard]] bool failed() const noexcept {
+			return _state == state::failed;
+		}
+
+	 private:
+		enum class state
+		{
+			header,
+			id,
+			payload,
+			failed
+		};
+
+		state _state = state::header;
+		uint64_t _varint = 0;
+		unsigned _shift = 0;
+		uint64_t _remaining = 0;
+		request_id _id;
+	};
+}
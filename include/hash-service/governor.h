@@ -0,0 +1,170 @@
+#pragma once
+
+#include "hash-service/buffer_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	/**
+	 * @brief Server-wide limits of the sessions and of the memory they hold.
+	 *
+	 * The servers sharing the governor stop accepting while `max_sessions` sessions are alive,
+	 * and the sessions stop receiving while the receive buffers in use and the queued responses exceed `max_bytes`.
+	 * A session paused by the budget waits for `relieved()` to bring the bytes under the resume mark,
+	 * `max_bytes - max_bytes / 8`, so that the sessions do not flap around the limit.
+	 *
+	 * Receive buffers are accounted by `buffer_pool`, process-wide, the responses by the sessions.
+	 * A limit may be exceeded by the sessions accepted or the buffers read while it is reached,
+	 * at most one per acceptor or session.
+	 *
+	 * @threadsafe All the member functions may be called from multiple threads.
+	 */
+	class resource_governor
+	{
+	 public:
+		struct config
+		{
+			// `0` for no limit
+			size_t max_sessions = 0;
+			// `0` for no limit
+			size_t max_bytes = 0;
+		};
+
+		explicit resource_governor(config conf) noexcept
+			: _maxSessions(conf.max_sessions),
+			  _maxBytes(conf.max_bytes),
+			  _resumeBytes(conf.max_bytes - conf.max_bytes / 8)
+		{}
+
+		resource_governor(const resource_governor&) = delete;
+		resource_governor& operator=(const resource_governor&) = delete;
+
+		void session_opened() noexcept {
+			_sessions.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void session_closed() noexcept {
+			_sessions.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @return `true` if a session may be accepted.
+		 */
+		[[nodiscard]] bool admitting() const noexcept {
+			return !_maxSessions || _sessions.load(std::memory_order_relaxed) < _maxSessions;
+		}
+
+		[[nodiscard]] size_t sessions() const noexcept {
+			return _sessions.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Accounts for the responses queued, or written if `bytes` is negative.
+		 */
+		void add_output(int64_t bytes) noexcept {
+			_outputBytes.fetch_add(uint64_t(bytes), std::memory_order_relaxed);
+		}
+
+		/**
+		 * @return bytes of the receive buffers in use and of the queued responses.
+		 */
+		[[nodiscard]] uint64_t bytes() const noexcept {
+			return buffer_pool::stats().bytes_in_use + _outputBytes.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @return `true` if the sessions must not receive.
+		 */
+		[[nodiscard]] bool over_budget() const noexcept {
+			return _maxBytes && bytes() >= _maxBytes;
+		}
+
+		/**
+		 * @brief Registers a session paused by the budget.
+		 *
+		 * `_waiting` is raised before the budget is checked: a `relieved()` releasing memory meanwhile either
+		 * sees it and waits for the registration, or has released before the check.
+		 * @param resume called once under the resume mark, on the thread calling `relieved()`,
+		 * possibly the calling one if the memory has been released during the registration
+		 * @return `false` if the budget is no longer exceeded: `resume` is not registered.
+		 * @throws std::bad_alloc
+		 */
+		bool wait_for_budget(std::function<void()> &&resume) {
+			{
+				std::lock_guard lock{_mutex};
+				_waiting.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!over_budget())
+				{
+					_waiting.store(!_waiters.empty(), std::memory_order_relaxed);
+					return false;
+				}
+				_waiters.push_back(std::move(resume));
+			}
+			// released between the check and the registration
+			relieved();
+			return true;
+		}
+
+		/**
+		 * @brief Resumes the paused sessions once under the resume mark.
+		 * To be called after memory has been released, cheap if no session is paused.
+		 */
+		void relieved() noexcept {
+			// pairs with the fence of `wait_for_budget()`: the released bytes or the waiting flag are seen
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!_waiting.load(std::memory_order_relaxed) || bytes() >= _resumeBytes)
+				return;
+
+			std::vector<std::function<void()>> waiters{};
+			{
+				std::lock_guard lock{_mutex};
+				waiters.swap(_waiters);
+				_waiting.store(false, std::memory_order_relaxed);
+			}
+			for (auto &resume : waiters)
+				resume();
+		}
+
+	 private:
+		size_t _maxSessions;
+		uint64_t _maxBytes;
+		uint64_t _resumeBytes;
+		std::atomic<size_t> _sessions{0};
+		std::atomic<uint64_t> _outputBytes{0};
+
+		std::mutex _mutex;
+		std::vector<std::function<void()>> _waiters;
+		std::atomic<bool> _waiting{false};
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_resource_governor
+		{
+			constexpr resource_governor *operator()(const Config&) const noexcept {
+				return nullptr;
+			}
+		};
+
+		template <typename Config>
+		struct _get_resource_governor<Config, std::void_t<decltype(std::declval<Config>().governor)>>
+		{
+			constexpr resource_governor *operator()(const Config& c) const noexcept {
+				return c.governor;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static resource_governor *get_resource_governor(const Config &c) noexcept {
+		return detail::_get_resource_governor<std::decay_t<Config>>{}(c);
+	}
+}
@@ -1,37 +1,204 @@
 #pragma once
 
+#include "hash-service/sha256.h"
+
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <array>
 #include <string_view>
 #include <optional>
 #include <charconv>
+#include <type_traits>
+#include <utility>
 
 namespace hs {
-	class sha256_hash
+	/**
+	 * @brief Hasher traits.
+	 *
+	 * A Hasher is a move-only type providing:
+	 * - `constexpr static size_t digest_length`
+	 * - `static std::optional<Hasher> create() noexcept`
+	 * - `bool update(std::string_view) noexcept`
+	 * - `std::optional<std::array<uint8_t, digest_length>> finalize() noexcept`, resetting the hasher
+	 * for the next message.
+	 */
+	template <typename Hasher, typename = void>
+	struct is_hasher : std::false_type
+	{};
+
+	template <typename Hasher>
+	struct is_hasher<Hasher, std::void_t<
+		decltype(Hasher::digest_length),
+		std::enable_if_t<std::is_same_v<decltype(Hasher::create()), std::optional<Hasher>>>,
+		std::enable_if_t<std::is_same_v<decltype(std::declval<Hasher&>().update(std::string_view())), bool>>,
+		std::enable_if_t<std::is_same_v<decltype(std::declval<Hasher&>().finalize()),
+			std::optional<std::array<uint8_t, Hasher::digest_length>>>>
+	>> : std::true_type
+	{};
+
+	template <typename Hasher>
+	constexpr static bool is_hasher_v = is_hasher<Hasher>::value;
+
+	/**
+	 * @brief One-shot Hasher traits.
+	 *
+	 * A one-shot Hasher is a Hasher additionally providing
+	 * `static std::array<uint8_t, digest_length> hash(std::string_view) noexcept`, hashing a whole message
+	 * without the streaming state.
+	 */
+	template <typename Hasher, typename = void>
+	struct has_one_shot : std::false_type
+	{};
+
+	template <typename Hasher>
+	struct has_one_shot<Hasher, std::void_t<
+		std::enable_if_t<is_hasher_v<Hasher>>,
+		std::enable_if_t<std::is_same_v<decltype(Hasher::hash(std::string_view())),
+			std::array<uint8_t, Hasher::digest_length>>>
+	>> : std::true_type
+	{};
+
+	template <typename Hasher>
+	constexpr static bool has_one_shot_v = has_one_shot<Hasher>::value;
+
+	/**
+	 * @brief Intermediate state of a SHA-256 message.
+	 */
+	struct sha256_checkpoint
+	{
+		// midstate after the last complete block
+		std::array<uint32_t, 8> state{};
+		// bytes hashed so far
+		uint64_t bytes = 0;
+		// the first `bytes % 64` bytes are the incomplete block
+		std::array<uint8_t, 64> tail{};
+	};
+
+	/**
+	 * @brief Checkpointable Hasher traits.
+	 *
+	 * A checkpointable Hasher is a Hasher additionally providing:
+	 * - `sha256_checkpoint checkpoint() const noexcept`, the state of the current message
+	 * - `bool restore(const sha256_checkpoint&) noexcept`, replacing the current message
+	 */
+	template <typename Hasher, typename = void>
+	struct is_checkpointable : std::false_type
+	{};
+
+	template <typename Hasher>
+	struct is_checkpointable<Hasher, std::void_t<
+		std::enable_if_t<is_hasher_v<Hasher>>,
+		std::enable_if_t<std::is_same_v<decltype(std::declval<const Hasher&>().checkpoint()), sha256_checkpoint>>,
+		std::enable_if_t<std::is_same_v<decltype(std::declval<Hasher&>().restore(sha256_checkpoint())), bool>>
+	>> : std::true_type
+	{};
+
+	template <typename Hasher>
+	constexpr static bool is_checkpointable_v = is_checkpointable<Hasher>::value;
+
+	/**
+	 * OpenSSL EVP algorithms.
+	 */
+	struct evp_sha256
+	{
+		constexpr static size_t digest_length = SHA256_DIGEST_LENGTH;
+
+		static const EVP_MD *md() noexcept {
+			return EVP_sha256();
+		}
+	};
+
+	struct evp_sha512_256
 	{
-	 public:
 		constexpr static size_t digest_length = SHA256_DIGEST_LENGTH;
 
-		sha256_hash(const sha256_hash&) = delete;
-		sha256_hash& operator=(const sha256_hash&) = delete;
+		static const EVP_MD *md() noexcept {
+			return EVP_sha512_256();
+		}
+	};
+
+	namespace detail {
+		/**
+		 * @brief Per-thread cache of EVP digest contexts of an algorithm.
+		 * Cached contexts keep their digest state allocated, a reused context is merely re-initialized.
+		 */
+		template <typename Algorithm>
+		class evp_md_ctx_cache
+		{
+		 public:
+			constexpr static size_t capacity = 64;
+
+			evp_md_ctx_cache() = default;
+			evp_md_ctx_cache(const evp_md_ctx_cache&) = delete;
+			evp_md_ctx_cache& operator=(const evp_md_ctx_cache&) = delete;
+
+			~evp_md_ctx_cache() {
+				for (size_t i = 0; i < _size; ++i)
+					EVP_MD_CTX_free(_contexts[i]);
+				destroyed = true;
+			}
+
+			/**
+			 * @return a context of the calling thread, `nullptr` after the thread's cache has been destroyed.
+			 */
+			static evp_md_ctx_cache *this_thread() noexcept {
+				if (destroyed)
+					return nullptr;
+				thread_local evp_md_ctx_cache cache{};
+				return &cache;
+			}
 
-		sha256_hash(sha256_hash&&) noexcept = default;
-		sha256_hash& operator=(sha256_hash&&) noexcept = default;
+			[[nodiscard]] EVP_MD_CTX *acquire() noexcept {
+				return _size ? _contexts[--_size] : EVP_MD_CTX_new();
+			}
+
+			void release(EVP_MD_CTX *context) noexcept {
+				if (_size < capacity)
+					_contexts[_size++] = context;
+				else
+					EVP_MD_CTX_free(context);
+			}
+
+		 private:
+			inline static thread_local bool destroyed = false;
+
+			std::array<EVP_MD_CTX*, capacity> _contexts{};
+			size_t _size = 0;
+		};
+	}
+
+	/**
+	 * @brief Hasher using an OpenSSL EVP digest.
+	 * Digest contexts are recycled through a per-thread cache.
+	 * @tparam Algorithm type providing `digest_length` and `static const EVP_MD *md()`
+	 */
+	template <typename Algorithm>
+	class evp_hash
+	{
+	 public:
+		constexpr static size_t digest_length = Algorithm::digest_length;
+
+		evp_hash(const evp_hash&) = delete;
+		evp_hash& operator=(const evp_hash&) = delete;
+
+		evp_hash(evp_hash&&) noexcept = default;
+		evp_hash& operator=(evp_hash&&) noexcept = default;
 
 		// TODO: expected-like error
-		static std::optional<sha256_hash> create() noexcept {
-			unique_md_ctx context{EVP_MD_CTX_new()};
+		static std::optional<evp_hash> create() noexcept {
+			auto *cache = detail::evp_md_ctx_cache<Algorithm>::this_thread();
+			unique_md_ctx context{cache ? cache->acquire() : EVP_MD_CTX_new()};
 			if (!context)
 				return std::nullopt;
 
-			if (!EVP_DigestInit(context.get(), EVP_sha256()))
+			if (!EVP_DigestInit_ex(context.get(), Algorithm::md(), nullptr))
 				return std::nullopt;
 
-			return sha256_hash(std::move(context));
+			return evp_hash(std::move(context));
 		}
 
 		// TODO: expected-like error
@@ -45,9 +212,10 @@ namespace hs {
 
 			std::array<uint8_t, digest_length> hash{};
 			unsigned int written = 0;
-			if (!EVP_DigestFinal(_context.get(), hash.data(), &written) || !written)
+			// the _ex functions keep the digest state allocated
+			if (!EVP_DigestFinal_ex(_context.get(), hash.data(), &written) || !written)
 				return std::nullopt;
-			if (!EVP_DigestInit(_context.get(), EVP_sha256()))
+			if (!EVP_DigestInit_ex(_context.get(), Algorithm::md(), nullptr))
 				return std::nullopt;
 
 			return hash;
@@ -57,19 +225,103 @@ namespace hs {
 		struct evp_md_ctx_free
 		{
 			void operator()(EVP_MD_CTX *context) const noexcept {
-				EVP_MD_CTX_free(context);
+				if (auto *cache = detail::evp_md_ctx_cache<Algorithm>::this_thread())
+					cache->release(context);
+				else
+					EVP_MD_CTX_free(context);
 			}
 		};
 
 		using unique_md_ctx = std::unique_ptr<EVP_MD_CTX, evp_md_ctx_free>;
 
-		sha256_hash(unique_md_ctx ctx)
+		evp_hash(unique_md_ctx ctx)
 			: _context(std::move(ctx))
 		{}
 
 		unique_md_ctx _context;
 	};
 
+	using evp_sha256_hash = evp_hash<evp_sha256>;
+	// OpenSSL's if built without `WITH_NATIVE_SHA256`
+#ifdef HS_OPENSSL_SHA256
+	using sha256_hash = evp_sha256_hash;
+#else
+	using sha256_hash = sha256_native_hash;
+#endif
+	using sha512_256_hash = evp_hash<evp_sha512_256>;
+
+// the low-level API is deprecated by OpenSSL 3, but the EVP one does not expose the intermediate state
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+	/**
+	 * @brief SHA-256 hasher whose intermediate state can be checkpointed and restored, e.g. by another process.
+	 * Uses the low-level OpenSSL API, as fast as the EVP one, with the state held inline.
+	 */
+	class sha256_resumable_hash
+	{
+	 public:
+		constexpr static size_t digest_length = SHA256_DIGEST_LENGTH;
+
+		sha256_resumable_hash(const sha256_resumable_hash&) = delete;
+		sha256_resumable_hash& operator=(const sha256_resumable_hash&) = delete;
+
+		sha256_resumable_hash(sha256_resumable_hash&&) noexcept = default;
+		sha256_resumable_hash& operator=(sha256_resumable_hash&&) noexcept = default;
+
+		static std::optional<sha256_resumable_hash> create() noexcept {
+			sha256_resumable_hash hash{};
+			if (!SHA256_Init(&hash._context))
+				return std::nullopt;
+			return hash;
+		}
+
+		bool update(std::string_view str) noexcept {
+			return SHA256_Update(&_context, str.data(), str.size());
+		}
+
+		auto finalize() noexcept -> std::optional<std::array<uint8_t, digest_length>> {
+			std::array<uint8_t, digest_length> hash{};
+			if (!SHA256_Final(hash.data(), &_context) || !SHA256_Init(&_context))
+				return std::nullopt;
+			return hash;
+		}
+
+		[[nodiscard]] sha256_checkpoint checkpoint() const noexcept {
+			sha256_checkpoint cp{};
+			for (size_t i = 0; i < cp.state.size(); ++i)
+				cp.state[i] = _context.h[i];
+			// the message length is counted in bits
+			cp.bytes = ((uint64_t(_context.Nh) << 32) | _context.Nl) >> 3;
+			std::memcpy(cp.tail.data(), _context.data, _context.num);
+			return cp;
+		}
+
+		bool restore(const sha256_checkpoint &cp) noexcept {
+			if (!SHA256_Init(&_context))
+				return false;
+			for (size_t i = 0; i < cp.state.size(); ++i)
+				_context.h[i] = cp.state[i];
+			const uint64_t bits = cp.bytes << 3;
+			_context.Nl = static_cast<SHA_LONG>(bits);
+			_context.Nh = static_cast<SHA_LONG>(bits >> 32);
+			_context.num = unsigned(cp.bytes % SHA256_CBLOCK);
+			std::memcpy(_context.data, cp.tail.data(), _context.num);
+			return true;
+		}
+
+	 private:
+		sha256_resumable_hash() = default;
+
+		SHA256_CTX _context{};
+	};
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
 	template <size_t N>
 	constexpr static auto to_hex(const std::array<uint8_t, N> &arr) noexcept -> std::array<uint8_t, N * 2> {
 		constexpr const char hexMap[] = "0123456789abcdef";
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "hash-service/hash.h"
+#include "hash-service/tree_hash.h"
+
+#ifdef HS_HAS_BLAKE3
+#include <blake3.h>
+#endif
+
+#ifdef HS_HAS_XXHASH
+#define XXH_STATIC_LINKING_ONLY
+#include <xxhash.h>
+#endif
+
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+
+namespace hs {
+#ifdef HS_HAS_BLAKE3
+	/**
+	 * @brief BLAKE3 hasher with the default 32-byte output. Requires the BLAKE3 C library.
+	 */
+	class blake3_hash
+	{
+	 public:
+		constexpr static size_t digest_length = BLAKE3_OUT_LEN;
+
+		blake3_hash(const blake3_hash&) = delete;
+		blake3_hash& operator=(const blake3_hash&) = delete;
+
+		blake3_hash(blake3_hash&&) noexcept = default;
+		blake3_hash& operator=(blake3_hash&&) noexcept = default;
+
+		static std::optional<blake3_hash> create() noexcept {
+			auto hasher = std::make_unique<blake3_hasher>();
+			blake3_hasher_init(hasher.get());
+			return blake3_hash(std::move(hasher));
+		}
+
+		bool update(std::string_view str) noexcept {
+			if (!_hasher)
+				return false;
+			blake3_hasher_update(_hasher.get(), str.data(), str.size());
+			return true;
+		}
+
+		auto finalize() noexcept -> std::optional<std::array<uint8_t, digest_length>> {
+			if (!_hasher)
+				return std::nullopt;
+
+			std::array<uint8_t, digest_length> hash{};
+			blake3_hasher_finalize(_hasher.get(), hash.data(), hash.size());
+			blake3_hasher_init(_hasher.get());
+			return hash;
+		}
+
+	 private:
+		explicit blake3_hash(std::unique_ptr<blake3_hasher> hasher)
+			: _hasher(std::move(hasher))
+		{}
+
+		std::unique_ptr<blake3_hasher> _hasher;
+	};
+#endif
+
+#if defined(HS_HAS_XXHASH) && XXH_VERSION_NUMBER >= 800
+	/**
+	 * @brief Non-cryptographic XXH3 128-bit hasher. Requires xxHash 0.8 or newer.
+	 * The digest is the canonical (big-endian) representation.
+	 */
+	class xxh3_128_hash
+	{
+	 public:
+		constexpr static size_t digest_length = sizeof(XXH128_canonical_t);
+
+		xxh3_128_hash(const xxh3_128_hash&) = delete;
+		xxh3_128_hash& operator=(const xxh3_128_hash&) = delete;
+
+		xxh3_128_hash(xxh3_128_hash&&) noexcept = default;
+		xxh3_128_hash& operator=(xxh3_128_hash&&) noexcept = default;
+
+		static std::optional<xxh3_128_hash> create() noexcept {
+			unique_state state{XXH3_createState()};
+			if (!state || XXH3_128bits_reset(state.get()) != XXH_OK)
+				return std::nullopt;
+
+			return xxh3_128_hash(std::move(state));
+		}
+
+		bool update(std::string_view str) noexcept {
+			return bool(_state) && XXH3_128bits_update(_state.get(), str.data(), str.size()) == XXH_OK;
+		}
+
+		auto finalize() noexcept -> std::optional<std::array<uint8_t, digest_length>> {
+			if (!_state)
+				return std::nullopt;
+
+			XXH128_canonical_t canonical{};
+			XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(_state.get()));
+			if (XXH3_128bits_reset(_state.get()) != XXH_OK)
+				return std::nullopt;
+
+			std::array<uint8_t, digest_length> hash{};
+			std::copy(std::begin(canonical.digest), std::end(canonical.digest), hash.begin());
+			return hash;
+		}
+
+	 private:
+		struct xxh3_state_free
+		{
+			void operator()(XXH3_state_t *state) const noexcept {
+				XXH3_freeState(state);
+			}
+		};
+
+		using unique_state = std::unique_ptr<XXH3_state_t, xxh3_state_free>;
+
+		explicit xxh3_128_hash(unique_state state)
+			: _state(std::move(state))
+		{}
+
+		unique_state _state;
+	};
+#define HS_HAS_XXH3_128 1
+#endif
+
+	/**
+	 * Hash algorithms available for a listening port.
+	 */
+	enum class hash_algorithm {
+		sha256,
+		// SHA-256 with checkpoints of long lines, see `checkpoint_store`
+		sha256_resumable,
+		// SHA-256 Merkle tree over leaves hashed in parallel, a different digest, see `sha256_tree_hash`
+		sha256_tree,
+		sha512_256,
+		blake3,
+		xxh3_128
+	};
+
+	template <typename Hasher>
+	struct hasher_tag
+	{
+		using type = Hasher;
+	};
+
+	/**
+	 * @param name algorithm name: `sha256`, `sha256-resumable`, `sha256-tree`, `sha512-256`, `blake3`, `xxh3-128`
+	 * @return the algorithm, or `std::nullopt` if the name is unknown or the algorithm is not built in.
+	 */
+	inline std::optional<hash_algorithm> parse_hash_algorithm(std::string_view name) noexcept {
+		if (name == "sha256")
+			return hash_algorithm::sha256;
+		if (name == "sha256-resumable")
+			return hash_algorithm::sha256_resumable;
+		if (name == "sha256-tree")
+			return hash_algorithm::sha256_tree;
+		if (name == "sha512-256")
+			return hash_algorithm::sha512_256;
+#ifdef HS_HAS_BLAKE3
+		if (name == "blake3")
+			return hash_algorithm::blake3;
+#endif
+#ifdef HS_HAS_XXH3_128
+		if (name == "xxh3-128")
+			return hash_algorithm::xxh3_128;
+#endif
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief Invokes `f` with `hasher_tag<Hasher>` of the algorithm's Hasher.
+	 *
+	 * Bridges a run-time choice (e.g. from the command line) to the compile-time Hasher parameter
+	 * of `basic_session` and `basic_server`. Algorithms that are not built in fall back to SHA-256,
+	 * `parse_hash_algorithm()` never returns them.
+	 */
+	template <typename F>
+	decltype(auto) visit_hash_algorithm(hash_algorithm algorithm, F &&f) {
+		switch (algorithm)
+		{
+		case hash_algorithm::sha256_resumable:
+			return f(hasher_tag<sha256_resumable_hash>{});
+		case hash_algorithm::sha256_tree:
+			return f(hasher_tag<sha256_tree_hash>{});
+		case hash_algorithm::sha512_256:
+			return f(hasher_tag<sha512_256_hash>{});
+#ifdef HS_HAS_BLAKE3
+		case hash_algorithm::blake3:
+			return f(hasher_tag<blake3_hash>{});
+#endif
+#ifdef HS_HAS_XXH3_128
+		case hash_algorithm::xxh3_128:
+			return f(hasher_tag<xxh3_128_hash>{});
+#endif
+		default:
+			return f(hasher_tag<sha256_hash>{});
+		}
+	}
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HS_HEX_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace hs {
+	namespace detail {
+		constexpr const char hex_digits[] = "0123456789abcdef";
+
+		inline void hex_encode_scalar(const uint8_t *in, size_t size, uint8_t *out) noexcept {
+			for (size_t i = 0; i < size; ++i)
+			{
+				out[2 * i] = uint8_t(hex_digits[in[i] >> 4]);
+				out[2 * i + 1] = uint8_t(hex_digits[in[i] & 0x0F]);
+			}
+		}
+
+#ifdef HS_HEX_X86_DISPATCH
+		/**
+		 * @brief Nibbles of every byte are looked up with a byte shuffle of the digits, then interleaved
+		 * high nibble first. 16 bytes per iteration.
+		 */
+		__attribute__((target("ssse3")))
+		inline void hex_encode_ssse3(const uint8_t *in, size_t size, uint8_t *out) noexcept {
+			const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_digits));
+			const __m128i lowMask = _mm_set1_epi8(0x0F);
+			size_t i = 0;
+			for (; i + 16 <= size; i += 16)
+			{
+				const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				const __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask));
+				const __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, lowMask));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+			}
+			hex_encode_scalar(in + i, size - i, out + 2 * i);
+		}
+
+		/**
+		 * @brief AVX2 version of `hex_encode_ssse3()`, 32 bytes per iteration, i.e. a SHA-256 digest.
+		 * The unpacks work within 128-bit lanes: the halves are reordered by a 64-bit permutation beforehand.
+		 */
+		__attribute__((target("avx2")))
+		inline void hex_encode_avx2(const uint8_t *in, size_t size, uint8_t *out) noexcept {
+			const __m256i digits = _mm256_broadcastsi128_si256(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_digits)));
+			const __m256i lowMask = _mm256_set1_epi8(0x0F);
+			size_t i = 0;
+			for (; i + 32 <= size; i += 32)
+			{
+				// 64-bit quarters [q0 q1 q2 q3] -> [q0 q2 | q1 q3], the unpacks then encode [q0 q1] and [q2 q3]
+				const __m256i bytes = _mm256_permute4x64_epi64(
+					_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), 0xD8);
+				const __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), lowMask));
+				const __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, lowMask));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_unpacklo_epi8(hi, lo));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_unpackhi_epi8(hi, lo));
+			}
+			hex_encode_ssse3(in + i, size - i, out + 2 * i);
+		}
+#endif
+	}
+
+	/**
+	 * @brief Lowercase hex encoder of digests.
+	 *
+	 * Encodes with SSSE3 or AVX2 byte shuffles when supported by the CPU, one byte at a time otherwise.
+	 * The kernel is selected upon the first use. Lines are written straight into the caller's buffer,
+	 * e.g. the session's output queue.
+	 */
+	class hex_encoder
+	{
+	 public:
+		/**
+		 * Kernels, from the narrowest to the widest.
+		 */
+		enum class kernel {
+			scalar,
+			ssse3,
+			avx2
+		};
+
+		/**
+		 * @return `true` if the kernel can be used on this CPU.
+		 */
+		[[nodiscard]] static bool supported(kernel k) noexcept {
+			switch (k)
+			{
+			case kernel::scalar:
+				return true;
+#ifdef HS_HEX_X86_DISPATCH
+			case kernel::ssse3:
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("ssse3");
+			case kernel::avx2:
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("avx2");
+#endif
+			default:
+				return false;
+			}
+		}
+
+		/**
+		 * @return the widest supported kernel.
+		 */
+		[[nodiscard]] static kernel best() noexcept {
+			static const kernel k = [] {
+				for (kernel candidate : {kernel::avx2, kernel::ssse3})
+					if (supported(candidate))
+						return candidate;
+				return kernel::scalar;
+			}();
+			return k;
+		}
+
+		/**
+		 * @brief Encodes `size` bytes into `2 * size` hex characters.
+		 * @pre `supported(k)`
+		 */
+		static void encode(kernel k, const uint8_t *in, size_t size, uint8_t *out) noexcept {
+			switch (k)
+			{
+#ifdef HS_HEX_X86_DISPATCH
+			case kernel::ssse3:
+				detail::hex_encode_ssse3(in, size, out);
+				return;
+			case kernel::avx2:
+				detail::hex_encode_avx2(in, size, out);
+				return;
+#endif
+			default:
+				detail::hex_encode_scalar(in, size, out);
+				return;
+			}
+		}
+
+		static void encode(const uint8_t *in, size_t size, uint8_t *out) noexcept {
+			encode(best(), in, size, out);
+		}
+
+		/**
+		 * @return size of an encoded line of an `N`-byte digest, including the terminator.
+		 */
+		template <size_t N>
+		constexpr static size_t line_size = N * 2 + 1;
+
+		/**
+		 * @brief Encodes the digests as consecutive '\n'-terminated hex lines.
+		 * @param out `count * line_size<N>` bytes
+		 * @return pointer past the last written byte.
+		 */
+		template <size_t N>
+		static uint8_t *encode_lines(kernel k, const std::array<uint8_t, N> *digests, size_t count, uint8_t *out) noexcept {
+			for (size_t i = 0; i < count; ++i)
+			{
+				encode(k, digests[i].data(), N, out);
+				out[N * 2] = '\n';
+				out += line_size<N>;
+			}
+			return out;
+		}
+
+		template <size_t N>
+		static uint8_t *encode_lines(const std::array<uint8_t, N> *digests, size_t count, uint8_t *out) noexcept {
+			return encode_lines(best(), digests, count, out);
+		}
+	};
+}
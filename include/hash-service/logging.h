@@ -1,11 +1,33 @@
 ﻿#pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <iostream>
 #include <sstream>
 
+/**
+ * Log levels compiled in, a mask of `hs::log_level`. Calls of the levels that are not compiled in are
+ * removed entirely, including evaluation of their arguments' formatting.
+ */
+#ifndef HS_LOG_LEVELS
+#define HS_LOG_LEVELS 7
+#endif
+
 namespace hs {
 	/**
 	 * Logging level flag
@@ -16,64 +38,518 @@ namespace hs {
 		messages = 4
 	};
 
-	log_level operator|(log_level lhs, log_level rhs) noexcept {
+	constexpr log_level operator|(log_level lhs, log_level rhs) noexcept {
 		return log_level(static_cast<std::underlying_type_t<log_level>>(lhs) |
 						 static_cast<std::underlying_type_t<log_level>>(rhs));
 	}
 
-	log_level operator&(log_level lhs, log_level rhs) noexcept {
+	constexpr log_level operator&(log_level lhs, log_level rhs) noexcept {
 		return log_level(static_cast<std::underlying_type_t<log_level>>(lhs) &
 						 static_cast<std::underlying_type_t<log_level>>(rhs));
 	}
 
+	constexpr log_level compiled_log_levels = log_level(HS_LOG_LEVELS);
+
+	namespace detail {
+		/**
+		 * @brief Encoded arguments of a log line.
+		 * Formatting of the arguments is deferred to `format`, instantiated for their types.
+		 */
+		struct log_record
+		{
+			constexpr static size_t size = 256;
+
+			using format_fn = void (*)(const char *payload, size_t size, std::string &out);
+
+			format_fn format;
+			log_level level;
+			uint16_t payloadSize;
+			char payload[size - sizeof(format_fn) - sizeof(log_level) - sizeof(uint16_t)];
+		};
+
+		/**
+		 * Appends arguments to a record's payload, truncating what does not fit.
+		 */
+		class log_writer
+		{
+		 public:
+			log_writer(char *begin, size_t capacity) noexcept
+				: _begin(begin), _cur(begin), _end(begin + capacity)
+			{}
+
+			template <typename T>
+			void put(const T &value) noexcept {
+				static_assert(std::is_trivially_copyable_v<T>);
+				if (size_t(_end - _cur) < sizeof(T))
+				{
+					_cur = _end;
+					return;
+				}
+				std::memcpy(_cur, &value, sizeof(T));
+				_cur += sizeof(T);
+			}
+
+			void put_string(const char *data, size_t size) noexcept {
+				if (size_t(_end - _cur) < sizeof(uint16_t))
+				{
+					_cur = _end;
+					return;
+				}
+				const auto length = uint16_t(std::min(size, size_t(_end - _cur) - sizeof(uint16_t)));
+				put(length);
+				std::memcpy(_cur, data, length);
+				_cur += length;
+			}
+
+			[[nodiscard]] size_t size() const noexcept {
+				return size_t(_cur - _begin);
+			}
+
+		 private:
+			char *_begin, *_cur, *_end;
+		};
+
+		class log_reader
+		{
+		 public:
+			log_reader(const char *begin, size_t size) noexcept
+				: _cur(begin), _end(begin + size)
+			{}
+
+			template <typename T>
+			bool get(T &value) noexcept {
+				if (size_t(_end - _cur) < sizeof(T))
+					return false;
+				std::memcpy(&value, _cur, sizeof(T));
+				_cur += sizeof(T);
+				return true;
+			}
+
+			bool get_string(std::string &out) noexcept {
+				uint16_t length = 0;
+				if (!get(length))
+					return false;
+				out.append(_cur, length);
+				_cur += length;
+				return true;
+			}
+
+		 private:
+			const char *_cur, *_end;
+		};
+
+		/**
+		 * @brief Encoding of a log argument.
+		 * The default one formats eagerly with `operator<<`, others copy the value and format it later.
+		 */
+		template <typename T, typename = void>
+		struct log_arg
+		{
+			static void encode(log_writer &w, const T &value) {
+				std::ostringstream ss{};
+				ss << value;
+				const std::string str = ss.str();
+				w.put_string(str.data(), str.size());
+			}
+
+			static bool decode(log_reader &r, std::string &out) {
+				return r.get_string(out);
+			}
+		};
+
+		template <typename T>
+		struct log_arg<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+		{
+			static void encode(log_writer &w, T value) noexcept {
+				w.put(value);
+			}
+
+			static bool decode(log_reader &r, std::string &out) {
+				T value{};
+				if (!r.get(value))
+					return false;
+				if constexpr (std::is_same_v<T, bool>)
+					out += value ? "true" : "false";
+				else if constexpr (std::is_same_v<T, char>)
+					out += value;
+				else
+					out += std::to_string(value);
+				return true;
+			}
+		};
+
+		struct log_string_arg
+		{
+			static void encode(log_writer &w, std::string_view value) noexcept {
+				w.put_string(value.data(), value.size());
+			}
+
+			static bool decode(log_reader &r, std::string &out) {
+				return r.get_string(out);
+			}
+		};
+
+		template <>
+		struct log_arg<const char*> : log_string_arg
+		{};
+
+		template <>
+		struct log_arg<char*> : log_string_arg
+		{};
+
+		template <>
+		struct log_arg<std::string> : log_string_arg
+		{};
+
+		template <>
+		struct log_arg<std::string_view> : log_string_arg
+		{};
+
+		/**
+		 * Error codes (std::, asio:: and boost::): the message is looked up by the drain thread.
+		 */
+		template <typename T>
+		struct log_arg<T, std::void_t<decltype(std::declval<const T&>().value()),
+									  decltype(std::declval<const T&>().category().message(0))>>
+		{
+			using category_type = std::decay_t<decltype(std::declval<const T&>().category())>;
+
+			static void encode(log_writer &w, const T &value) noexcept {
+				w.put(value.value());
+				w.put(&value.category());
+			}
+
+			static bool decode(log_reader &r, std::string &out) {
+				int value = 0;
+				const category_type *category = nullptr;
+				if (!r.get(value) || !r.get(category))
+					return false;
+				out += category->message(value);
+				return true;
+			}
+		};
+
+		template <typename ... Args>
+		void format_log_record(const char *payload, size_t size, std::string &out) {
+			log_reader r{payload, size};
+			// stops at the first truncated argument
+			(log_arg<Args>::decode(r, out) && ...);
+		}
+
+		template <typename ... Args>
+		void encode_log_record(log_record &record, log_level level, const Args &... args) {
+			record.format = &format_log_record<std::decay_t<Args>...>;
+			record.level = level;
+			log_writer w{record.payload, sizeof(record.payload)};
+			(log_arg<std::decay_t<Args>>::encode(w, args), ...);
+			record.payloadSize = uint16_t(w.size());
+		}
+
+		inline const char *log_level_prefix(log_level level) noexcept {
+			switch (level)
+			{
+			case log_level::errors:
+				return "ERROR ";
+			case log_level::warnings:
+				return "WARNING ";
+			default:
+				return "";
+			}
+		}
+
+		/**
+		 * @brief Single-producer single-consumer ring of log records.
+		 * The producer is the thread owning the ring, the consumer is the drain thread.
+		 */
+		class log_ring
+		{
+		 public:
+			explicit log_ring(size_t capacity, std::string threadName)
+				: _records(capacity), _mask(capacity - 1), _threadName(std::move(threadName))
+			{}
+
+			/**
+			 * @return a free record, `nullptr` if the ring is full.
+			 */
+			[[nodiscard]] log_record *begin_push() noexcept {
+				const size_t tail = _tail.load(std::memory_order_relaxed);
+				if (tail - _head.load(std::memory_order_acquire) > _mask)
+				{
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				return &_records[tail & _mask];
+			}
+
+			void end_push() noexcept {
+				_tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			}
+
+			[[nodiscard]] const log_record *front() const noexcept {
+				const size_t head = _head.load(std::memory_order_relaxed);
+				if (head == _tail.load(std::memory_order_acquire))
+					return nullptr;
+				return &_records[head & _mask];
+			}
+
+			void pop() noexcept {
+				_head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			}
+
+			[[nodiscard]] uint64_t take_dropped() noexcept {
+				return _dropped.exchange(0, std::memory_order_relaxed);
+			}
+
+			[[nodiscard]] const std::string &thread_name() const noexcept {
+				return _threadName;
+			}
+
+		 private:
+			std::vector<log_record> _records;
+			size_t _mask;
+			std::string _threadName;
+			alignas(64) std::atomic<size_t> _head{0};
+			alignas(64) std::atomic<size_t> _tail{0};
+			std::atomic<uint64_t> _dropped{0};
+		};
+
+		inline const std::string &this_thread_name() {
+			thread_local const std::string name = [] {
+				std::ostringstream ss{};
+				ss << std::this_thread::get_id();
+				return ss.str();
+			}();
+			return name;
+		}
+
+		inline void format_log_line(log_level level, std::string_view threadName, const log_record &record,
+									std::string &out) {
+			out += log_level_prefix(level);
+			out += "[thread:";
+			out += threadName;
+			out += "] ";
+			record.format(record.payload, record.payloadSize, out);
+			out += '\n';
+		}
+	}
+
 	/**
-	 * ad-hoc logger using std::cout and std::cerr.
-	 * Need to be replaced later
+	 * @brief Asynchronous log backend.
+	 *
+	 * Every logging thread writes encoded records into its own lock-free ring, a background thread drains
+	 * the rings, formats the records and writes them to the output. Records that do not fit into a full ring
+	 * are dropped and counted. Records of different threads may be written out of order.
 	 */
-	class std_ostream_logger
+	class log_backend
 	{
 	 public:
-		explicit std_ostream_logger(log_level level)
-			: _level(level)
-		{}
+		constexpr static size_t ring_capacity = 1024;
 
-		std_ostream_logger()
-			: std_ostream_logger(log_level::errors | log_level::warnings | log_level::messages)
+		/**
+		 * @param output stream to write to, owned by the caller
+		 */
+		explicit log_backend(std::FILE *output = stderr)
+			: _output(output),
+			  _id(next_id()),
+			  _thread([this]{ drain_loop(); })
 		{}
 
-		void message(std::string s) const noexcept {
-			if (!is_enabled(log_level::messages))
-				return;
+		/**
+		 * @param path file to append to
+		 * @throws std::system_error if the file cannot be opened
+		 */
+		explicit log_backend(const std::string &path)
+			: log_backend(open(path))
+		{
+			_ownsOutput = true;
+		}
+
+		log_backend(const log_backend&) = delete;
+		log_backend& operator=(const log_backend&) = delete;
 
-			std::stringstream ss;
-			ss << "[thread:" << std::this_thread::get_id() << "] " << s << '\n';
-			std::cout << ss.str();
+		/**
+		 * Drains the pending records and stops the background thread.
+		 */
+		~log_backend() {
+			_stopping.store(true, std::memory_order_release);
+			_thread.join();
+			if (_ownsOutput)
+				std::fclose(_output);
 		}
 
-		void warning(std::string s) const noexcept {
-			if (!is_enabled(log_level::warnings))
-				return;
+		/**
+		 * @brief Encodes the record into the calling thread's ring. Never blocks.
+		 */
+		template <typename ... Args>
+		void push(log_level level, const Args &... args) noexcept {
+			try {
+				detail::log_ring &ring = this_thread_ring();
+				if (auto *record = ring.begin_push())
+				{
+					detail::encode_log_record(*record, level, args...);
+					ring.end_push();
+				}
+			}
+			catch (...) {
+				// losing a record is better than losing a session
+			}
+		}
 
-			std::stringstream ss;
-			ss << "WARNING [thread:" << std::this_thread::get_id() << "] " << s << '\n';
-			std::cout << ss.str();
+	 private:
+		static std::FILE *open(const std::string &path) {
+			std::FILE *file = std::fopen(path.c_str(), "a");
+			if (!file)
+				throw std::system_error(errno, std::generic_category(), "failed to open the log file " + path);
+			return file;
 		}
 
-		void error(std::string s) const noexcept {
-			if (!is_enabled(log_level::errors))
-				return;
+		static uint64_t next_id() noexcept {
+			static std::atomic<uint64_t> lastId{0};
+			return ++lastId;
+		}
 
-			std::stringstream ss;
-			ss << "ERROR [thread:" << std::this_thread::get_id() << "] " << s << '\n';
-			std::cerr << ss.str();
+		detail::log_ring &this_thread_ring() {
+			// rings of the thread by backend, a thread logs to one or two backends
+			thread_local std::vector<std::pair<uint64_t, detail::log_ring*>> rings{};
+			for (const auto &[id, ring] : rings)
+			{
+				if (id == _id)
+					return *ring;
+			}
+
+			std::lock_guard lock{_ringsMutex};
+			_rings.push_back(std::make_unique<detail::log_ring>(ring_capacity, detail::this_thread_name()));
+			rings.emplace_back(_id, _rings.back().get());
+			return *_rings.back();
+		}
+
+		/**
+		 * @return number of drained records.
+		 */
+		size_t drain(std::string &out) {
+			size_t drained = 0;
+			std::lock_guard lock{_ringsMutex};
+			for (auto &ring : _rings)
+			{
+				while (const auto *record = ring->front())
+				{
+					detail::format_log_line(record->level, ring->thread_name(), *record, out);
+					ring->pop();
+					++drained;
+				}
+
+				if (const uint64_t dropped = ring->take_dropped())
+				{
+					out += "WARNING [thread:" + ring->thread_name() + "] " + std::to_string(dropped) +
+						" log records dropped\n";
+				}
+			}
+			return drained;
+		}
+
+		void drain_loop() {
+			constexpr auto max_backoff = std::chrono::milliseconds(10);
+			auto backoff = std::chrono::microseconds(100);
+			std::string out{};
+			for (;;)
+			{
+				const bool stopping = _stopping.load(std::memory_order_acquire);
+				const size_t drained = drain(out);
+				if (!out.empty())
+				{
+					std::fwrite(out.data(), 1, out.size(), _output);
+					std::fflush(_output);
+					out.clear();
+				}
+
+				if (drained)
+				{
+					backoff = std::chrono::microseconds(100);
+					continue;
+				}
+				if (stopping)
+					return;
+
+				std::this_thread::sleep_for(backoff);
+				backoff = std::min<std::chrono::microseconds>(backoff * 2, max_backoff);
+			}
+		}
+
+		std::FILE *_output;
+		bool _ownsOutput = false;
+		uint64_t _id;
+		std::mutex _ringsMutex;
+		std::vector<std::unique_ptr<detail::log_ring>> _rings;
+		std::atomic<bool> _stopping{false};
+		std::thread _thread;
+	};
+
+	/**
+	 * @brief Logger front-end, cheap to copy.
+	 *
+	 * Takes the parts of a line as arguments: a level that is disabled at compile time or at run time
+	 * costs nothing but a check. Enabled records go to the `log_backend`, if any, and are formatted by its
+	 * thread. Otherwise they are formatted and written synchronously to std::cout (std::cerr for errors).
+	 */
+	class leveled_logger
+	{
+	 public:
+		explicit leveled_logger(log_level level, log_backend *backend = nullptr) noexcept
+			: _level(level), _backend(backend)
+		{}
+
+		leveled_logger() noexcept
+			: leveled_logger(log_level::errors | log_level::warnings | log_level::messages)
+		{}
+
+		template <typename ... Args>
+		void message(const Args &... args) const noexcept {
+			if constexpr (bool(compiled_log_levels & log_level::messages))
+				log(log_level::messages, args...);
+		}
+
+		template <typename ... Args>
+		void warning(const Args &... args) const noexcept {
+			if constexpr (bool(compiled_log_levels & log_level::warnings))
+				log(log_level::warnings, args...);
+		}
+
+		template <typename ... Args>
+		void error(const Args &... args) const noexcept {
+			if constexpr (bool(compiled_log_levels & log_level::errors))
+				log(log_level::errors, args...);
 		}
 
-	 private:
 		[[nodiscard]] bool is_enabled(log_level flag) const noexcept {
-			return bool(_level & flag);
+			return bool(compiled_log_levels & flag) && bool(_level & flag);
+		}
+
+	 private:
+		template <typename ... Args>
+		void log(log_level level, const Args &... args) const noexcept {
+			if (!is_enabled(level))
+				return;
+
+			if (_backend)
+			{
+				_backend->push(level, args...);
+				return;
+			}
+
+			try {
+				detail::log_record record{};
+				detail::encode_log_record(record, level, args...);
+				std::string line{};
+				detail::format_log_line(level, detail::this_thread_name(), record, line);
+				(level == log_level::errors ? std::cerr : std::cout) << line;
+			}
+			catch (...) {
+			}
 		}
 
 		log_level _level;
+		log_backend *_backend;
 	};
 
+	using std_ostream_logger = leveled_logger;
 }
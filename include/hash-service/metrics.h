@@ -0,0 +1,539 @@
+#pragma once
+
+#include "hash-service/buffer_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	/**
+	 * @brief Monotonic counters.
+	 */
+	enum class counter : size_t
+	{
+		sessions_accepted,
+		sessions_closed,
+		bytes_received,
+		bytes_sent,
+		// lines hashed and answered, including the digest cache hits
+		lines_hashed,
+		// time spent by the sessions in a state, nanoseconds, see `session_state`
+		receiving_ns,
+		encoding_ns,
+		responding_ns,
+		// short lines answered from the `digest_cache` and looked up in vain
+		digest_cache_hits,
+		digest_cache_misses,
+		// encoding turns ended by the quantum or the time budget, see `scheduling_policy`
+		turns_yielded,
+		// accepting paused by `resource_governor::config::max_sessions`, receiving paused by `max_bytes`,
+		// receiving paused by `output_policy::max_pending`
+		session_limit_hits,
+		memory_limit_hits,
+		output_limit_hits,
+		count_
+	};
+
+	/**
+	 * @brief Gauges, the sum of the increments and decrements of all the threads.
+	 */
+	enum class gauge : size_t
+	{
+		active_sessions,
+		// lines hashed, but not written to the client yet
+		line_backlog,
+		// bytes of the responses queued and being written
+		output_bytes,
+		count_
+	};
+
+	/**
+	 * @brief Distributions.
+	 */
+	enum class histogram : size_t
+	{
+		// bytes of a hashed line, excluding the terminator
+		line_size,
+		// from receiving the first byte of a line to its digest, nanoseconds
+		line_latency_ns,
+		// from a session yielding its turn to its next turn, per `session_class`, nanoseconds
+		latency_wait_ns,
+		bulk_wait_ns,
+		count_
+	};
+
+	/**
+	 * @brief Session states timed by `counter::receiving_ns`, `encoding_ns` and `responding_ns`.
+	 * Responding overlaps with the other two.
+	 */
+	enum class session_state : size_t
+	{
+		// a receive is pending
+		receiving,
+		// from a receive completion till the received bytes are consumed, including offloaded hashing
+		encoding,
+		// a write is pending
+		responding
+	};
+
+	namespace detail {
+		/**
+		 * @brief HDR-style log-linear buckets: exact below `2^sub_bucket_bits`, above that every power of two
+		 * is split into `2^sub_bucket_bits` buckets, i.e. a relative error below 12.5%.
+		 */
+		struct log_buckets
+		{
+			constexpr static unsigned sub_bucket_bits = 3;
+			constexpr static size_t sub_buckets = size_t(1) << sub_bucket_bits;
+			constexpr static size_t count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+			constexpr static unsigned msb(uint64_t value) noexcept {
+				unsigned bit = 0;
+				while (value >>= 1)
+					++bit;
+				return bit;
+			}
+
+			constexpr static size_t index(uint64_t value) noexcept {
+				if (value < sub_buckets)
+					return size_t(value);
+				const unsigned shift = msb(value) - sub_bucket_bits;
+				return ((shift + 1) << sub_bucket_bits) | size_t((value >> shift) & (sub_buckets - 1));
+			}
+
+			/**
+			 * @return the smallest value of the bucket.
+			 */
+			constexpr static uint64_t lower_bound(size_t index) noexcept {
+				if (index < sub_buckets)
+					return index;
+				const unsigned shift = unsigned(index >> sub_bucket_bits) - 1;
+				return uint64_t(sub_buckets | (index & (sub_buckets - 1))) << shift;
+			}
+
+			/**
+			 * @return the largest value of the bucket.
+			 */
+			constexpr static uint64_t upper_bound(size_t index) noexcept {
+				return index + 1 < count ? lower_bound(index + 1) - 1 : UINT64_MAX;
+			}
+		};
+
+		static_assert(log_buckets::index(UINT64_MAX) == log_buckets::count - 1);
+
+		// the only writer is the owning thread: no read-modify-write instruction is needed
+		template <typename T>
+		inline void add_relaxed(std::atomic<T> &value, T n) noexcept {
+			value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Metrics of a single thread. Written by the thread, read by the scraper.
+		 */
+		struct alignas(64) metrics_shard
+		{
+			std::array<std::atomic<uint64_t>, size_t(counter::count_)> counters{};
+			std::array<std::atomic<int64_t>, size_t(gauge::count_)> gauges{};
+			std::array<std::array<std::atomic<uint64_t>, log_buckets::count>, size_t(histogram::count_)> histograms{};
+			std::array<std::atomic<uint64_t>, size_t(histogram::count_)> sums{};
+		};
+	}
+
+	/**
+	 * @brief Merged distribution of a histogram.
+	 */
+	class histogram_snapshot
+	{
+	 public:
+		void add(size_t bucket, uint64_t n) noexcept {
+			_buckets[bucket] += n;
+			_count += n;
+		}
+
+		void add_sum(uint64_t sum) noexcept {
+			_sum += sum;
+		}
+
+		[[nodiscard]] uint64_t count() const noexcept {
+			return _count;
+		}
+
+		[[nodiscard]] uint64_t sum() const noexcept {
+			return _sum;
+		}
+
+		[[nodiscard]] uint64_t bucket(size_t index) const noexcept {
+			return _buckets[index];
+		}
+
+		/**
+		 * @param q quantile in [0, 1]
+		 * @return upper bound of the bucket containing the quantile, 0 if empty.
+		 */
+		[[nodiscard]] uint64_t quantile(double q) const noexcept {
+			if (!_count)
+				return 0;
+
+			const auto rank = std::max<uint64_t>(1, uint64_t(q * double(_count) + 0.5));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < _buckets.size(); ++i)
+			{
+				seen += _buckets[i];
+				if (seen >= rank)
+					return detail::log_buckets::upper_bound(i);
+			}
+			return detail::log_buckets::upper_bound(_buckets.size() - 1);
+		}
+
+		/**
+		 * @return the largest recorded value, rounded up to its bucket.
+		 */
+		[[nodiscard]] uint64_t max() const noexcept {
+			for (size_t i = _buckets.size(); i-- > 0;)
+			{
+				if (_buckets[i])
+					return detail::log_buckets::upper_bound(i);
+			}
+			return 0;
+		}
+
+	 private:
+		std::array<uint64_t, detail::log_buckets::count> _buckets{};
+		uint64_t _count = 0;
+		uint64_t _sum = 0;
+	};
+
+	/**
+	 * @brief Point-in-time merge of the metrics of all the threads.
+	 */
+	struct metrics_snapshot
+	{
+		std::array<uint64_t, size_t(counter::count_)> counters{};
+		std::array<int64_t, size_t(gauge::count_)> gauges{};
+		std::array<histogram_snapshot, size_t(histogram::count_)> histograms{};
+		// process-wide, shared by all the metrics instances
+		buffer_pool_stats buffers{};
+
+		[[nodiscard]] uint64_t operator[](counter c) const noexcept {
+			return counters[size_t(c)];
+		}
+
+		[[nodiscard]] int64_t operator[](gauge g) const noexcept {
+			return gauges[size_t(g)];
+		}
+
+		[[nodiscard]] const histogram_snapshot &operator[](histogram h) const noexcept {
+			return histograms[size_t(h)];
+		}
+	};
+
+	/**
+	 * @brief Server metrics.
+	 *
+	 * Every recording thread writes to its own cache-line aligned shard with plain relaxed stores,
+	 * shards are merged on read. Recording never locks, except for the first record of a thread.
+	 *
+	 * @threadsafe All the member functions may be called from multiple threads.
+	 * Must outlive the recording sessions.
+	 */
+	class metrics
+	{
+	 public:
+		metrics()
+			: _id(next_id())
+		{}
+
+		metrics(const metrics&) = delete;
+		metrics& operator=(const metrics&) = delete;
+
+		void add(counter c, uint64_t n = 1) noexcept {
+			if (auto *shard = this_thread_shard())
+				detail::add_relaxed(shard->counters[size_t(c)], n);
+		}
+
+		void add(gauge g, int64_t n) noexcept {
+			if (auto *shard = this_thread_shard())
+				detail::add_relaxed(shard->gauges[size_t(g)], n);
+		}
+
+		void record(histogram h, uint64_t value) noexcept {
+			if (auto *shard = this_thread_shard())
+			{
+				detail::add_relaxed(shard->histograms[size_t(h)][detail::log_buckets::index(value)], uint64_t(1));
+				detail::add_relaxed(shard->sums[size_t(h)], value);
+			}
+		}
+
+		/**
+		 * @brief Adds the time elapsed since `since` to the state's counter.
+		 */
+		void add_time(session_state state, std::chrono::steady_clock::time_point since,
+					  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) noexcept {
+			add(counter(size_t(counter::receiving_ns) + size_t(state)), elapsed_ns(since, now));
+		}
+
+		[[nodiscard]] static uint64_t elapsed_ns(std::chrono::steady_clock::time_point since,
+												 std::chrono::steady_clock::time_point now) noexcept {
+			return now > since ? uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - since).count()) : 0;
+		}
+
+		[[nodiscard]] metrics_snapshot snapshot() const {
+			metrics_snapshot snap{};
+			snap.buffers = buffer_pool::stats();
+			std::lock_guard lock{_shardsMutex};
+			for (const auto &shard : _shards)
+			{
+				for (size_t i = 0; i < snap.counters.size(); ++i)
+					snap.counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+				for (size_t i = 0; i < snap.gauges.size(); ++i)
+					snap.gauges[i] += shard->gauges[i].load(std::memory_order_relaxed);
+				for (size_t h = 0; h < snap.histograms.size(); ++h)
+				{
+					for (size_t i = 0; i < detail::log_buckets::count; ++i)
+					{
+						if (const uint64_t n = shard->histograms[h][i].load(std::memory_order_relaxed))
+							snap.histograms[h].add(i, n);
+					}
+					snap.histograms[h].add_sum(shard->sums[h].load(std::memory_order_relaxed));
+				}
+			}
+			return snap;
+		}
+
+	 private:
+		static uint64_t next_id() noexcept {
+			static std::atomic<uint64_t> lastId{0};
+			return ++lastId;
+		}
+
+		detail::metrics_shard *this_thread_shard() noexcept {
+			// shards of the thread by metrics instance, usually a single one
+			thread_local std::vector<std::pair<uint64_t, detail::metrics_shard*>> shards{};
+			for (const auto &[id, shard] : shards)
+			{
+				if (id == _id)
+					return shard;
+			}
+
+			try {
+				std::lock_guard lock{_shardsMutex};
+				_shards.push_back(std::make_unique<detail::metrics_shard>());
+				shards.emplace_back(_id, _shards.back().get());
+				return _shards.back().get();
+			}
+			catch (...) {
+				// losing a record is better than losing a session
+				return nullptr;
+			}
+		}
+
+		uint64_t _id;
+		mutable std::mutex _shardsMutex;
+		// shards outlive their threads: a thread's records remain in the totals
+		std::vector<std::unique_ptr<detail::metrics_shard>> _shards;
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_metrics
+		{
+			constexpr std::nullptr_t operator()(const Config&) const noexcept {
+				return nullptr;
+			}
+		};
+
+		template <typename Config>
+		struct _get_metrics<Config, std::void_t<decltype(std::declval<Config>().metrics)>>
+		{
+			constexpr metrics *operator()(const Config& c) const noexcept {
+				return c.metrics;
+			}
+		};
+
+		struct metric_info
+		{
+			std::string_view name;
+			std::string_view help;
+		};
+
+		constexpr std::array<metric_info, size_t(counter::count_)> counter_info{{
+			{"hs_sessions_accepted_total", "Sessions accepted."},
+			{"hs_sessions_closed_total", "Sessions closed."},
+			{"hs_received_bytes_total", "Bytes received from the clients."},
+			{"hs_sent_bytes_total", "Bytes sent to the clients."},
+			{"hs_lines_hashed_total", "Lines hashed and answered, including the digest cache hits."},
+			{"hs_receiving_seconds_total", "Time the sessions spent waiting for a receive."},
+			{"hs_encoding_seconds_total", "Time the sessions spent hashing received bytes, including the compute pool."},
+			{"hs_responding_seconds_total", "Time the sessions spent waiting for a write."},
+			{"hs_digest_cache_hits_total", "Lines answered from the digest cache."},
+			{"hs_digest_cache_misses_total", "Lines looked up in the digest cache and hashed."},
+			{"hs_turns_yielded_total", "Encoding turns ended by the scheduling quantum or time budget."},
+			{"hs_session_limit_hits_total", "Times accepting was paused by the session limit."},
+			{"hs_memory_limit_hits_total", "Times a session stopped receiving over the memory budget."},
+			{"hs_output_limit_hits_total", "Times a session stopped receiving over its output queue limit."},
+		}};
+
+		constexpr std::array<metric_info, size_t(gauge::count_)> gauge_info{{
+			{"hs_active_sessions", "Sessions alive."},
+			{"hs_line_backlog", "Lines hashed, but not written to the clients yet."},
+			{"hs_output_bytes", "Bytes of the responses queued and being written."},
+		}};
+
+		constexpr std::array<metric_info, size_t(histogram::count_)> histogram_info{{
+			{"hs_line_size_bytes", "Bytes of a hashed line."},
+			{"hs_line_latency_seconds", "Time from the first byte of a line to its digest."},
+			{"hs_latency_wait_seconds", "Time a latency-class session waited for its next turn after yielding."},
+			{"hs_bulk_wait_seconds", "Time a bulk-class session waited for its next turn after yielding."},
+		}};
+
+		constexpr std::array<metric_info, 4> buffer_pool_info{{
+			{"hs_receive_buffers", "Receive buffers borrowed by the sessions."},
+			{"hs_receive_buffer_bytes", "Bytes of the receive buffers borrowed by the sessions."},
+			{"hs_receive_buffer_peak_bytes", "High-water mark of hs_receive_buffer_bytes."},
+			{"hs_receive_buffer_cached_bytes", "Bytes of the receive buffers kept by the per-thread pools."},
+		}};
+
+		inline std::array<uint64_t, 4> buffer_pool_values(const buffer_pool_stats &stats) noexcept {
+			return {stats.buffers_in_use, stats.bytes_in_use, stats.peak_bytes_in_use, stats.bytes_cached};
+		}
+
+		// counters and histograms in nanoseconds are exposed in seconds
+		constexpr bool is_nanoseconds(counter c) noexcept {
+			return c == counter::receiving_ns || c == counter::encoding_ns || c == counter::responding_ns;
+		}
+
+		constexpr bool is_nanoseconds(histogram h) noexcept {
+			return h == histogram::line_latency_ns || h == histogram::latency_wait_ns ||
+				h == histogram::bulk_wait_ns;
+		}
+
+		inline std::string format_value(uint64_t value, bool nanoseconds) {
+			if (!nanoseconds)
+				return std::to_string(value);
+			std::string s = std::to_string(value / 1'000'000'000) + '.';
+			const std::string fraction = std::to_string(value % 1'000'000'000);
+			return s.append(9 - fraction.size(), '0').append(fraction);
+		}
+	}
+
+	/**
+	 * @return metrics of the config, `nullptr` if not set.
+	 */
+	template <typename Config>
+	constexpr static metrics *get_metrics(const Config &c) noexcept {
+		return detail::_get_metrics<std::decay_t<Config>>{}(c);
+	}
+
+	/**
+	 * @brief Formats the snapshot in the Prometheus text exposition format.
+	 * Histograms are exposed with a bucket per power of two up to the largest recorded value.
+	 */
+	inline std::string to_prometheus(const metrics_snapshot &snap) {
+		std::string out{};
+		const auto header = [&out](const detail::metric_info &info, std::string_view type) {
+			out.append("# HELP ").append(info.name).append(" ").append(info.help).append("\n")
+				.append("# TYPE ").append(info.name).append(" ").append(type).append("\n");
+		};
+
+		for (size_t i = 0; i < snap.counters.size(); ++i)
+		{
+			const auto &info = detail::counter_info[i];
+			header(info, "counter");
+			out.append(info.name).append(" ")
+				.append(detail::format_value(snap.counters[i], detail::is_nanoseconds(counter(i)))).append("\n");
+		}
+
+		for (size_t i = 0; i < snap.gauges.size(); ++i)
+		{
+			const auto &info = detail::gauge_info[i];
+			header(info, "gauge");
+			out.append(info.name).append(" ").append(std::to_string(snap.gauges[i])).append("\n");
+		}
+
+		const auto bufferValues = detail::buffer_pool_values(snap.buffers);
+		for (size_t i = 0; i < bufferValues.size(); ++i)
+		{
+			const auto &info = detail::buffer_pool_info[i];
+			header(info, "gauge");
+			out.append(info.name).append(" ").append(std::to_string(bufferValues[i])).append("\n");
+		}
+
+		for (size_t h = 0; h < snap.histograms.size(); ++h)
+		{
+			const auto &info = detail::histogram_info[h];
+			const auto &hist = snap.histograms[h];
+			const bool ns = detail::is_nanoseconds(histogram(h));
+			header(info, "histogram");
+
+			// the power-of-two boundaries are bucket boundaries as well
+			const uint64_t max = hist.max();
+			uint64_t cumulative = 0;
+			size_t iBucket = 0;
+			for (unsigned bit = 0; bit < 64; ++bit)
+			{
+				const uint64_t le = (uint64_t(1) << bit) - 1;
+				for (; iBucket < detail::log_buckets::count && detail::log_buckets::upper_bound(iBucket) <= le; ++iBucket)
+					cumulative += hist.bucket(iBucket);
+				out.append(info.name).append("_bucket{le=\"").append(detail::format_value(le, ns)).append("\"} ")
+					.append(std::to_string(cumulative)).append("\n");
+				if (le >= max)
+					break;
+			}
+			out.append(info.name).append("_bucket{le=\"+Inf\"} ").append(std::to_string(hist.count())).append("\n")
+				.append(info.name).append("_sum ").append(detail::format_value(hist.sum(), ns)).append("\n")
+				.append(info.name).append("_count ").append(std::to_string(hist.count())).append("\n");
+		}
+		return out;
+	}
+
+	/**
+	 * @brief Formats the snapshot as a JSON object.
+	 * Histograms are summarized by their count, sum and quantiles, in their recorded units.
+	 */
+	inline std::string to_json(const metrics_snapshot &snap) {
+		std::string out = "{";
+		const auto field = [&out](std::string_view name, const std::string &value) {
+			if (out.size() > 1)
+				out += ',';
+			out.append("\"").append(name).append("\":").append(value);
+		};
+
+		for (size_t i = 0; i < snap.counters.size(); ++i)
+			field(detail::counter_info[i].name, detail::format_value(snap.counters[i], detail::is_nanoseconds(counter(i))));
+		for (size_t i = 0; i < snap.gauges.size(); ++i)
+			field(detail::gauge_info[i].name, std::to_string(snap.gauges[i]));
+		const auto bufferValues = detail::buffer_pool_values(snap.buffers);
+		for (size_t i = 0; i < bufferValues.size(); ++i)
+			field(detail::buffer_pool_info[i].name, std::to_string(bufferValues[i]));
+
+		constexpr std::array<std::pair<std::string_view, double>, 4> quantiles{{
+			{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p999", 0.999}
+		}};
+		for (size_t h = 0; h < snap.histograms.size(); ++h)
+		{
+			const auto &hist = snap.histograms[h];
+			std::string value = "{\"count\":" + std::to_string(hist.count()) + ",\"sum\":" + std::to_string(hist.sum());
+			for (const auto &[name, q] : quantiles)
+				value.append(",\"").append(name).append("\":").append(std::to_string(hist.quantile(q)));
+			value.append(",\"max\":").append(std::to_string(hist.max())).append("}");
+			// nanoseconds are not converted: the name says the unit
+			std::string name{detail::histogram_info[h].name};
+			if (detail::is_nanoseconds(histogram(h)))
+				name.replace(name.rfind("_seconds"), std::string::npos, "_ns");
+			field(name, value);
+		}
+		out += '}';
+		return out;
+	}
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <array>
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+	/**
+	 * When queued responses are handed to the socket.
+	 */
+	enum class flush_mode {
+		immediate, // as soon as a line is complete
+		end_of_batch, // once all the lines of a receive have been processed
+		threshold // when `size_threshold` bytes are queued or `delay` has passed since the first queued byte
+	};
+
+	struct flush_policy
+	{
+		flush_mode mode = flush_mode::end_of_batch;
+		size_t size_threshold = 16 * 1024;
+		std::chrono::microseconds delay{500};
+	};
+
+	struct output_policy
+	{
+		flush_policy flush{};
+		bool no_delay = true; // TCP_NODELAY
+		size_t max_pending = 1024 * 1024; // stop receiving while more output is queued
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_output_policy
+		{
+			constexpr output_policy operator()(const Config&) const noexcept {
+				return output_policy{};
+			}
+		};
+
+		template <typename Config>
+		struct _get_output_policy<Config, std::void_t<decltype(std::declval<Config>().output)>>
+		{
+			constexpr output_policy operator()(const Config& c) const noexcept {
+				return c.output;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static output_policy get_output_policy(const Config &c) noexcept {
+		return detail::_get_output_policy<std::decay_t<Config>>{}(c);
+	}
+
+	namespace detail {
+		/**
+		 * @brief Allocator default-initializing the elements, so that growing a byte buffer
+		 * to write into it does not zero it first.
+		 */
+		template <typename T>
+		struct default_init_allocator : std::allocator<T>
+		{
+			using value_type = T;
+
+			template <typename U>
+			struct rebind
+			{
+				using other = default_init_allocator<U>;
+			};
+
+			default_init_allocator() noexcept = default;
+
+			template <typename U>
+			default_init_allocator(const default_init_allocator<U>&) noexcept
+			{}
+
+			template <typename U>
+			void construct(U *p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+				::new(static_cast<void*>(p)) U;
+			}
+
+			template <typename U, typename ... Args>
+			void construct(U *p, Args &&... args) {
+				::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+			}
+		};
+	}
+
+	/**
+	 * @brief Per-session output queue.
+	 *
+	 * Responses are appended to the staging buffer while at most one write is in flight.
+	 * `begin_write()` swaps the staging buffer with the in-flight one, so that everything
+	 * queued since the previous write is sent with a single write operation.
+	 * Buffers keep their capacity between writes.
+	 *
+	 * Not thread-safe: must be accessed from the session's strand.
+	 */
+	class output_queue
+	{
+	 public:
+		using buffer_type = std::vector<uint8_t, detail::default_init_allocator<uint8_t>>;
+
+		output_queue() = default;
+
+		explicit output_queue(size_t reserve) {
+			_staging.reserve(reserve);
+			_inFlight.reserve(reserve);
+		}
+
+		/**
+		 * @brief Appends a response to the staging buffer.
+		 */
+		void push(const uint8_t *data, size_t size) {
+			_staging.insert(std::end(_staging), data, data + size);
+		}
+
+		template <size_t N>
+		void push(const std::array<uint8_t, N> &data) {
+			push(data.data(), N);
+		}
+
+		void push(uint8_t byte) {
+			_staging.push_back(byte);
+		}
+
+		/**
+		 * @brief Appends `size` uninitialized bytes to the staging buffer for the caller to write responses into.
+		 * @return the appended bytes. Valid until the next call modifying the queue.
+		 */
+		[[nodiscard]] uint8_t *append(size_t size) {
+			const size_t offset = _staging.size();
+			_staging.resize(offset + size);
+			return _staging.data() + offset;
+		}
+
+		/**
+		 * @return bytes waiting for the next write.
+		 */
+		[[nodiscard]] size_t staged() const noexcept {
+			return _staging.size();
+		}
+
+		/**
+		 * @return bytes of the write in flight.
+		 */
+		[[nodiscard]] size_t in_flight() const noexcept {
+			return _inFlight.size();
+		}
+
+		[[nodiscard]] bool writing() const noexcept {
+			return _writing;
+		}
+
+		/**
+		 * @brief Moves staged bytes to the in-flight buffer.
+		 * @pre `!writing() && staged() != 0`
+		 * @return buffer to be written. Stays valid until `end_write()`.
+		 */
+		const buffer_type &begin_write() noexcept {
+			_staging.swap(_inFlight);
+			_writing = true;
+			return _inFlight;
+		}
+
+		/**
+		 * @brief Releases the in-flight buffer upon write completion.
+		 */
+		void end_write() noexcept {
+			_inFlight.clear();
+			_writing = false;
+		}
+
+	 private:
+		buffer_type _staging,
+			_inFlight;
+		bool _writing = false;
+	};
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+	namespace detail {
+		/**
+		 * @brief Per-thread cache of freed memory blocks by size class.
+		 *
+		 * Blocks up to `max_block_size` are rounded up to a multiple of `granularity` and kept in an intrusive
+		 * free list of their class, up to `max_cached_bytes` per class. Larger blocks go to the global heap.
+		 * A block freed by another thread than the allocating one joins the freeing thread's cache.
+		 */
+		class block_cache
+		{
+		 public:
+			constexpr static size_t granularity = 64;
+			constexpr static size_t max_block_size = 4096;
+			constexpr static size_t max_cached_bytes = 256 * 1024;
+
+			block_cache() = default;
+			block_cache(const block_cache&) = delete;
+			block_cache& operator=(const block_cache&) = delete;
+
+			~block_cache() {
+				for (auto &list : _lists)
+				{
+					while (list.head)
+					{
+						free_block *next = list.head->next;
+						::operator delete(list.head);
+						list.head = next;
+					}
+				}
+			}
+
+			/**
+			 * @brief Allocates from the heap a block any cache can take back, without a cache.
+			 * Blocks up to `max_block_size` are rounded up to their class size.
+			 */
+			[[nodiscard]] static void *allocate_uncached(size_t size) {
+				return ::operator new(size > max_block_size ? size : block_size(size));
+			}
+
+			[[nodiscard]] void *allocate(size_t size) {
+				if (size > max_block_size)
+					return ::operator new(size);
+
+				free_list &list = _lists[class_of(size)];
+				if (!list.head)
+					return allocate_uncached(size);
+
+				free_block *block = list.head;
+				list.head = block->next;
+				--list.count;
+				return block;
+			}
+
+			void deallocate(void *p, size_t size) noexcept {
+				if (size > max_block_size)
+				{
+					::operator delete(p);
+					return;
+				}
+
+				free_list &list = _lists[class_of(size)];
+				if (list.count * block_size(size) >= max_cached_bytes)
+				{
+					::operator delete(p);
+					return;
+				}
+
+				auto *block = static_cast<free_block*>(p);
+				block->next = list.head;
+				list.head = block;
+				++list.count;
+			}
+
+		 private:
+			struct free_block
+			{
+				free_block *next;
+			};
+
+			struct free_list
+			{
+				free_block *head = nullptr;
+				size_t count = 0;
+			};
+
+			constexpr static size_t class_of(size_t size) noexcept {
+				return size ? (size - 1) / granularity : 0;
+			}
+
+			constexpr static size_t block_size(size_t size) noexcept {
+				return (class_of(size) + 1) * granularity;
+			}
+
+			std::array<free_list, max_block_size / granularity> _lists{};
+		};
+
+		// set once the thread's cache is destroyed: blocks freed later during the thread's exit go to the heap
+		inline thread_local bool blockCacheDestroyed = false;
+
+		struct thread_block_cache : block_cache
+		{
+			~thread_block_cache() {
+				blockCacheDestroyed = true;
+			}
+		};
+
+		inline block_cache *this_thread_block_cache() noexcept {
+			if (blockCacheDestroyed)
+				return nullptr;
+			thread_local thread_block_cache cache{};
+			return &cache;
+		}
+	}
+
+	/**
+	 * @brief Allocator recycling memory through per-thread caches, see `detail::block_cache`.
+	 *
+	 * Used for session contexts with `std::allocate_shared` and for asio handlers, see `bind_pool_allocator()`,
+	 * so that in steady state neither a new connection nor an asynchronous operation reaches malloc.
+	 */
+	template <typename T>
+	class pool_allocator
+	{
+	 public:
+		using value_type = T;
+
+		static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "over-aligned types are not supported");
+
+		pool_allocator() noexcept = default;
+
+		template <typename U>
+		pool_allocator(const pool_allocator<U>&) noexcept
+		{}
+
+		[[nodiscard]] T *allocate(size_t n) {
+			const size_t size = n * sizeof(T);
+			if (auto *cache = detail::this_thread_block_cache())
+				return static_cast<T*>(cache->allocate(size));
+			// freed later to another thread's cache, so rounded up as well
+			return static_cast<T*>(detail::block_cache::allocate_uncached(size));
+		}
+
+		void deallocate(T *p, size_t n) noexcept {
+			if (auto *cache = detail::this_thread_block_cache())
+				cache->deallocate(p, n * sizeof(T));
+			else
+				::operator delete(p);
+		}
+
+		template <typename U>
+		friend bool operator==(const pool_allocator&, const pool_allocator<U>&) noexcept {
+			return true;
+		}
+
+		template <typename U>
+		friend bool operator!=(const pool_allocator&, const pool_allocator<U>&) noexcept {
+			return false;
+		}
+	};
+
+	/**
+	 * @brief Completion handler associated with `pool_allocator`.
+	 * asio allocates the operation's state with the handler's associated allocator.
+	 */
+	template <typename Handler>
+	class pooled_handler
+	{
+	 public:
+		using allocator_type = pool_allocator<Handler>;
+
+		explicit pooled_handler(const Handler &handler)
+			: _handler(handler)
+		{}
+
+		explicit pooled_handler(Handler &&handler)
+			: _handler(std::move(handler))
+		{}
+
+		[[nodiscard]] allocator_type get_allocator() const noexcept {
+			return allocator_type{};
+		}
+
+		template <typename ... Args>
+		decltype(auto) operator()(Args &&... args) {
+			return _handler(std::forward<Args>(args)...);
+		}
+
+	 private:
+		Handler _handler;
+	};
+
+	template <typename Handler>
+	pooled_handler<std::decay_t<Handler>> bind_pool_allocator(Handler &&handler) {
+		return pooled_handler<std::decay_t<Handler>>(std::forward<Handler>(handler));
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	template <typename Node>
+	class session_registry;
+
+	/**
+	 * @brief Intrusive hook of a `session_registry` node.
+	 * A node is linked into a single registry at a time.
+	 */
+	class registry_hook
+	{
+	 public:
+		registry_hook() noexcept = default;
+
+		registry_hook(const registry_hook&) = delete;
+		registry_hook& operator=(const registry_hook&) = delete;
+
+		[[nodiscard]] bool linked() const noexcept {
+			return _next != nullptr;
+		}
+
+	 private:
+		template <typename Node>
+		friend class session_registry;
+
+		registry_hook *_prev = nullptr;
+		registry_hook *_next = nullptr;
+		size_t _shard = 0;
+	};
+
+	/**
+	 * @brief Registry of live sessions for graceful shutdown.
+	 *
+	 * An intrusive circular list per shard, every shard protected by its own mutex. Nodes link themselves
+	 * into the shard of the linking thread and unlink in O(1), usually from their destructors, so that
+	 * neither periodic sweeping nor a global lock is needed.
+	 *
+	 * @threadsafe All the member functions may be called from multiple threads.
+	 * The registry must outlive its nodes.
+	 *
+	 * @tparam Node type deriving from `registry_hook` and `std::enable_shared_from_this<Node>`
+	 */
+	template <typename Node>
+	class session_registry
+	{
+	 public:
+		explicit session_registry(size_t shards = std::thread::hardware_concurrency())
+			: _shards(shards ? shards : 1)
+		{
+			for (auto &shard : _shards)
+				shard.head._prev = shard.head._next = &shard.head;
+		}
+
+		session_registry(const session_registry&) = delete;
+		session_registry& operator=(const session_registry&) = delete;
+
+		/**
+		 * @brief Links the node into the calling thread's shard. The node must not be linked.
+		 */
+		void link(Node &node) noexcept {
+			registry_hook &hook = node;
+			const size_t iShard = std::hash<std::thread::id>{}(std::this_thread::get_id()) % _shards.size();
+			shard &s = _shards[iShard];
+
+			std::lock_guard lock{s.mutex};
+			hook._shard = iShard;
+			hook._prev = &s.head;
+			hook._next = s.head._next;
+			s.head._next->_prev = &hook;
+			s.head._next = &hook;
+			++s.size;
+		}
+
+		/**
+		 * @brief Unlinks the node. No-op if the node is not linked.
+		 */
+		void unlink(Node &node) noexcept {
+			registry_hook &hook = node;
+			if (!hook.linked())
+				return;
+
+			shard &s = _shards[hook._shard];
+			std::lock_guard lock{s.mutex};
+			hook._prev->_next = hook._next;
+			hook._next->_prev = hook._prev;
+			hook._prev = hook._next = nullptr;
+			--s.size;
+		}
+
+		/**
+		 * @return live nodes. Nodes being destroyed are skipped.
+		 * Shard locks are released before returning, so that dropping the references may destroy nodes.
+		 */
+		[[nodiscard]] std::vector<std::shared_ptr<Node>> snapshot() const {
+			std::vector<std::shared_ptr<Node>> nodes{};
+			for (const auto &s : _shards)
+			{
+				std::lock_guard lock{s.mutex};
+				nodes.reserve(nodes.size() + s.size);
+				for (registry_hook *hook = s.head._next; hook != &s.head; hook = hook->_next)
+				{
+					if (auto node = static_cast<Node*>(hook)->weak_from_this().lock())
+						nodes.push_back(std::move(node));
+				}
+			}
+			return nodes;
+		}
+
+		/**
+		 * @return number of linked nodes.
+		 */
+		[[nodiscard]] size_t size() const noexcept {
+			size_t total = 0;
+			for (const auto &s : _shards)
+			{
+				std::lock_guard lock{s.mutex};
+				total += s.size;
+			}
+			return total;
+		}
+
+	 private:
+		struct alignas(64) shard
+		{
+			mutable std::mutex mutex;
+			registry_hook head;
+			size_t size = 0;
+		};
+
+		std::vector<shard> _shards;
+	};
+}
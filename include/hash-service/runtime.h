@@ -0,0 +1,130 @@
+#pragma once
+
+#include <asio.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <string_view>
+
+namespace hs {
+	/**
+	 * How I/O threads share the work.
+	 */
+	enum class runtime_mode {
+		shared, // all the threads run a single io_context
+		sharded // every thread runs its own io_context, with its own acceptors (SO_REUSEPORT)
+	};
+
+	inline std::optional<runtime_mode> parse_runtime_mode(std::string_view name) noexcept {
+		if (name == "shared")
+			return runtime_mode::shared;
+		if (name == "sharded")
+			return runtime_mode::sharded;
+		return std::nullopt;
+	}
+
+	/**
+	 * @return the I/O backend asio has been built with.
+	 * `io_uring` requires Asio 1.21+ built with `ASIO_HAS_IO_URING` and `ASIO_DISABLE_EPOLL`, see `WITH_IO_URING`.
+	 */
+	constexpr std::string_view io_backend() noexcept {
+#if defined(ASIO_HAS_IO_URING) && defined(ASIO_DISABLE_EPOLL)
+		return "io_uring";
+#elif defined(ASIO_HAS_IOCP)
+		return "iocp";
+#elif defined(ASIO_HAS_EPOLL)
+		return "epoll";
+#elif defined(ASIO_HAS_KQUEUE)
+		return "kqueue";
+#else
+		return "select";
+#endif
+	}
+
+	struct runtime_config
+	{
+		runtime_mode mode = runtime_mode::shared;
+		size_t threads = 0; // 0 for std::thread::hardware_concurrency()
+	};
+
+	/**
+	 * @brief Owns the io_contexts and the threads running them.
+	 *
+	 * In the shared mode there is a single io_context run by all the threads.
+	 * In the sharded mode there is an io_context per thread. Servers are created per shard,
+	 * so that accepted sessions are served by the thread of their acceptor only.
+	 */
+	class runtime
+	{
+	 public:
+		explicit runtime(runtime_config config)
+			: _mode(config.mode),
+			  _threads(config.threads ? config.threads : default_threads())
+		{
+			const size_t shards = _mode == runtime_mode::sharded ? _threads : 1;
+			const int concurrencyHint = _mode == runtime_mode::sharded ? 1 : int(_threads);
+			_contexts.reserve(shards);
+			for (size_t i = 0; i < shards; ++i)
+				_contexts.push_back(std::make_unique<asio::io_context>(concurrencyHint));
+		}
+
+		runtime(const runtime&) = delete;
+		runtime& operator=(const runtime&) = delete;
+
+		[[nodiscard]] runtime_mode mode() const noexcept {
+			return _mode;
+		}
+
+		[[nodiscard]] size_t threads() const noexcept {
+			return _threads;
+		}
+
+		/**
+		 * @return number of io_contexts: 1 in the shared mode, `threads()` in the sharded mode.
+		 */
+		[[nodiscard]] size_t shards() const noexcept {
+			return _contexts.size();
+		}
+
+		[[nodiscard]] asio::io_context &context(size_t shard) noexcept {
+			return *_contexts[shard];
+		}
+
+		/**
+		 * @brief Runs the io_contexts until all of them are out of work.
+		 * The calling thread is one of `threads()`.
+		 */
+		void run() {
+			std::vector<std::thread> workers{};
+			workers.reserve(_threads - 1);
+			for (size_t i = 1; i < _threads; ++i)
+				workers.emplace_back([this, i]{ context(i % shards()).run(); });
+
+			context(0).run();
+			for (auto &worker : workers)
+				worker.join();
+		}
+
+		/**
+		 * @brief Stops all the io_contexts, abandoning the pending handlers.
+		 * @threadsafe Safe to be called from multiple threads.
+		 */
+		void stop() noexcept {
+			for (auto &ctx : _contexts)
+				ctx->stop();
+		}
+
+	 private:
+		static size_t default_threads() noexcept {
+			const unsigned int cores = std::thread::hardware_concurrency();
+			return cores ? cores : 1;
+		}
+
+		runtime_mode _mode;
+		size_t _threads;
+		std::vector<std::unique_ptr<asio::io_context>> _contexts;
+	};
+}
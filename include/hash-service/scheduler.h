@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace hs {
+	/**
+	 * @brief Scheduling class of a session, see `scheduling_policy`.
+	 */
+	enum class session_class
+	{
+		// short requests, the larger quantum
+		latency,
+		// long lines, the smaller quantum
+		bulk
+	};
+
+	/**
+	 * @brief How the sessions of a port are classified.
+	 */
+	enum class class_mode
+	{
+		latency,
+		bulk,
+		// bulk while the current line is longer than `scheduling_policy::bulk_line`, latency otherwise
+		adaptive
+	};
+
+	/**
+	 * @return the mode by its name: `latency`, `bulk` or `adaptive`, `std::nullopt` if unknown.
+	 */
+	inline std::optional<class_mode> parse_class_mode(std::string_view name) noexcept {
+		if (name == "latency")
+			return class_mode::latency;
+		if (name == "bulk")
+			return class_mode::bulk;
+		if (name == "adaptive")
+			return class_mode::adaptive;
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief Fair sharing of the I/O threads between the sessions.
+	 *
+	 * Every encoding turn of a session is granted the quantum of its class. The session yields to the other
+	 * sessions of its thread once it has consumed the quantum, or once the time budget has passed, and resumes
+	 * with its next turn. The sessions waiting to run are served in the FIFO order of the `io_context`:
+	 * together with the per-session deficit, this is a deficit round-robin. Unused quanta are not accumulated:
+	 * the deficit is reset once a session has consumed all its received bytes.
+	 *
+	 * Only the bytes hashed on the I/O thread are counted, the chunks handed to the compute pool are not.
+	 */
+	struct scheduling_policy
+	{
+		// bytes of a latency turn, `0` disables scheduling
+		size_t quantum = 64 * 1024;
+		// bytes of a bulk turn
+		size_t bulk_quantum = 16 * 1024;
+		// duration of a turn, `0` for no limit. Checked after every chunk hashed on the I/O thread
+		std::chrono::microseconds time_budget{500};
+		class_mode classes = class_mode::adaptive;
+		// bytes of a line after which the adaptive mode classifies its session as bulk
+		uint64_t bulk_line = 64 * 1024;
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_scheduling_policy
+		{
+			constexpr scheduling_policy operator()(const Config&) const noexcept {
+				return scheduling_policy{};
+			}
+		};
+
+		template <typename Config>
+		struct _get_scheduling_policy<Config, std::void_t<decltype(std::declval<Config>().scheduling)>>
+		{
+			constexpr scheduling_policy operator()(const Config& c) const noexcept {
+				return c.scheduling;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static scheduling_policy get_scheduling_policy(const Config &c) noexcept {
+		return detail::_get_scheduling_policy<std::decay_t<Config>>{}(c);
+	}
+
+	/**
+	 * @brief Deficit and deadline of the current turn of a session.
+	 *
+	 * The deficit may go negative when a chunk cannot be split, e.g. a chunk handed to the compute pool:
+	 * the overdraft is paid by the next turn.
+	 */
+	class turn_budget
+	{
+	 public:
+		using clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Starts a turn, granting the quantum.
+		 */
+		void start(size_t quantum, std::chrono::microseconds timeBudget) noexcept {
+			_deficit += int64_t(quantum);
+			_timed = timeBudget.count() != 0;
+			if (_timed)
+				_deadline = clock::now() + timeBudget;
+		}
+
+		void consume(size_t bytes) noexcept {
+			_deficit -= int64_t(bytes);
+		}
+
+		/**
+		 * @brief Ends the turn if its time budget has passed.
+		 */
+		void check_time() noexcept {
+			if (_timed && _deficit > 0 && clock::now() >= _deadline)
+				_deficit = 0;
+		}
+
+		/**
+		 * @return bytes left in the turn.
+		 */
+		[[nodiscard]] size_t remaining() const noexcept {
+			return _deficit > 0 ? size_t(_deficit) : 0;
+		}
+
+		[[nodiscard]] bool exhausted() const noexcept {
+			return _deficit <= 0;
+		}
+
+		/**
+		 * @brief Forgets the unused part of the quantum, once the session has nothing left to consume.
+		 */
+		void idle() noexcept {
+			if (_deficit > 0)
+				_deficit = 0;
+		}
+
+	 private:
+		int64_t _deficit = 0;
+		bool _timed = false;
+		clock::time_point _deadline{};
+	};
+}
@@ -1,59 +1,123 @@
 ﻿#pragma once
 
 #include "hash-service/session.h"
+#include "hash-service/governor.h"
 #include "hash-service/logging.h"
+#include "hash-service/metrics.h"
+#include "hash-service/timing_wheel.h"
 
 #include <asio.hpp>
 
+#include <chrono>
 #include <type_traits>
-#include <algorithm>
+#include <utility>
 
-#include <vector>
+#include <stdexcept>
 
 namespace hs {
 	using asio::ip::tcp;
 
 	namespace detail {
 		template <typename Config, typename = void>
-		struct _get_time_interval
+		struct _get_reuse_port
 		{
-			constexpr std::chrono::milliseconds operator()(const Config&) const noexcept {
-				return std::chrono::seconds(2);
+			constexpr bool operator()(const Config&) const noexcept {
+				return false;
 			}
 		};
 
 		template <typename Config>
-		struct _get_time_interval<Config, std::void_t<decltype(std::declval<Config>().time_interval)>>
+		struct _get_reuse_port<Config, std::void_t<decltype(std::declval<Config>().reuse_port)>>
 		{
-			constexpr std::chrono::milliseconds operator()(const Config& c) const noexcept {
-				return c.time_interval;
+			constexpr bool operator()(const Config& c) const noexcept {
+				return c.reuse_port;
 			}
 		};
+
+#ifdef SO_REUSEPORT
+		/**
+		 * @brief `SO_REUSEPORT` as an asio SettableSocketOption, asio providing none publicly.
+		 */
+		class reuse_port_option
+		{
+		 public:
+			explicit reuse_port_option(bool enabled) noexcept
+				: _value(enabled ? 1 : 0)
+			{}
+
+			template <typename Protocol>
+			int level(const Protocol&) const noexcept {
+				return SOL_SOCKET;
+			}
+
+			template <typename Protocol>
+			int name(const Protocol&) const noexcept {
+				return SO_REUSEPORT;
+			}
+
+			template <typename Protocol>
+			const int *data(const Protocol&) const noexcept {
+				return &_value;
+			}
+
+			template <typename Protocol>
+			size_t size(const Protocol&) const noexcept {
+				return sizeof(_value);
+			}
+
+		 private:
+			int _value;
+		};
+#endif
 	}
 
+	/**
+	 * @return `true` if several acceptors may listen to the same port (SO_REUSEPORT).
+	 */
 	template <typename Config>
-	constexpr static std::chrono::milliseconds get_time_interval(const Config &c) noexcept {
-		return detail::_get_time_interval<std::decay_t<Config>>{}(c);
+	constexpr static bool get_reuse_port(const Config &c) noexcept {
+		return detail::_get_reuse_port<std::decay_t<Config>>{}(c);
 	}
 
 	/**
 	 * @brief TCP hashing server.
 	 *
-	 * Upon instantiation begins asynchronously accepting new tcp connections and
-	 * monitoring their lifetime.
-	 * Stores termination handlers for accepted sessions for graceful termination
-	 * when server::stop() is called.
+	 * Upon instantiation begins asynchronously accepting new tcp connections.
+	 * Accepted sessions link themselves into the server's session registry and unlink upon destruction,
+	 * so that server::stop() can gracefully terminate the live ones.
 	 *
-	 * Periodically disposes of dead termination references.
+	 * Enforces the sessions' timeouts with a timing wheel shared by all the sessions of the server,
+	 * i.e. of an I/O thread in the sharded runtime mode.
+	 *
+	 * @tparam Hasher hash algorithm of the sessions, see `is_hasher`
 	 */
-	class server
+	template <typename Hasher>
+	class basic_server
 	{
+		using session_type = basic_session<Hasher>;
+
 	 public:
 		struct config
 		{
 			uint16_t port;
-			std::chrono::milliseconds connection_timeout;
-			std_ostream_logger logger;
+			timeout_policy timeouts;
+			leveled_logger logger;
+			output_policy output;
+			compute_policy compute;
+			receive_policy receive;
+			// allows a server per io_context to listen to the same port
+			bool reuse_port;
+			// shared by the servers, not recorded if not set
+			hs::metrics *metrics;
+			// long lines are resumable if the store is set and `Hasher` is checkpointable
+			checkpoint_policy checkpoints;
+			// shared by the servers, short lines are not cached if not set
+			digest_cache *digests;
+			wire_protocol protocol;
+			// turns of the sessions sharing an I/O thread, `classes` is the class of the port
+			scheduling_policy scheduling;
+			// shared by the servers, no limits if not set
+			resource_governor *governor;
 		};
 
 		/**
@@ -62,150 +126,194 @@ namespace hs {
 		 * @tparam Config
 		 * @param executor
 		 * @param config
+		 * @throws asio::system_error if failed to listen to the port
+		 * @throws std::runtime_error if `reuse_port` is requested, but not supported by the platform
 		 */
 		template <typename Config>
-		constexpr server(asio::io_context &executor, Config &&config)
-			: _acceptor(executor, tcp::endpoint(tcp::v4(), config.port)),
-			  _connectionTimeout(config.connection_timeout),
-			  _monitoringStrand(executor.get_executor()),
-			  _monitoringInterval(get_time_interval(config)),
-			  _monitoringTimer(executor),
+		constexpr basic_server(asio::io_context &executor, Config &&config)
+			: _acceptor(make_acceptor(executor, config.port, get_reuse_port(config))),
+			  _acceptorStrand(executor.get_executor()),
+			  _timeoutPolicy(get_timeout_policy(config)),
+			  _timeouts(_timeoutPolicy.resolution),
+			  _timeoutStrand(executor.get_executor()),
+			  _timeoutTimer(executor),
+			  _outputPolicy(get_output_policy(config)),
+			  _computePolicy(get_compute_policy(config)),
+			  _receivePolicy(get_receive_policy(config)),
+			  _metrics(get_metrics(config)),
+			  _checkpointPolicy(get_checkpoint_policy(config)),
+			  _digests(get_digest_cache(config)),
+			  _protocol(get_wire_protocol(config)),
+			  _schedulingPolicy(get_scheduling_policy(config)),
+			  _governor(get_resource_governor(config)),
+			  _admissionTimer(executor),
 			  _logger(config.logger)
 		{
-			if(_monitoringInterval < std::chrono::milliseconds(200))
-				_monitoringInterval = std::chrono::milliseconds(200);
-
-			// TODO: configure?
-			_sessionTerminators.reserve(256);
-
-			_logger.message(std::string("listening to port: ") + std::to_string(_acceptor.local_endpoint().port()));
-			start_monitoring();
+			_logger.message("listening to port: ", _acceptor.local_endpoint().port());
+			if (_timeoutPolicy.idle.count() || _timeoutPolicy.line.count() || _timeoutPolicy.write.count())
+				asio::post(_timeoutStrand, [this]{ sweep_timeouts(); });
 			accepting();
 		}
 
-		server(const server&) = delete;
-		server(server &&) = delete;
-		server& operator=(const server&) = delete;
-		server& operator=(server&&) = delete;
+		basic_server(const basic_server&) = delete;
+		basic_server(basic_server &&) = delete;
+		basic_server& operator=(const basic_server&) = delete;
+		basic_server& operator=(basic_server&&) = delete;
 
 		/**
 		 * Stops all operations.
 		 * All the outstanding tcp connections are gracefully shutdown.
-		 * Removes all the termination handlers.
+		 * The server must outlive its sessions.
 		 */
 		void stop() {
-			const auto func_name = std::string("server::") + __func__ + "(): ";
+			const char *func_name = __func__;
 
-			asio::post(_acceptor.get_executor(), [func_name, this]{
-			  _logger.message(func_name + "terminating all connections");
+			asio::post(_acceptorStrand, [func_name, this]{
+			  _logger.message("server::", func_name, "(): terminating all connections");
 
+			  _stopped = true;
+			  _admissionTimer.cancel();
 			  asio::error_code errorCode{};
 			  _acceptor.cancel(errorCode);
 
 			  if (errorCode != asio::error_code())
-				  _logger.error(func_name + "error: " + errorCode.message());
-			});
-
-			asio::post(_monitoringStrand, [func_name, this]{
-			  _logger.message(func_name + "stopping monitoring timer");
-
-			  asio::error_code errorCode{};
-			  _monitoringTimer.cancel(errorCode);
-			  if (errorCode != asio::error_code())
-				  _logger.error(func_name + "error: " + errorCode.message());
+				  _logger.error("server::", func_name, "(): error: ", errorCode);
 
-			  if (!errorCode)
-				  asio::post(_monitoringStrand, [this]{terminate_all_sessions();});
+			  session_type::terminate_all(_sessions);
+			});
 
-			  if (errorCode != asio::error_code())
-				  _logger.error(std::string("server::stop() error: ") + errorCode.message());
+			asio::post(_timeoutStrand, [this]{
+			  _timeoutsStopped = true;
+			  _timeoutTimer.cancel();
 			});
 		}
 
 	 private:
+		static tcp::acceptor make_acceptor(asio::io_context &executor, uint16_t port, bool reusePort) {
+			const tcp::endpoint endpoint(tcp::v4(), port);
+			tcp::acceptor acceptor(executor);
+			acceptor.open(endpoint.protocol());
+			acceptor.set_option(tcp::acceptor::reuse_address(true));
+			if (reusePort)
+			{
+#ifdef SO_REUSEPORT
+				acceptor.set_option(detail::reuse_port_option(true));
+#else
+				throw std::runtime_error("SO_REUSEPORT is not supported");
+#endif
+			}
+			acceptor.bind(endpoint);
+			acceptor.listen();
+			return acceptor;
+		}
+
 		void accepting() noexcept {
-			const auto func_name = std::string("server::") + __func__ + ": ";
-			_acceptor.async_accept(
+			const char *func_name = __func__;
+			if (_governor && !_governor->admitting())
+			{
+				admission_paused();
+				return;
+			}
+
+			_admissionPaused = false;
+			_acceptor.async_accept(asio::bind_executor(_acceptorStrand,
 				[this, func_name](asio::error_code err, tcp::socket socket) mutable {
-				  if (!err){
-					  using config = hs::session::config;
-					  auto &&term = hs::session::start(std::move(socket), config{_connectionTimeout, _logger});
-					  asio::post(_monitoringStrand, [this, term = std::move(term)] () mutable {
-						register_session(std::move(term));
-					  });
+				  // completed before being cancelled by stop()
+				  if (_stopped)
+					  return;
 
+				  if (!err){
+					  trace(trace_event::accepted, 0);
+					  using config = typename session_type::config;
+					  _timeouts.add(session_type::start(std::move(socket), config{_timeoutPolicy, &_timeouts.clock(), _logger,
+																				  _outputPolicy, _computePolicy, _receivePolicy,
+																				  &_sessions, _metrics, _checkpointPolicy,
+																				  _digests, _protocol, _schedulingPolicy,
+																				  _governor}));
 					  accepting();
 					  return;
 				  }
 
 				  if (err == asio::error::operation_aborted)
-				  {
-					  asio::post(_monitoringStrand, [this]{_monitoringTimer.cancel();});
 					  return;
-				  }
 
-				  _logger.error(func_name + "error: " + err.message());
+				  _logger.error("server::", func_name, ": error: ", err);
 				  accepting();
-				});
+				}));
 		}
 
-		void start_monitoring() {
-			const auto func_name = std::string("server::") + __func__ + ": ";
-
-			asio::error_code errorCode{};
-			_monitoringTimer.expires_at(std::chrono::steady_clock::now() + _monitoringInterval, errorCode);
-			if (errorCode != asio::error_code())
+		/**
+		 * @brief Polls the governor every `admission_retry` until a session may be accepted.
+		 * Pending connections wait in the listen backlog meanwhile. Runs on `_acceptorStrand`.
+		 */
+		void admission_paused() noexcept {
+			const char *func_name = __func__;
+			if (!std::exchange(_admissionPaused, true))
 			{
-				_logger.error(func_name + "critical error: failed to set up timer: " +
-					errorCode.message() + ", terminating...");
-				stop();
-				return;
+				_logger.warning("server::", func_name, ": session limit reached, accepting paused");
+				if (_metrics)
+					_metrics->add(counter::session_limit_hits);
 			}
 
-			_monitoringTimer.async_wait([this, func_name](asio::error_code err){
-			  if (!err) {
-				  asio::post(_monitoringStrand, [this] {remove_dead_sessions(); });
-				  return;
-			  }
-
-			  if (err == asio::error::operation_aborted)
-			  {
+			_admissionTimer.expires_after(admission_retry);
+			_admissionTimer.async_wait(asio::bind_executor(_acceptorStrand, [this, func_name](asio::error_code err){
+			  if (_stopped || err == asio::error::operation_aborted)
 				  return;
-			  }
-
-			  _logger.error(func_name + "error: " + err.message());
-			  asio::post(_monitoringStrand, [this]{start_monitoring();});
-			});
+			  if (err)
+				  _logger.error("server::", func_name, ": error: ", err);
+			  accepting();
+			}));
 		}
 
-		void remove_dead_sessions() {
-			auto iRemove = std::remove_if(std::begin(_sessionTerminators), std::end(_sessionTerminators),
-				[](const auto &s) noexcept -> bool {
-				  return !s.is_alive();
-				});
-			_sessionTerminators.erase(iRemove, std::end(_sessionTerminators));
-			asio::post(_monitoringStrand, [this]{start_monitoring();});
-		}
+		/**
+		 * @brief Advances the timing wheel every `timeout_policy::resolution`, terminating the expired sessions.
+		 * Runs on `_timeoutStrand`.
+		 */
+		void sweep_timeouts() {
+			const char *func_name = __func__;
+			if (_timeoutsStopped)
+				return;
 
-		void register_session(hs::session::termination &&session) {
-			_sessionTerminators.push_back(std::move(session));
-		}
+			_timeouts.advance([](auto &term, timeout_kind kind) noexcept { term.expire(kind); });
 
-		void terminate_all_sessions() {
-			for (auto &term : _sessionTerminators)
-				term();
+			_timeoutTimer.expires_after(_timeouts.clock().resolution());
+			_timeoutTimer.async_wait(asio::bind_executor(_timeoutStrand, [this, func_name](asio::error_code err){
+			  if (err == asio::error::operation_aborted)
+				  return;
+			  if (err)
+				  _logger.error("server::", func_name, ": error: ", err);
+			  sweep_timeouts();
+			}));
 		}
 
 	 private:
 		tcp::acceptor _acceptor;
-
-		std::chrono::milliseconds _connectionTimeout;
-
-		// strand to serialize actions on adding new and removing dead sessions
-		asio::strand<asio::io_service::executor_type> _monitoringStrand;
-		std::chrono::milliseconds _monitoringInterval;
-		asio::steady_timer _monitoringTimer;
-		std::vector<hs::session::termination> _sessionTerminators;
-		std_ostream_logger _logger;
+		// serializes accepting with stop()
+		asio::strand<asio::io_context::executor_type> _acceptorStrand;
+		bool _stopped = false;
+
+		timeout_policy _timeoutPolicy;
+		timing_wheel<typename session_type::termination> _timeouts;
+		// serializes sweeping with stop()
+		asio::strand<asio::io_context::executor_type> _timeoutStrand;
+		asio::steady_timer _timeoutTimer;
+		bool _timeoutsStopped = false;
+		output_policy _outputPolicy;
+		compute_policy _computePolicy;
+		receive_policy _receivePolicy;
+
+		typename session_type::registry _sessions;
+		metrics *_metrics;
+		checkpoint_policy _checkpointPolicy;
+		digest_cache *_digests;
+		wire_protocol _protocol;
+		scheduling_policy _schedulingPolicy;
+		resource_governor *_governor;
+		constexpr static std::chrono::milliseconds admission_retry{10};
+		asio::steady_timer _admissionTimer;
+		bool _admissionPaused = false;
+		leveled_logger _logger;
 	};
+
+	using server = basic_server<sha256_hash>;
 }
\ No newline at end of file
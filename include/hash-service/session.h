@@ -1,30 +1,68 @@
 ﻿#pragma once
 
+#include "hash-service/buffer.h"
+#include "hash-service/checkpoint.h"
+#include "hash-service/compute.h"
+#include "hash-service/digest_cache.h"
+#include "hash-service/frame.h"
+#include "hash-service/governor.h"
 #include "hash-service/hash.h"
+#include "hash-service/hex.h"
 #include "hash-service/logging.h"
+#include "hash-service/metrics.h"
+#include "hash-service/output.h"
+#include "hash-service/pool.h"
+#include "hash-service/registry.h"
+#include "hash-service/scheduler.h"
+#include "hash-service/sha256.h"
+#include "hash-service/sha256_batch.h"
+#include "hash-service/timing_wheel.h"
+#include "hash-service/trace.h"
+#include "hash-service/tree_hash.h"
 
 #include <asio.hpp>
 
 #include <cstddef>
 #include <cstdint>
+#include <algorithm>
 #include <memory>
+#include <new>
+#include <optional>
+#include <charconv>
+#include <initializer_list>
+#include <string_view>
 #include <utility>
 #include <chrono>
 
 #include <array>
+#include <deque>
+#include <vector>
 
 namespace hs {
 	namespace detail {
-		template <typename T, typename ... Ts, size_t ... I>
-		constexpr static auto append(std::index_sequence<I...>, std::array<T, sizeof...(I)> to, Ts... vals) {
-			constexpr size_t N = sizeof...(I) + sizeof...(Ts);
-			return std::array<T, N>{to[I]..., T(vals)...};
-		}
+		template <typename Config, typename = void>
+		struct _get_session_registry
+		{
+			constexpr std::nullptr_t operator()(const Config&) const noexcept {
+				return nullptr;
+			}
+		};
 
-		template <size_t N, typename T, typename ... Ts>
-		constexpr static auto append(std::array<T, N> to, Ts ... vals) noexcept {
-			return append(std::make_index_sequence<N>(), to, vals...);
-		}
+		template <typename Config>
+		struct _get_session_registry<Config, std::void_t<decltype(std::declval<Config>().sessions)>>
+		{
+			constexpr auto operator()(const Config& c) const noexcept {
+				return c.sessions;
+			}
+		};
+	}
+
+	/**
+	 * @return registry the session links itself into, `nullptr` if not set.
+	 */
+	template <typename Config>
+	constexpr static auto get_session_registry(const Config &c) noexcept {
+		return detail::_get_session_registry<std::decay_t<Config>>{}(c);
 	}
 
 	using tcp = asio::ip::tcp;
@@ -34,19 +72,62 @@ namespace hs {
 	 *
 	 * Implements asynchronous state-machine that receives '\n'-terminated
 	 * lines of ASCII characters and responds with an '\n'-terminated line containing
-	 * the calculated hash (sha256) in a hex format.
+	 * the calculated hash in a hex format.
+	 *
+	 * With a checkpointable Hasher and a `checkpoint_store`, long lines are resumable across connections.
+	 * Every `checkpoint_policy::interval` bytes of a line, the session stores the hash state and responds with
+	 * a `#checkpoint <token> <offset>` line. The first line of a later connection may be
+	 * `#resume <token> <offset>`: the session restores the state, responds with `#resumed <token> <offset>`
+	 * and the following bytes continue the line. An unknown token or offset is responded with `#error <reason>`
+	 * and the connection goes on from a new line. Hex lines never start with '#'.
+	 *
+	 * With `wire_protocol::binary`, requests are length-prefixed frames and responses are raw digests,
+	 * see `frame_reader`. Lines are neither checkpointed nor cached in that mode.
+	 *
+	 * With a `resource_governor`, the session stops receiving while the server is over its memory budget.
+	 *
+	 * Sessions sharing an I/O thread take turns: Encoding yields once the session has consumed the quantum
+	 * of its class or its time budget, see `scheduling_policy`.
+	 *
+	 * @tparam Hasher hash algorithm, see `is_hasher`
 	 */
-	class session
+	template <typename Hasher>
+	class basic_session
 	{
+		static_assert(is_hasher_v<Hasher>, "Hasher must satisfy hs::is_hasher");
+
+		struct context;
+		using digest = std::array<uint8_t, Hasher::digest_length>;
+
 	 public:
+		/**
+		 * Registry of live sessions, see `terminate_all()`.
+		 */
+		using registry = session_registry<context>;
 
 		/**
 		 * Default configuration type.
 		 */
 		struct config
 		{
-			std::chrono::microseconds timeout;
-			std_ostream_logger logger;
+			timeout_policy timeouts;
+			// clock of the timing wheel enforcing the timeouts, timeouts are not tracked if not set
+			const coarse_clock *clock;
+			leveled_logger logger;
+			output_policy output;
+			compute_policy compute;
+			receive_policy receive;
+			// the session is linked into the registry for its lifetime, if set
+			registry *sessions;
+			// the session records its traffic and timings, if set
+			hs::metrics *metrics;
+			checkpoint_policy checkpoints;
+			// short lines are answered from the cache, if set and `Hasher` is batchable
+			digest_cache *digests;
+			wire_protocol protocol;
+			scheduling_policy scheduling;
+			// server-wide limits, not enforced if not set
+			resource_governor *governor;
 		};
 
 		class termination;
@@ -65,14 +146,21 @@ namespace hs {
 		template <typename Config>
 		static termination start(tcp::socket &&socket, Config &&conf) noexcept;
 
-	 private:
-		session() = default;
+		/**
+		 * @brief Terminates all the sessions of the registry.
+		 * @threadsafe Safe to be called from multiple threads.
+		 */
+		static void terminate_all(const registry &sessions) noexcept;
 
-		struct context;
+	 private:
+		basic_session() = default;
 
 		/**
 		 * @brief Receiving state.
-		 * Asynchronously receives data, that potentially containing a '\n' terminated line.
+		 * Asynchronously waits for the socket to become readable without holding a buffer,
+		 * then borrows one from the `buffer_pool` and reads data, that potentially containing a '\n' terminated line.
+		 * With io_uring, borrows the buffer upfront and receives into it: the ring completes the receive itself,
+		 * whereas a readiness wait would cost a poll and a `recvmsg` outside of the ring.
 		 * Transitions to Encoding upon receiving.
 		 *
 		 * The session will be terminated in cases, if:
@@ -84,10 +172,39 @@ namespace hs {
 		 */
 		static void receiving(std::shared_ptr<context> ctx) noexcept;
 
+		/**
+		 * Completes a receive of `bytesReceived` bytes into `buffer`, transitioning to Encoding.
+		 * @param ctx
+		 */
+		static void received(std::shared_ptr<context> ctx, asio::error_code err, size_t bytesReceived) noexcept;
+
+		/**
+		 * Waiting for budget state.
+		 * Receiving is paused while the `resource_governor` is over its memory budget, without holding a buffer.
+		 * Transitions to Receiving once the governor resumes the session.
+		 *
+		 * The session will be terminated in cases, if:
+		 * - operation has been cancelled
+		 * @param ctx
+		 */
+		static void waiting_for_budget(std::shared_ptr<context> ctx) noexcept;
+
 		/**
 		 * Encoding state.
-		 * Asynchronously encodes bytes from the buffer. If the line is complete, transitions to Responding.
-		 * If no complete lines are available in the buffer, transitions to Receiving.
+		 * Encodes all the received bytes in a single pass: every complete line is hashed and its hex line is
+		 * queued for output, the remainder of an incomplete line is fed to the hash.
+		 * Short lines that are entirely within the buffer are hashed by `sha256_messages()`: side by side,
+		 * or one by one with the SHA instructions for the lines short of a full group.
+		 * Chunks of a line longer than `compute_policy::threshold` are hashed by the compute pool, see Hashing:
+		 * a chunk ending the line suspends Encoding until it has been hashed, the trailing chunk of a buffer
+		 * takes the buffer along, so that the next one is received meanwhile.
+		 * Queued lines are flushed according to the session's `flush_policy`.
+		 * Every call is a turn of the session: once the turn's quantum or time budget has been consumed,
+		 * the rest of the buffer is left to the next turn, see Yielding.
+		 * Returns the receive buffer to the pool once it has been consumed.
+		 * Transitions to Receiving, unless the output queue exceeds `output_policy::max_pending`
+		 * or `compute_policy::max_in_flight` buffers are being hashed.
+		 * In that case receiving is resumed by Responding or Hashing once under the limits.
 		 *
 		 * The session will be terminated in cases, if:
 		 * - an internal error has occurred
@@ -95,10 +212,101 @@ namespace hs {
 		 */
 		static void encoding(std::shared_ptr<context> ctx) noexcept;
 
+		/**
+		 * Yielding state.
+		 * Queues the lines hashed by the turn, then posts the next turn of Encoding behind the handlers
+		 * that are ready on the strand's thread, e.g. the turns of the other sessions.
+		 * @param ctx
+		 */
+		static void yielding(std::shared_ptr<context> ctx) noexcept;
+
+		/**
+		 * @return scheduling class of the session, see `class_mode`.
+		 */
+		static session_class class_of(const context &ctx) noexcept;
+
+		/**
+		 * Hashing state.
+		 * Runs concurrently with Receiving and Encoding.
+		 * Hashes chunks of a long line on the compute pool one after another, leaving the I/O thread to other sessions.
+		 * A chunk owning its buffer is hashed while the session receives the next one: receiving and hashing of
+		 * a streamed line overlap with up to `compute_policy::max_in_flight` buffers being hashed.
+		 * A chunk within the session's receive buffer transitions to Encoding once hashed.
+		 *
+		 * The session will be terminated in cases, if:
+		 * - an internal error has occurred
+		 * @param ctx
+		 * @param chunk chunk of the current line
+		 * @param lineComplete `true` if the chunk ends the line
+		 * @param storage buffer of the chunk, empty if the chunk refers to the session's receive buffer
+		 */
+		static void hashing(std::shared_ptr<context> ctx, std::string_view chunk, bool lineComplete,
+							pooled_buffer &&storage) noexcept;
+
+		/**
+		 * Hashes the first queued chunk on the compute pool.
+		 * @param ctx
+		 */
+		static void hash_next(std::shared_ptr<context> ctx) noexcept;
+
+		/**
+		 * @return `true` if the session may receive: the output queue and the buffers being hashed are under the limits.
+		 */
+		static bool can_receive(const context &ctx) noexcept;
+
+		/**
+		 * Accounts for the bytes of the output queue to the governor and the metrics.
+		 * Resumes the sessions paused by the governor if the bytes have decreased.
+		 * @param ctx
+		 */
+		static void account_output(context &ctx) noexcept;
+
+		/**
+		 * Consumes the next request chunk of the receive buffer: a line chunk with the text protocol,
+		 * a message chunk with the binary protocol.
+		 * @param limit bytes to consume at most
+		 * @return the chunk, `std::nullopt` if the rest of the buffer is a part of a binary request's header
+		 * or the header is malformed.
+		 */
+		static std::optional<line_chunk> next_request(context &ctx, size_t limit) noexcept;
+
+		/**
+		 * Accounts for a hashed chunk of the current line. If the line is complete,
+		 * finalizes the hash and queues the hex line.
+		 * @param ctx
+		 * @param oneShot digest of the complete line if it has been hashed at once, the hash is not finalized
+		 * @return `false` if an internal error has occurred.
+		 */
+		static bool chunk_hashed(const std::shared_ptr<context> &ctx, size_t chunkSize, bool lineComplete,
+								 const digest *oneShot = nullptr) noexcept;
+
+		/**
+		 * Stores a checkpoint of the current line if due, and queues its `#checkpoint` line.
+		 * @param ctx
+		 */
+		static void checkpoint_line(const std::shared_ptr<context> &ctx) noexcept;
+
+		/**
+		 * Writes and removes the checkpoint files due, on the compute pool if set, see `checkpoint_store::flush()`.
+		 * @param ctx
+		 */
+		static void write_checkpoint_files(const std::shared_ptr<context> &ctx) noexcept;
+
+		/**
+		 * Handles the `#resume <token> <offset>` request, that the first line of a checkpointed session may be.
+		 * Bytes that may belong to the request are held back until the request is complete
+		 * or turns out to be the beginning of an ordinary line.
+		 * @param ctx
+		 * @return `true` if the chunk has been consumed by the request.
+		 */
+		static bool resuming(const std::shared_ptr<context> &ctx, std::string_view chunk, bool lineComplete) noexcept;
+
 		/**
 		 * Responding state.
-		 * Asynchronously sends the hashed hex '\n'-terminated line.
-		 * If the buffer contains pending bytes, transitions to Encoding. Otherwise transitions to receiving.
+		 * Runs concurrently with Receiving and Encoding.
+		 * Asynchronously sends all the queued hex '\n'-terminated lines with a single write.
+		 * No-op if a write is already in flight or nothing is queued: lines queued during the write
+		 * are sent upon its completion.
 		 *
 		 * The session will be terminated in cases, if:
 		 * - a timeout has occurred
@@ -108,8 +316,40 @@ namespace hs {
 		 * @param ctx
 		 */
 		static void responding(std::shared_ptr<context> ctx) noexcept;
+
+		/**
+		 * Encodes the digests as hex lines straight into the output queue, flushing them if the flush policy requires.
+		 * With the binary protocol, queues the raw digests, each preceded by the id of its request, if any.
+		 * @param ctx
+		 * @param ids ids of the requests, `nullptr` if none has an id
+		 */
+		template <size_t N>
+		static void queue_responses(const std::shared_ptr<context> &ctx, const std::array<uint8_t, N> *digests,
+									size_t count, const request_id *ids = nullptr) noexcept;
+
+		/**
+		 * Queues a '#'-prefixed protocol line made of the space-separated words, see `checkpoint_line()`.
+		 * @param ctx
+		 */
+		static void queue_notice(const std::shared_ptr<context> &ctx, std::initializer_list<std::string_view> words) noexcept;
+
+		/**
+		 * Flushes the queued lines if the flush policy requires.
+		 * @param ctx
+		 * @param wasEmpty `true` if nothing had been staged before the lines
+		 */
+		static void flush_queued(const std::shared_ptr<context> &ctx, bool wasEmpty) noexcept;
+
+		/**
+		 * Hashes the collected short lines with `sha256_messages()` and queues their hex lines in order.
+		 * With a `digest_cache`, the hex lines of the cached lines are copied from it and only the misses are hashed.
+		 * @param ctx
+		 */
+		static void hash_batch(const std::shared_ptr<context> &ctx) noexcept;
 	};
 
+	using session = basic_session<sha256_hash>;
+
 	/**
 	 * Private session context. Not a part of the public API.
 	 * Session owns the context exclusively.
@@ -117,42 +357,179 @@ namespace hs {
 	 * Context's lifetime starts upon receiving a tcp connection and ends upon disconnection.
 	 *
 	 * An object of the context may be weak-referenced in order to track the lifetime.
+	 * The context is linked into the session registry, if any, from start till destruction.
 	 */
-	struct session::context : std::enable_shared_from_this<context>
+	template <typename Hasher>
+	struct basic_session<Hasher>::context : std::enable_shared_from_this<context>, registry_hook
 	{
-		constexpr static size_t buffer_size = 2048;
-
 		tcp::socket socket;
 		asio::strand<tcp::socket::executor_type> socketStrand;
 
-		// TODO: wrapper for the string buffer
-		std::array<uint8_t, buffer_size> stringBuffer{};
-		size_t pendingBytes = 0;
+		// borrowed from the buffer pool from a read until it has been consumed
+		pooled_line_buffer buffer;
+		wire_protocol protocol;
+		// binary requests, see `frame_reader`
+		frame_reader frames;
+		// `hash` contains the beginning of the current line
+		bool lineInProgress = false;
+		// bytes of the current line fed to `hash`
+		uint64_t lineBytes = 0;
+		compute_policy computePolicy;
+		scheduling_policy schedulingPolicy;
+		// deficit of the session's turns
+		turn_budget turn;
+
+		// chunks of the current line queued for the compute pool, the first one is being hashed
+		struct hash_job
+		{
+			std::string_view chunk;
+			bool lineComplete;
+			// empty if the chunk refers to `buffer`
+			pooled_buffer storage;
+		};
+		std::deque<hash_job> hashJobs;
+		// jobs owning their storage
+		size_t buffersHashing = 0;
+
+		// complete lines of the current receive, that are short enough to be hashed side by side
+		constexpr static bool batchable = std::is_same_v<Hasher, sha256_hash> ||
+			std::is_same_v<Hasher, sha256_resumable_hash>;
+		constexpr static size_t batch_line_limit = 512;
+		std::vector<std::string_view> batchLines;
+		// ids of the batch lines, binary protocol only
+		std::vector<request_id> batchIds;
+		std::vector<sha256_batch::digest> batchDigests;
+		// responses of the cached lines are copied from the cache, only the misses are hashed
+		digest_cache *digests;
+		// positions of the batch lines missed in the cache
+		std::vector<size_t> batchMisses;
+
+		// timestamps read by the timing wheel, see `termination::deadline()`
+		session_activity activity;
+
+		constexpr static size_t hex_buffer_sz = Hasher::digest_length * 2 + 1;
+		output_queue output;
+		// hex lines staged and being written, protocol lines are not counted
+		size_t stagedLines = 0,
+			writingLines = 0;
+		output_policy outputPolicy;
+		asio::steady_timer flushTimer;
+		bool flushTimerArmed = false;
+		// set by Encoding when the output queue is full or too many buffers are being hashed,
+		// Responding and Hashing resume receiving
+		bool receivingPaused = false;
+		// server-wide limits, see `resource_governor`
+		resource_governor *governor;
+		// bytes of `output` accounted to the governor and the metrics
+		size_t outputAccounted = 0;
+		// pending while receiving is paused by the governor's budget, cancelled to resume
+		asio::steady_timer budgetTimer;
+		bool budgetGranted = false;
+
+		Hasher hash;
+		checkpoint_policy checkpointPolicy;
+		constexpr static size_t max_resume_request = 128;
+		// `true` if long lines are checkpointed and resumable
+		bool checkpointed;
+		// resume token of the current line, empty until its first checkpoint
+		std::string lineToken;
+		uint64_t nextCheckpoint;
+		// the first line of the connection, held back while it may be a `#resume` request
+		std::array<char, max_resume_request> resumeRequest{};
+		size_t resumeRequestSize = 0;
+		bool resumeChecked;
 
-		constexpr static size_t hex_buffer_sz = sha256_hash::digest_length * 2 + 1;
-		std::array<uint8_t, hex_buffer_sz> hexBuffer{};
-		sha256_hash hash;
-		std_ostream_logger logger;
+		leveled_logger logger;
+		registry *sessions;
+
+		hs::metrics *metrics;
+		// timestamps of the state transitions, maintained only if `metrics` is set
+		std::chrono::steady_clock::time_point receiveStarted{};
+		std::chrono::steady_clock::time_point receivedAt{};
+		std::chrono::steady_clock::time_point lineStartedAt{};
+		std::chrono::steady_clock::time_point writeStarted{};
+		// id of the session's spans in the trace, see `trace_session_id()`
+		const uint64_t traceId = trace_session_id();
+
+		context(const context&) = delete;
+		context& operator=(const context&) = delete;
+
+		~context() {
+			trace(trace_event::closed, traceId);
+			if (sessions)
+				sessions->unlink(*this);
+
+			if (metrics)
+			{
+				metrics->add(counter::sessions_closed);
+				metrics->add(gauge::active_sessions, -1);
+				metrics->add(gauge::line_backlog, -int64_t(stagedLines));
+				metrics->add(gauge::output_bytes, -int64_t(outputAccounted));
+			}
+
+			if (governor)
+			{
+				governor->add_output(-int64_t(outputAccounted));
+				governor->session_closed();
+				governor->relieved();
+			}
+		}
 
 		std::weak_ptr<context> weak_ref() {
-			return weak_from_this();
+			return this->weak_from_this();
 		}
 
 		template <typename Config>
 		[[nodiscard]] static std::shared_ptr<context> create(tcp::socket &&socket,
-																sha256_hash &&hash,
+																Hasher &&hash,
 																Config &&conf) noexcept {
-			return std::shared_ptr<context>(new context(std::move(socket), std::move(hash), std::forward<Config>(conf)));
+			return std::allocate_shared<context>(pool_allocator<context>(), passkey(), std::move(socket), std::move(hash),
+												 std::forward<Config>(conf));
 		}
 
 	 private:
+		// restricts construction to `create()`, while allowing `std::allocate_shared`
+		struct passkey
+		{
+			explicit passkey() = default;
+		};
+
+	 public:
 		template <typename Config>
-		context(tcp::socket &&socket, sha256_hash &&hash, Config &&conf)
+		context(passkey, tcp::socket &&socket, Hasher &&hash, Config &&conf)
 			: socket(std::move(socket)),
 			socketStrand(socket.get_executor()),
+			buffer(get_receive_policy(conf)),
+			protocol(get_wire_protocol(conf)),
+			computePolicy(get_compute_policy(conf)),
+			schedulingPolicy(get_scheduling_policy(conf)),
+			digests(batchable && protocol == wire_protocol::text ? get_digest_cache(conf) : nullptr),
+			activity(get_coarse_clock(conf), get_timeout_policy(conf)),
+			output(hex_buffer_sz),
+			outputPolicy(get_output_policy(conf)),
+			flushTimer(socket.get_executor()),
+			governor(get_resource_governor(conf)),
+			budgetTimer(socket.get_executor()),
 			hash(std::move(hash)),
-			logger(conf.logger)
-		{}
+			checkpointPolicy(get_checkpoint_policy(conf)),
+			checkpointed(is_checkpointable_v<Hasher> && protocol == wire_protocol::text && checkpointPolicy.store &&
+						 checkpointPolicy.interval),
+			nextCheckpoint(checkpointPolicy.interval),
+			resumeChecked(!checkpointed),
+			logger(conf.logger),
+			sessions(get_session_registry(conf)),
+			metrics(get_metrics(conf))
+		{
+			if constexpr (is_parallel_v<Hasher>)
+				hash.set_pool(computePolicy.pool);
+			if (governor)
+				governor->session_opened();
+			if (metrics)
+			{
+				metrics->add(counter::sessions_accepted);
+				metrics->add(gauge::active_sessions, 1);
+			}
+		}
 	};
 
 	/**
@@ -162,10 +539,11 @@ namespace hs {
 	 *
 	 * Primarily used for graceful shutdown.
 	 */
-	class session::termination
+	template <typename Hasher>
+	class basic_session<Hasher>::termination
 	{
 	 public:
-		explicit termination(std::weak_ptr<session::context> &&context) noexcept
+		explicit termination(std::weak_ptr<context> &&context) noexcept
 			: _context(std::move(context))
 		{}
 
@@ -177,6 +555,29 @@ namespace hs {
 			return !_context.expired();
 		}
 
+		/**
+		 * @brief Timing wheel handle interface.
+		 * @threadsafe Safe to be called from multiple threads.
+		 * @return the session's earliest timeout, `std::nullopt` if the session has been destroyed
+		 * or its timeouts are not tracked.
+		 */
+		[[nodiscard]] std::optional<std::pair<coarse_clock::tick_type, timeout_kind>> deadline() const noexcept {
+			const auto ctx = _context.lock();
+			if (!ctx)
+				return std::nullopt;
+			return ctx->activity.deadline();
+		}
+
+		/**
+		 * @brief Terminates the session due to a timeout.
+		 * @threadsafe Safe to be called from multiple threads
+		 */
+		void expire(timeout_kind kind) noexcept {
+			if (auto ctx = _context.lock())
+				ctx->logger.message("session: ", to_string(kind), " timeout");
+			(*this)();
+		}
+
 		/**
 		 * @brief Terminates the session. No-op if the session has been destroyed.
 		 * @threadsafe Safe to be called from multiple threads
@@ -186,161 +587,935 @@ namespace hs {
 			if (!ctx)
 				return;
 
-			asio::post(ctx->socketStrand, [ctx]{
+			auto &strand = ctx->socketStrand;
+			asio::post(strand, bind_pool_allocator([ctx = std::move(ctx)]{
+			  ctx->flushTimer.cancel();
+			  ctx->budgetTimer.cancel();
 			  ctx->socket.cancel();
 			  asio::error_code errorCode{};
 			  ctx->socket.shutdown(asio::socket_base::shutdown_both, errorCode);
 			  if (errorCode != asio::error_code())
-				  ctx->logger.error(std::string("session::termination() error: ") + errorCode.message());
-			});
+				  ctx->logger.error("session::termination() error: ", errorCode);
+			}));
 		}
 
 	 private:
-		std::weak_ptr<session::context> _context;
+		std::weak_ptr<context> _context;
 	};
 
-	void session::receiving(std::shared_ptr<context> ctx) noexcept
+	template <typename Hasher>
+	void basic_session<Hasher>::receiving(std::shared_ptr<context> ctx) noexcept
 	{
-		const auto func_name = std::string("session::") + __func__;
+		const char *func_name = __func__;
+
+		if (ctx->metrics)
+			ctx->receiveStarted = std::chrono::steady_clock::now();
 
 		tcp::socket &socket = ctx->socket;
-		auto &buffer = ctx->stringBuffer;
+		auto &strand = ctx->socketStrand;
+
+#if defined(ASIO_HAS_IO_URING) && defined(ASIO_DISABLE_EPOLL)
+		if (ctx->governor && ctx->governor->over_budget())
+		{
+			basic_session::waiting_for_budget(std::move(ctx));
+			return;
+		}
 
-		socket.async_receive(asio::buffer(buffer),
-			[ctx, func_name](asio::error_code err, size_t bytesReceived) {
+		auto &buffer = ctx->buffer;
+		try
+		{
+			buffer.acquire();
+		}
+		catch (const std::bad_alloc&)
+		{
+			ctx->logger.error("session::", func_name, " error: failed to allocate the receive buffer");
+			return;
+		}
+
+		trace(trace_event::receive_begin, ctx->traceId);
+		socket.async_read_some(asio::buffer(buffer.data(), buffer.capacity()), asio::bind_executor(strand,
+			bind_pool_allocator([ctx = std::move(ctx)](asio::error_code err, size_t bytesReceived) mutable {
+			trace(trace_event::receive_end, ctx->traceId);
+			basic_session::received(std::move(ctx), err, bytesReceived);
+		})));
+#else
+		trace(trace_event::receive_begin, ctx->traceId);
+		socket.async_wait(tcp::socket::wait_read, asio::bind_executor(strand, bind_pool_allocator(
+			[ctx = std::move(ctx), func_name](asio::error_code err) mutable {
+			trace(trace_event::receive_end, ctx->traceId);
+			size_t bytesReceived = 0;
 			if (!err)
 			{
-				ctx->pendingBytes = bytesReceived;
-				session::encoding(ctx);
+				if (ctx->governor && ctx->governor->over_budget())
+				{
+					// the socket stays readable meanwhile
+					basic_session::waiting_for_budget(std::move(ctx));
+					return;
+				}
+
+				auto &buffer = ctx->buffer;
+				try
+				{
+					buffer.acquire();
+				}
+				catch (const std::bad_alloc&)
+				{
+					ctx->logger.error("session::", func_name, " error: failed to allocate the receive buffer");
+					return;
+				}
+
+				bytesReceived = ctx->socket.read_some(asio::buffer(buffer.data(), buffer.capacity()), err);
+				if (err == asio::error::would_block || err == asio::error::try_again)
+				{
+					// spurious readiness, the buffer is not held while waiting
+					buffer.release();
+					basic_session::receiving(std::move(ctx));
+					return;
+				}
+			}
+
+			basic_session::received(std::move(ctx), err, bytesReceived);
+		})));
+#endif
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::received(std::shared_ptr<context> ctx, asio::error_code err, size_t bytesReceived) noexcept
+	{
+		const char *func_name = __func__;
+
+		if (!err)
+		{
+			ctx->buffer.commit(bytesReceived);
+			ctx->activity.received();
+			if (ctx->metrics)
+			{
+				ctx->receivedAt = std::chrono::steady_clock::now();
+				ctx->metrics->add_time(session_state::receiving, ctx->receiveStarted, ctx->receivedAt);
+				ctx->metrics->add(counter::bytes_received, bytesReceived);
+			}
+			basic_session::encoding(std::move(ctx));
+			return;
+		}
+
+		if (err == asio::error::operation_aborted)
+		{
+			ctx->logger.message("session::", func_name, " cancelled");
+			return;
+		}
+
+		if (err == asio::error::eof)
+		{
+			ctx->logger.message("session::", func_name, ": tcp socket has disconnected");
+			return;
+		}
+
+		ctx->logger.error("session::", func_name, " error: ", err);
+		// terminating the session
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::waiting_for_budget(std::shared_ptr<context> ctx) noexcept
+	{
+		const char *func_name = __func__;
+
+		if (ctx->metrics)
+			ctx->metrics->add(counter::memory_limit_hits);
+
+		trace(trace_event::budget_begin, ctx->traceId);
+		auto &timer = ctx->budgetTimer;
+		timer.expires_at(asio::steady_timer::time_point::max());
+		timer.async_wait(asio::bind_executor(ctx->socketStrand, bind_pool_allocator(
+			[ctx, func_name](asio::error_code /*err*/) {
+			trace(trace_event::budget_end, ctx->traceId);
+			// cancelled either to resume or to terminate the session
+			if (!std::exchange(ctx->budgetGranted, false))
+			{
+				ctx->logger.message("session::", func_name, " cancelled");
 				return;
 			}
+			basic_session::receiving(ctx);
+		})));
 
-			if (err == asio::error::operation_aborted)
+		// the governor does not keep the session alive
+		bool waiting = false;
+		try
+		{
+			waiting = ctx->governor->wait_for_budget([weak = ctx->weak_ref()] {
+				auto ctx = weak.lock();
+				if (!ctx)
+					return;
+				auto &strand = ctx->socketStrand;
+				asio::post(strand, bind_pool_allocator([ctx = std::move(ctx)] {
+					ctx->budgetGranted = true;
+					ctx->budgetTimer.cancel();
+				}));
+			});
+		}
+		catch (const std::bad_alloc&)
+		{
+			ctx->logger.warning("session::", func_name, " failed to wait for the budget");
+		}
+
+		if (!waiting)
+		{
+			// under the budget meanwhile
+			ctx->budgetGranted = true;
+			timer.cancel();
+		}
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::encoding(std::shared_ptr<context> ctx) noexcept
+	{
+		const char *func_name = __func__;
+
+		auto &buffer = ctx->buffer;
+		const trace_span span{trace_event::encode_begin, ctx->traceId, buffer.pending()};
+		const scheduling_policy &scheduling = ctx->schedulingPolicy;
+		const bool scheduled = scheduling.quantum != 0;
+		if (scheduled)
+			ctx->turn.start(class_of(*ctx) == session_class::bulk ? std::max<size_t>(scheduling.bulk_quantum, 1)
+																   : scheduling.quantum,
+							scheduling.time_budget);
+
+		while (!buffer.empty())
+		{
+			if (scheduled && ctx->turn.exhausted())
 			{
-				ctx->logger.message(func_name + " cancelled");
+				yielding(std::move(ctx));
 				return;
 			}
 
-			if (err == asio::error::eof)
+			// chunks that may be handed to the compute pool are not split: the I/O thread does not hash them
+			const size_t limit = scheduled && !ctx->computePolicy.pool ? ctx->turn.remaining() : SIZE_MAX;
+			const auto request = next_request(*ctx, limit);
+			if (!request)
 			{
-				ctx->logger.message(func_name + ": tcp socket has disconnected");
+				if (ctx->frames.failed())
+				{
+					ctx->logger.error("session::", func_name, " error: malformed request header");
+					return;
+				}
+				continue;
+			}
+
+			const auto [lineChunk, lineComplete] = *request;
+			if (!ctx->resumeChecked && resuming(ctx, lineChunk, lineComplete))
+				continue;
+
+			// queued chunks belong to the current line
+			if (context::batchable && lineComplete && !ctx->lineInProgress && ctx->hashJobs.empty() &&
+				lineChunk.size() <= context::batch_line_limit)
+			{
+				ctx->batchLines.push_back(lineChunk);
+				if (ctx->protocol == wire_protocol::binary)
+					ctx->batchIds.push_back(ctx->frames.id());
+				if (scheduled)
+					ctx->turn.consume(lineChunk.size() + 1);
+				continue;
+			}
+
+			// responses must keep the order of lines
+			hash_batch(ctx);
+
+			const compute_policy &compute = ctx->computePolicy;
+			if (!ctx->hashJobs.empty() || (compute.pool && ctx->lineBytes + lineChunk.size() >= compute.threshold))
+			{
+				if (lineComplete)
+				{
+					hashing(std::move(ctx), lineChunk, true, pooled_buffer());
+					return;
+				}
+
+				// the rest of the buffer: hashed along with its buffer while the next one is received
+				hashing(ctx, lineChunk, false, buffer.detach());
+				break;
+			}
+
+			trace(trace_event::update_begin, ctx->traceId, lineChunk.size());
+			std::optional<digest> oneShot{};
+			if constexpr (has_one_shot_v<Hasher>)
+			{
+				// a line entirely within the buffer bypasses the streaming state
+				if (lineComplete && !ctx->lineInProgress)
+					oneShot = Hasher::hash(lineChunk);
+			}
+			const bool hashed = oneShot || ctx->hash.update(lineChunk);
+			trace(trace_event::update_end, ctx->traceId);
+			if (!hashed)
+			{
+				ctx->logger.error("session::", func_name, " error: hash.update() failed");
+				return;
+			}
+
+			if (!chunk_hashed(ctx, lineChunk.size(), lineComplete, oneShot ? &*oneShot : nullptr))
 				return;
+
+			if (scheduled)
+			{
+				ctx->turn.consume(lineChunk.size());
+				ctx->turn.check_time();
 			}
+		}
+		// the unused quantum is not accumulated
+		ctx->turn.idle();
+		hash_batch(ctx);
+		buffer.release();
+		if (ctx->governor)
+			ctx->governor->relieved();
+		if (ctx->metrics)
+			ctx->metrics->add_time(session_state::encoding, ctx->receivedAt);
 
-			ctx->logger.error(func_name + " error:" + err.message());
-			// terminating the session
-		});
+		if (ctx->outputPolicy.flush.mode == flush_mode::end_of_batch)
+			responding(ctx);
+
+		// the buffer has been consumed entirely, the rest of an incomplete line is in the hash or being hashed
+		if (!can_receive(*ctx))
+		{
+			if (ctx->metrics && ctx->output.staged() + ctx->output.in_flight() > ctx->outputPolicy.max_pending)
+				ctx->metrics->add(counter::output_limit_hits);
+			ctx->receivingPaused = true;
+			return;
+		}
+
+		receiving(std::move(ctx));
 	}
 
-	void session::encoding(std::shared_ptr<context> ctx) noexcept
+	template <typename Hasher>
+	void basic_session<Hasher>::yielding(std::shared_ptr<context> ctx) noexcept
 	{
-		const auto func_name = std::string("session::") + __func__;
+		// the lines of the turn are not held back by the next turns
+		hash_batch(ctx);
+		if (ctx->outputPolicy.flush.mode == flush_mode::end_of_batch)
+			responding(ctx);
 
-		// TODO: make a buffer-class
-		const auto inspectBuffer = [](const auto &buffer, size_t bytes, char term) {
-		  struct _res
-		  {
-			  size_t dataLength, // will not include '\n'
-			  toErase; // will include '\n' if found
-		  };
+		const session_class sessionClass = class_of(*ctx);
+		std::chrono::steady_clock::time_point yieldedAt{};
+		if (ctx->metrics)
+		{
+			ctx->metrics->add(counter::turns_yielded);
+			yieldedAt = std::chrono::steady_clock::now();
+		}
 
-		  const auto iBegin = std::cbegin(buffer),
-			  iEnd = std::next(iBegin, bytes);
+		trace(trace_event::yield_begin, ctx->traceId);
+		auto &strand = ctx->socketStrand;
+		asio::post(strand, bind_pool_allocator([ctx = std::move(ctx), sessionClass, yieldedAt] () mutable {
+			trace(trace_event::yield_end, ctx->traceId);
+			if (ctx->metrics)
+				ctx->metrics->record(sessionClass == session_class::bulk ? histogram::bulk_wait_ns : histogram::latency_wait_ns,
+									 metrics::elapsed_ns(yieldedAt, std::chrono::steady_clock::now()));
+			basic_session::encoding(std::move(ctx));
+		}));
+	}
 
-		  const auto iTerm = std::find(iBegin, iEnd, term);
-		  const size_t dataLength = std::distance(iBegin, iTerm);
-		  const size_t toErase = dataLength +
-								 (iTerm != std::cend(buffer) && *iTerm == term ? 1 : 0);
+	template <typename Hasher>
+	session_class basic_session<Hasher>::class_of(const context &ctx) noexcept
+	{
+		const scheduling_policy &scheduling = ctx.schedulingPolicy;
+		switch (scheduling.classes)
+		{
+		case class_mode::latency:
+			return session_class::latency;
+		case class_mode::bulk:
+			return session_class::bulk;
+		case class_mode::adaptive:
+			break;
+		}
+		return ctx.lineBytes >= scheduling.bulk_line ? session_class::bulk : session_class::latency;
+	}
 
-		  return _res{dataLength, toErase};
-		};
+	template <typename Hasher>
+	void basic_session<Hasher>::hashing(std::shared_ptr<context> ctx, std::string_view chunk, bool lineComplete,
+										pooled_buffer &&storage) noexcept
+	{
+		const char *func_name = __func__;
 
-		const auto shiftLeft = [](auto &buffer, size_t bytes) {
-		  const auto iBegin = std::begin(buffer);
-		  const auto iNewEnd = std::rotate(iBegin, std::next(iBegin, bytes), std::end(buffer));
-		  std::for_each(iNewEnd, std::end(buffer), [](auto &e) { e = 0; });
-		};
+		if (storage)
+			++ctx->buffersHashing;
 
-		const size_t pendingBytes = ctx->pendingBytes;
-		if (!pendingBytes)
+		const bool idle = ctx->hashJobs.empty();
+		try
 		{
-			asio::post(ctx->socketStrand, [ctx]{ receiving(ctx); });
+			ctx->hashJobs.push_back(typename context::hash_job{chunk, lineComplete, std::move(storage)});
+		}
+		catch (const std::bad_alloc&)
+		{
+			ctx->logger.error("session::", func_name, " error: failed to queue a chunk");
+			asio::error_code errorCode{};
+			ctx->socket.cancel(errorCode);
+			ctx->flushTimer.cancel();
+			ctx->budgetTimer.cancel();
 			return;
 		}
 
-		auto &buffer = ctx->stringBuffer;
-		const auto [dataLength, toErase] = inspectBuffer(buffer, pendingBytes, '\n');
-		std::string_view lineChunk{(const char*)buffer.data(), dataLength};
-		if (!ctx->hash.update(lineChunk))
+		if (idle)
+			hash_next(std::move(ctx));
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::hash_next(std::shared_ptr<context> ctx) noexcept
+	{
+		const char *func_name = __func__;
+
+		const auto &job = ctx->hashJobs.front();
+		const std::string_view chunk = job.chunk;
+		// keeps the io_context running until the result is delivered to the strand
+		auto work = asio::make_work_guard(ctx->socket.get_executor());
+		asio::thread_pool &pool = *ctx->computePolicy.pool;
+		trace(trace_event::pool_queue_begin, ctx->traceId, chunk.size());
+		asio::post(pool, bind_pool_allocator([ctx = std::move(ctx), chunk, func_name,
+											  work = std::move(work)] () mutable {
+			trace(trace_event::pool_queue_end, ctx->traceId);
+			trace(trace_event::pool_hash_begin, ctx->traceId, chunk.size());
+			const bool hashed = ctx->hash.update(chunk);
+			trace(trace_event::pool_hash_end, ctx->traceId);
+			trace(trace_event::strand_queue_begin, ctx->traceId);
+			auto &strand = ctx->socketStrand;
+			asio::post(strand, bind_pool_allocator([ctx = std::move(ctx), func_name, hashed] () mutable {
+				trace(trace_event::strand_queue_end, ctx->traceId);
+				auto &job = ctx->hashJobs.front();
+				if (!hashed || !chunk_hashed(ctx, job.chunk.size(), job.lineComplete))
+				{
+					if (!hashed)
+						ctx->logger.error("session::", func_name, " error: hash.update() failed");
+					// terminating the session, cancelling the pending receive
+					asio::error_code errorCode{};
+					ctx->socket.cancel(errorCode);
+					ctx->flushTimer.cancel();
+					ctx->budgetTimer.cancel();
+					return;
+				}
+
+				// the buffer of the chunk returns to the pool of the I/O thread
+				const bool resumeEncoding = !job.storage;
+				if (!resumeEncoding)
+					--ctx->buffersHashing;
+				ctx->hashJobs.pop_front();
+				if (ctx->governor)
+					ctx->governor->relieved();
+
+				if (!ctx->hashJobs.empty())
+					hash_next(ctx);
+
+				if (resumeEncoding)
+				{
+					basic_session::encoding(std::move(ctx));
+					return;
+				}
+
+				// the received segment has been hashed, e.g. its `#checkpoint` lines are due
+				if (ctx->outputPolicy.flush.mode == flush_mode::end_of_batch)
+					responding(ctx);
+
+				if (ctx->receivingPaused && can_receive(*ctx))
+				{
+					ctx->receivingPaused = false;
+					basic_session::receiving(std::move(ctx));
+				}
+			}));
+			work.reset();
+		}));
+	}
+
+	template <typename Hasher>
+	bool basic_session<Hasher>::can_receive(const context &ctx) noexcept
+	{
+		return ctx.output.staged() + ctx.output.in_flight() <= ctx.outputPolicy.max_pending &&
+			ctx.buffersHashing < std::max<size_t>(ctx.computePolicy.max_in_flight, 1);
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::account_output(context &ctx) noexcept
+	{
+		const size_t bytes = ctx.output.staged() + ctx.output.in_flight();
+		const int64_t delta = int64_t(bytes) - int64_t(ctx.outputAccounted);
+		ctx.outputAccounted = bytes;
+		if (ctx.metrics)
+			ctx.metrics->add(gauge::output_bytes, delta);
+		if (ctx.governor)
+		{
+			ctx.governor->add_output(delta);
+			if (delta < 0)
+				ctx.governor->relieved();
+		}
+	}
+
+	template <typename Hasher>
+	std::optional<line_chunk> basic_session<Hasher>::next_request(context &ctx, size_t limit) noexcept
+	{
+		if (ctx.protocol == wire_protocol::text)
+			return ctx.buffer.next_chunk('\n', limit);
+
+		size_t consumed = 0;
+		const auto request = ctx.frames.next(ctx.buffer.pending_data().substr(0, limit), consumed);
+		ctx.buffer.consume(consumed);
+		return request;
+	}
+
+	template <typename Hasher>
+	bool basic_session<Hasher>::chunk_hashed(const std::shared_ptr<context> &ctx, size_t chunkSize, bool lineComplete,
+											 const digest *oneShot) noexcept
+	{
+		const char *func_name = __func__;
+
+		if (ctx->metrics && !ctx->lineInProgress)
+			ctx->lineStartedAt = ctx->receivedAt;
+
+		if (!lineComplete && !ctx->lineInProgress)
+			ctx->activity.line_started();
+		else if (lineComplete && ctx->lineInProgress)
+			ctx->activity.line_finished();
+
+		ctx->lineInProgress = !lineComplete;
+		ctx->lineBytes += chunkSize;
+		if (!lineComplete)
+		{
+			checkpoint_line(ctx);
+			return true;
+		}
+
+		const uint64_t lineSize = ctx->lineBytes;
+		ctx->lineBytes = 0;
+		if (ctx->checkpointed)
+		{
+			ctx->nextCheckpoint = ctx->checkpointPolicy.interval;
+			if (!ctx->lineToken.empty())
+			{
+				ctx->checkpointPolicy.store->erase(ctx->lineToken);
+				ctx->lineToken.clear();
+				write_checkpoint_files(ctx);
+			}
+		}
+		const auto res = oneShot ? std::optional<digest>(*oneShot) : ctx->hash.finalize();
+		if (!res)
+		{
+			ctx->logger.error("session::", func_name, " error: hash.finalize() failed");
+			return false;
+		}
+
+		trace(trace_event::line_hashed, ctx->traceId, lineSize);
+		if (ctx->metrics)
+		{
+			ctx->metrics->add(counter::lines_hashed);
+			ctx->metrics->record(histogram::line_size, lineSize);
+			ctx->metrics->record(histogram::line_latency_ns,
+								 metrics::elapsed_ns(ctx->lineStartedAt, std::chrono::steady_clock::now()));
+		}
+
+		const request_id id = ctx->frames.id();
+		queue_responses(ctx, &*res, 1, &id);
+		return true;
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::checkpoint_line(const std::shared_ptr<context> &ctx) noexcept
+	{
+		if constexpr (is_checkpointable_v<Hasher>)
 		{
-			ctx->logger.error(func_name + " error: hash.update() failed");
+			const char *func_name = __func__;
+
+			if (!ctx->checkpointed || ctx->lineBytes < ctx->nextCheckpoint)
+				return;
+
+			ctx->nextCheckpoint = ctx->lineBytes + ctx->checkpointPolicy.interval;
+			try
+			{
+				if (ctx->lineToken.empty())
+					ctx->lineToken = checkpoint_store::make_token();
+			}
+			catch (const std::exception &e)
+			{
+				ctx->logger.warning("session::", func_name, " failed to make a token: ", e.what());
+				return;
+			}
+
+			if (!ctx->checkpointPolicy.store->put(ctx->lineToken, ctx->hash.checkpoint()))
+			{
+				ctx->logger.warning("session::", func_name, " failed to store a checkpoint");
+				return;
+			}
+			write_checkpoint_files(ctx);
+
+			std::array<char, 20> offset{};
+			const auto [iEnd, err] = std::to_chars(offset.data(), offset.data() + offset.size(), ctx->lineBytes);
+			queue_notice(ctx, {"#checkpoint", ctx->lineToken, std::string_view(offset.data(), size_t(iEnd - offset.data()))});
+		}
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::write_checkpoint_files(const std::shared_ptr<context> &ctx) noexcept
+	{
+		checkpoint_store &store = *ctx->checkpointPolicy.store;
+		if (!store.flush_due())
 			return;
+
+		if (ctx->computePolicy.pool)
+		{
+			try
+			{
+				// keeps the io_context, and so the store, running until the files are written
+				auto work = asio::make_work_guard(ctx->socket.get_executor());
+				asio::post(*ctx->computePolicy.pool, bind_pool_allocator([&store, work = std::move(work)] {
+					store.flush();
+				}));
+				return;
+			}
+			catch (const std::exception &)
+			{}
+		}
+		store.flush();
+	}
+
+	template <typename Hasher>
+	bool basic_session<Hasher>::resuming(const std::shared_ptr<context> &ctx, std::string_view chunk,
+										 bool lineComplete) noexcept
+	{
+		if constexpr (is_checkpointable_v<Hasher>)
+		{
+			const char *func_name = __func__;
+			constexpr std::string_view prefix = "#resume ";
+
+			auto &request = ctx->resumeRequest;
+			const size_t heldSize = ctx->resumeRequestSize;
+			const bool fits = heldSize + chunk.size() <= request.size();
+			if (fits)
+			{
+				std::copy(chunk.cbegin(), chunk.cend(), request.begin() + heldSize);
+				ctx->resumeRequestSize += chunk.size();
+			}
+
+			const std::string_view text(request.data(), ctx->resumeRequestSize);
+			const bool isRequest = fits && text.substr(0, prefix.size()) == prefix.substr(0, text.size()) &&
+				(!lineComplete || text.size() >= prefix.size());
+			if (!isRequest)
+			{
+				// an ordinary line: the bytes held back are its beginning
+				ctx->resumeChecked = true;
+				const std::string_view held(request.data(), heldSize);
+				if (!held.empty() && (!ctx->hash.update(held) || !chunk_hashed(ctx, held.size(), false)))
+				{
+					ctx->logger.error("session::", func_name, " error: hash.update() failed");
+					asio::error_code errorCode{};
+					ctx->socket.cancel(errorCode);
+					return true;
+				}
+				return false;
+			}
+
+			if (!lineComplete)
+				return true;
+
+			ctx->resumeChecked = true;
+			const std::string_view args = text.substr(prefix.size());
+			const size_t iSpace = args.find(' ');
+			const std::string_view token = args.substr(0, iSpace),
+				offsetText = iSpace == std::string_view::npos ? std::string_view() : args.substr(iSpace + 1);
+			uint64_t offset = 0;
+			const auto [iEnd, err] = std::from_chars(offsetText.data(), offsetText.data() + offsetText.size(), offset);
+			if (err != std::errc() || iEnd != offsetText.data() + offsetText.size() || !checkpoint_store::valid_token(token))
+			{
+				queue_notice(ctx, {"#error", "invalid request"});
+				return true;
+			}
+
+			const auto cp = ctx->checkpointPolicy.store->get(token);
+			write_checkpoint_files(ctx);
+			if (!cp || cp->bytes != offset)
+			{
+				queue_notice(ctx, {"#error", "unknown checkpoint"});
+				return true;
+			}
+			if (!ctx->hash.restore(*cp))
+			{
+				ctx->logger.error("session::", func_name, " error: hash.restore() failed");
+				queue_notice(ctx, {"#error", "internal error"});
+				return true;
+			}
+
+			ctx->lineToken.assign(token);
+			ctx->lineBytes = offset;
+			ctx->nextCheckpoint = offset + ctx->checkpointPolicy.interval;
+			ctx->lineInProgress = true;
+			ctx->activity.line_started();
+			if (ctx->metrics)
+				ctx->lineStartedAt = ctx->receivedAt;
+			ctx->logger.message("session::", func_name, ": resumed a line at ", offset);
+			queue_notice(ctx, {"#resumed", token, offsetText});
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	template <typename Hasher>
+	template <size_t N>
+	void basic_session<Hasher>::queue_responses(const std::shared_ptr<context> &ctx, const std::array<uint8_t, N> *digests,
+												size_t count, const request_id *ids) noexcept
+	{
+		const bool wasEmpty = !ctx->output.staged();
+		if (ctx->protocol == wire_protocol::text)
+			hex_encoder::encode_lines(digests, count, ctx->output.append(count * hex_encoder::line_size<N>));
+		else
+		{
+			size_t size = count * N;
+			for (size_t i = 0; ids && i < count; ++i)
+				if (ids[i].present)
+					size += detail::varint_size(ids[i].value);
+
+			uint8_t *out = ctx->output.append(size);
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (ids && ids[i].present)
+					out = detail::write_varint(ids[i].value, out);
+				out = std::copy(digests[i].cbegin(), digests[i].cend(), out);
+			}
+		}
+		ctx->stagedLines += count;
+		if (ctx->metrics)
+			ctx->metrics->add(gauge::line_backlog, int64_t(count));
+
+		flush_queued(ctx, wasEmpty);
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::queue_notice(const std::shared_ptr<context> &ctx,
+											 std::initializer_list<std::string_view> words) noexcept
+	{
+		const bool wasEmpty = !ctx->output.staged();
+		size_t size = 0;
+		for (const auto &word : words)
+			size += word.size() + 1;
+
+		auto *out = reinterpret_cast<char*>(ctx->output.append(size));
+		for (const auto &word : words)
+		{
+			out = std::copy(word.cbegin(), word.cend(), out);
+			*out++ = ' ';
 		}
+		out[-1] = '\n';
+
+		flush_queued(ctx, wasEmpty);
+	}
 
-		shiftLeft(buffer, toErase);
-		ctx->pendingBytes -= toErase;
+	template <typename Hasher>
+	void basic_session<Hasher>::flush_queued(const std::shared_ptr<context> &ctx, bool wasEmpty) noexcept
+	{
+		const char *func_name = __func__;
+
+		account_output(*ctx);
+		const flush_policy &policy = ctx->outputPolicy.flush;
+		switch (policy.mode)
+		{
+		case flush_mode::immediate:
+			responding(ctx);
+			return;
+		case flush_mode::end_of_batch:
+			return;
+		case flush_mode::threshold:
+			break;
+		}
 
-		// happens only if '\n' has been found upon inspection
-		const bool lineComplete = (toErase - dataLength) == 1;
-		if (lineComplete)
+		if (ctx->output.staged() >= policy.size_threshold)
 		{
-			asio::post(ctx->socketStrand, [ctx]{ responding(ctx); });
+			responding(ctx);
 			return;
 		}
 
-		asio::post(ctx->socketStrand, [ctx]{ receiving(ctx); });
+		if (!wasEmpty || ctx->flushTimerArmed)
+			return;
+
+		ctx->flushTimerArmed = true;
+		ctx->flushTimer.expires_after(policy.delay);
+		ctx->flushTimer.async_wait(asio::bind_executor(ctx->socketStrand, bind_pool_allocator(
+			[ctx, func_name](asio::error_code err) {
+			ctx->flushTimerArmed = false;
+			if (!err)
+			{
+				basic_session::responding(ctx);
+				return;
+			}
+
+			if (err != asio::error::operation_aborted)
+				ctx->logger.error("session::", func_name, " error: ", err);
+		})));
 	}
 
-	void session::responding(std::shared_ptr<context> ctx) noexcept
+	template <typename Hasher>
+	void basic_session<Hasher>::hash_batch(const std::shared_ptr<context> &ctx) noexcept
 	{
-		const auto func_name = std::string("session::") + __func__;
+		auto &lines = ctx->batchLines;
+		if (lines.empty())
+			return;
 
-		const auto res = ctx->hash.finalize();
-		if (!res)
+		const trace_span span{trace_event::batch_begin, ctx->traceId, lines.size()};
+		auto &digests = ctx->batchDigests;
+		if (ctx->metrics)
+		{
+			// the lines have been received by the current receive
+			const uint64_t latency = metrics::elapsed_ns(ctx->receivedAt, std::chrono::steady_clock::now());
+			ctx->metrics->add(counter::lines_hashed, lines.size());
+			for (const auto &line : lines)
+			{
+				ctx->metrics->record(histogram::line_size, line.size());
+				ctx->metrics->record(histogram::line_latency_ns, latency);
+			}
+		}
+
+		digest_cache *cache = ctx->digests;
+		if (!cache)
 		{
-			ctx->logger.error(func_name + " error: hash.finalize() failed");
+			digests.resize(lines.size());
+			sha256_messages(lines.data(), lines.size(), digests.data());
+			auto &ids = ctx->batchIds;
+			queue_responses(ctx, digests.data(), digests.size(), ids.empty() ? nullptr : ids.data());
+			lines.clear();
+			ids.clear();
 			return;
 		}
 
-		ctx->hexBuffer = detail::append(to_hex(*res), '\n');
+		// hits are copied in place, misses are moved to the front of `lines` and hashed side by side
+		constexpr size_t lineSize = digest_cache::response_size;
+		const size_t count = lines.size();
+		const bool wasEmpty = !ctx->output.staged();
+		uint8_t *out = ctx->output.append(count * lineSize);
+		auto &misses = ctx->batchMisses;
+		misses.clear();
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (cache->find(lines[i], out + i * lineSize))
+				continue;
+			lines[misses.size()] = lines[i];
+			misses.push_back(i);
+		}
+
+		digests.resize(misses.size());
+		sha256_messages(lines.data(), misses.size(), digests.data());
+		for (size_t j = 0; j < misses.size(); ++j)
+		{
+			uint8_t *response = out + misses[j] * lineSize;
+			hex_encoder::encode_lines(&digests[j], 1, response);
+			cache->insert(lines[j], response);
+		}
+		lines.clear();
+
+		ctx->stagedLines += count;
+		if (ctx->metrics)
+		{
+			ctx->metrics->add(gauge::line_backlog, int64_t(count));
+			ctx->metrics->add(counter::digest_cache_hits, count - misses.size());
+			ctx->metrics->add(counter::digest_cache_misses, misses.size());
+		}
+		flush_queued(ctx, wasEmpty);
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::responding(std::shared_ptr<context> ctx) noexcept
+	{
+		const char *func_name = __func__;
+
+		if (ctx->output.writing() || !ctx->output.staged())
+			return;
+
+		ctx->activity.write_started();
+		if (ctx->metrics)
+			ctx->writeStarted = std::chrono::steady_clock::now();
+
 		tcp::socket &socket = ctx->socket;
-		asio::async_write(socket, asio::buffer(ctx->hexBuffer),
-			[ctx, func_name](asio::error_code err, size_t /*bytesTransferred*/) noexcept{
+		auto &strand = ctx->socketStrand;
+		ctx->writingLines = std::exchange(ctx->stagedLines, 0);
+		const auto buffer = asio::buffer(ctx->output.begin_write());
+		trace(trace_event::write_begin, ctx->traceId, buffer.size());
+		asio::async_write(socket, buffer, asio::bind_executor(strand, bind_pool_allocator(
+			[ctx = std::move(ctx), func_name](asio::error_code err, size_t bytesTransferred) noexcept{
+			trace(trace_event::write_end, ctx->traceId);
+			if (ctx->metrics)
+			{
+				// lines of a failed write are dropped as well
+				ctx->metrics->add_time(session_state::responding, ctx->writeStarted);
+				ctx->metrics->add(counter::bytes_sent, bytesTransferred);
+				ctx->metrics->add(gauge::line_backlog, -int64_t(ctx->writingLines));
+			}
+			ctx->output.end_write();
+			account_output(*ctx);
+			ctx->activity.write_finished();
 
 			if (!err)
 			{
-				ctx->pendingBytes ?
-					session::encoding(ctx) :
-					asio::post(ctx->socketStrand, [ctx]{ receiving(ctx); });
+				const output_policy &policy = ctx->outputPolicy;
+				// lines queued during the write are ready, unless the policy waits for more of them
+				if (policy.flush.mode != flush_mode::threshold || ctx->output.staged() >= policy.flush.size_threshold)
+					basic_session::responding(ctx);
+
+				if (ctx->receivingPaused && can_receive(*ctx))
+				{
+					ctx->receivingPaused = false;
+					basic_session::receiving(ctx);
+				}
 				return;
 			}
 
 			if (err == asio::error::operation_aborted)
 			{
-				ctx->logger.message(func_name + " cancelled");
+				ctx->logger.message("session::", func_name, " cancelled");
 				return;
 			}
 			if (err == asio::error::eof)
 			{
-				ctx->logger.message(func_name + ": tcp socket has disconnected");
+				ctx->logger.message("session::", func_name, ": tcp socket has disconnected");
 				return;
 			}
 
-			ctx->logger.error(func_name + " error:" + err.message());
-			// terminating session here
-		});
+			ctx->logger.error("session::", func_name, " error: ", err);
+			// terminating session here, cancelling the pending receive
+			asio::error_code errorCode{};
+			ctx->socket.cancel(errorCode);
+			ctx->flushTimer.cancel();
+			ctx->budgetTimer.cancel();
+		})));
 	}
 
-	template<typename Config>
-	session::termination session::start(tcp::socket&& socket, Config&& conf) noexcept
+	template <typename Hasher>
+	template <typename Config>
+	typename basic_session<Hasher>::termination basic_session<Hasher>::start(tcp::socket&& socket, Config&& conf) noexcept
 	{
-		auto optHash = sha256_hash::create();
+		auto optHash = Hasher::create();
 		if (!optHash)
 			return termination({});
 
 		auto ctx = context::create(std::move(socket), std::move(*optHash), std::forward<Config>(conf));
-		asio::post(ctx->socketStrand, [ctx]{session::receiving(ctx);});
 
-		return session::termination(ctx);
+		asio::error_code errorCode{};
+		ctx->socket.set_option(tcp::no_delay(ctx->outputPolicy.no_delay), errorCode);
+		if (errorCode != asio::error_code())
+			ctx->logger.warning("session::start() failed to set TCP_NODELAY: ", errorCode);
+
+		// reads are attempted once the socket is readable, see `receiving()`
+		ctx->socket.non_blocking(true, errorCode);
+		if (errorCode != asio::error_code())
+		{
+			ctx->logger.error("session::start() failed to set the socket non-blocking: ", errorCode);
+			return termination({});
+		}
+
+		if (ctx->sessions)
+			ctx->sessions->link(*ctx);
+		trace(trace_event::registered, ctx->traceId);
+
+		termination term(ctx->weak_ref());
+		auto &strand = ctx->socketStrand;
+		asio::post(strand, bind_pool_allocator([ctx = std::move(ctx)] () mutable {basic_session::receiving(std::move(ctx));}));
+
+		return term;
+	}
+
+	template <typename Hasher>
+	void basic_session<Hasher>::terminate_all(const registry &sessions) noexcept
+	{
+		// terminating outside of the registry's locks: a context may be destroyed here
+		for (auto &ctx : sessions.snapshot())
+			termination(ctx->weak_ref())();
 	}
 }
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "hash-service/sha256_batch.h"
+
+#ifdef HS_SHA256_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define HS_SHA256_ARMV8 1
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <optional>
+#include <string_view>
+
+namespace hs {
+	namespace detail {
+		/**
+		 * @brief Compresses `blocks` consecutive 64-byte blocks of `data` into `state`.
+		 */
+		using sha256_compress_fn = void (*)(uint32_t *state, const uint8_t *data, size_t blocks) noexcept;
+
+		inline void sha256_compress_portable(uint32_t *state, const uint8_t *data, size_t blocks) noexcept {
+			for (; blocks; --blocks, data += 64)
+				sha256_compress(state, data);
+		}
+
+#ifdef HS_SHA256_X86_DISPATCH
+		// the portable rounds with the rotations of BMI2 (`rorx`, `andn`), AVX2 CPUs have it
+		__attribute__((target("avx2,bmi,bmi2")))
+		inline void sha256_compress_avx2(uint32_t *state, const uint8_t *data, size_t blocks) noexcept {
+			for (; blocks; --blocks, data += 64)
+				sha256_compress(state, data);
+		}
+
+		/**
+		 * @brief 4 rounds of the SHA extensions, the state being held as ABEF and CDGH.
+		 */
+		__attribute__((target("sha,sse4.1"), always_inline))
+		inline void sha256_shani_rounds(__m128i &abef, __m128i &cdgh, __m128i w, const uint32_t *k) noexcept {
+			__m128i wk = _mm_add_epi32(w, _mm_loadu_si128(reinterpret_cast<const __m128i*>(k)));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+			wk = _mm_shuffle_epi32(wk, 0x0E);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, wk);
+		}
+
+		__attribute__((target("sha,sse4.1")))
+		inline void sha256_compress_shani(uint32_t *state, const uint8_t *data, size_t blocks) noexcept {
+			// big-endian words
+			const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+
+			const __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+			__m128i cdgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+			__m128i abef = _mm_alignr_epi8(dcba, cdgh, 8);
+			cdgh = _mm_blend_epi16(cdgh, dcba, 0xF0);
+
+			for (; blocks; --blocks, data += 64)
+			{
+				const __m128i abefSaved = abef, cdghSaved = cdgh;
+				const auto *words = reinterpret_cast<const __m128i*>(data);
+				__m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128(words), byteSwap),
+					w1 = _mm_shuffle_epi8(_mm_loadu_si128(words + 1), byteSwap),
+					w2 = _mm_shuffle_epi8(_mm_loadu_si128(words + 2), byteSwap),
+					w3 = _mm_shuffle_epi8(_mm_loadu_si128(words + 3), byteSwap);
+				sha256_shani_rounds(abef, cdgh, w0, sha256_k);
+				sha256_shani_rounds(abef, cdgh, w1, sha256_k + 4);
+				sha256_shani_rounds(abef, cdgh, w2, sha256_k + 8);
+				sha256_shani_rounds(abef, cdgh, w3, sha256_k + 12);
+				for (size_t t = 16; t < 64; t += 4)
+				{
+					// the next 4 words of the schedule, from the previous 16
+					const __m128i w = _mm_sha256msg2_epu32(
+						_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)), w3);
+					sha256_shani_rounds(abef, cdgh, w, sha256_k + t);
+					w0 = w1;
+					w1 = w2;
+					w2 = w3;
+					w3 = w;
+				}
+				abef = _mm_add_epi32(abef, abefSaved);
+				cdgh = _mm_add_epi32(cdgh, cdghSaved);
+			}
+
+			const __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+			const __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+		}
+#endif
+
+#ifdef HS_SHA256_ARMV8
+		inline void sha256_compress_armv8(uint32_t *state, const uint8_t *data, size_t blocks) noexcept {
+			uint32x4_t abcd = vld1q_u32(state), efgh = vld1q_u32(state + 4);
+			const auto rounds = [&abcd, &efgh](uint32x4_t w, const uint32_t *k) {
+				const uint32x4_t wk = vaddq_u32(w, vld1q_u32(k));
+				const uint32x4_t abcdPrev = abcd;
+				abcd = vsha256hq_u32(abcd, efgh, wk);
+				efgh = vsha256h2q_u32(efgh, abcdPrev, wk);
+			};
+			const auto load = [](const uint8_t *bytes) {
+				return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(bytes)));
+			};
+
+			for (; blocks; --blocks, data += 64)
+			{
+				const uint32x4_t abcdSaved = abcd, efghSaved = efgh;
+				uint32x4_t w0 = load(data), w1 = load(data + 16), w2 = load(data + 32), w3 = load(data + 48);
+				rounds(w0, sha256_k);
+				rounds(w1, sha256_k + 4);
+				rounds(w2, sha256_k + 8);
+				rounds(w3, sha256_k + 12);
+				for (size_t t = 16; t < 64; t += 4)
+				{
+					const uint32x4_t w = vsha256su1q_u32(vsha256su0q_u32(w0, w1), w2, w3);
+					rounds(w, sha256_k + t);
+					w0 = w1;
+					w1 = w2;
+					w2 = w3;
+					w3 = w;
+				}
+				abcd = vaddq_u32(abcd, abcdSaved);
+				efgh = vaddq_u32(efgh, efghSaved);
+			}
+
+			vst1q_u32(state, abcd);
+			vst1q_u32(state + 4, efgh);
+		}
+#endif
+	}
+
+	/**
+	 * @brief In-tree SHA-256 hasher, with the state held inline.
+	 *
+	 * Compresses with the SHA extensions (SHA-NI) if the CPU has them, with the portable rounds built for
+	 * AVX2/BMI2 otherwise, or portably. The kernel is selected upon the first use, the ARMv8 one if the build
+	 * targets the cryptography extension. Resetting for the next message is a copy of the initial state,
+	 * without the algorithm lookup of `EVP_DigestInit_ex`. A message entirely available is hashed by `hash()`,
+	 * straight from its bytes.
+	 */
+	class sha256_native_hash
+	{
+	 public:
+		constexpr static size_t digest_length = 32;
+		using digest = std::array<uint8_t, digest_length>;
+
+		/**
+		 * Kernels, from the slowest to the fastest.
+		 */
+		enum class kernel {
+			portable,
+			avx2,
+			sha_ni,
+			armv8
+		};
+
+		/**
+		 * @return `true` if the kernel can be used on this CPU.
+		 */
+		[[nodiscard]] static bool supported(kernel k) noexcept {
+			switch (k)
+			{
+			case kernel::portable:
+				return true;
+#ifdef HS_SHA256_X86_DISPATCH
+			case kernel::avx2:
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+			case kernel::sha_ni:
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#endif
+#ifdef HS_SHA256_ARMV8
+			case kernel::armv8:
+				return true;
+#endif
+			default:
+				return false;
+			}
+		}
+
+		/**
+		 * @return the fastest supported kernel.
+		 */
+		[[nodiscard]] static kernel best() noexcept {
+			static const kernel k = [] {
+				for (kernel candidate : {kernel::armv8, kernel::sha_ni, kernel::avx2})
+					if (supported(candidate))
+						return candidate;
+				return kernel::portable;
+			}();
+			return k;
+		}
+
+		sha256_native_hash(const sha256_native_hash&) = delete;
+		sha256_native_hash& operator=(const sha256_native_hash&) = delete;
+
+		sha256_native_hash(sha256_native_hash&&) noexcept = default;
+		sha256_native_hash& operator=(sha256_native_hash&&) noexcept = default;
+
+		static std::optional<sha256_native_hash> create() noexcept {
+			return sha256_native_hash(compressor(best()));
+		}
+
+		/**
+		 * @pre `supported(k)`
+		 */
+		static std::optional<sha256_native_hash> create(kernel k) noexcept {
+			return sha256_native_hash(compressor(k));
+		}
+
+		bool update(std::string_view str) noexcept {
+			const auto *data = reinterpret_cast<const uint8_t*>(str.data());
+			size_t size = str.size();
+			const size_t used = size_t(_bytes % 64);
+			_bytes += size;
+
+			if (used)
+			{
+				const size_t taken = size < 64 - used ? size : 64 - used;
+				std::memcpy(_tail.data() + used, data, taken);
+				if (used + taken < 64)
+					return true;
+				_compress(_state.data(), _tail.data(), 1);
+				data += taken;
+				size -= taken;
+			}
+
+			const size_t blocks = size / 64;
+			if (blocks)
+				_compress(_state.data(), data, blocks);
+			if (size % 64)
+				std::memcpy(_tail.data(), data + blocks * 64, size % 64);
+			return true;
+		}
+
+		auto finalize() noexcept -> std::optional<digest> {
+			const digest hash = finish(_compress, _state, _tail.data(), size_t(_bytes % 64), _bytes);
+			_state = detail::sha256_iv;
+			_bytes = 0;
+			return hash;
+		}
+
+		/**
+		 * @brief Hashes a whole message using the best kernel.
+		 */
+		static digest hash(std::string_view message) noexcept {
+			return hash(best(), message);
+		}
+
+		/**
+		 * @brief Hashes a whole message using the given kernel.
+		 * @pre `supported(k)`
+		 */
+		static digest hash(kernel k, std::string_view message) noexcept {
+			const detail::sha256_compress_fn compress = compressor(k);
+			const auto *data = reinterpret_cast<const uint8_t*>(message.data());
+			const size_t blocks = message.size() / 64;
+
+			auto state = detail::sha256_iv;
+			if (blocks)
+				compress(state.data(), data, blocks);
+			return finish(compress, state, data + blocks * 64, message.size() % 64, message.size());
+		}
+
+	 private:
+		explicit sha256_native_hash(detail::sha256_compress_fn compress) noexcept
+			: _compress(compress)
+		{}
+
+		static detail::sha256_compress_fn compressor(kernel k) noexcept {
+			switch (k)
+			{
+#ifdef HS_SHA256_X86_DISPATCH
+			case kernel::avx2:
+				return detail::sha256_compress_avx2;
+			case kernel::sha_ni:
+				return detail::sha256_compress_shani;
+#endif
+#ifdef HS_SHA256_ARMV8
+			case kernel::armv8:
+				return detail::sha256_compress_armv8;
+#endif
+			default:
+				return detail::sha256_compress_portable;
+			}
+		}
+
+		/**
+		 * @brief Pads the last `size` bytes of the message and compresses them.
+		 * @param state consumed
+		 * @param bytes length of the message
+		 */
+		static digest finish(detail::sha256_compress_fn compress, std::array<uint32_t, 8> &state,
+							 const uint8_t *tail, size_t size, uint64_t bytes) noexcept {
+			uint8_t blocks[128]{};
+			if (size)
+				std::memcpy(blocks, tail, size);
+			blocks[size] = 0x80;
+			// the 64-bit length must fit after the terminator
+			const size_t padded = size < 56 ? 64 : 128;
+			detail::store_be32(blocks + padded - 8, uint32_t(bytes >> 29));
+			detail::store_be32(blocks + padded - 4, uint32_t(bytes << 3));
+			compress(state.data(), blocks, padded / 64);
+
+			digest hash{};
+			for (size_t i = 0; i < state.size(); ++i)
+				detail::store_be32(hash.data() + i * 4, state[i]);
+			return hash;
+		}
+
+		detail::sha256_compress_fn _compress;
+		std::array<uint32_t, 8> _state = detail::sha256_iv;
+		uint64_t _bytes = 0;
+		// the first `_bytes % 64` bytes are the incomplete block
+		std::array<uint8_t, 64> _tail{};
+	};
+
+	/**
+	 * @brief Hashes independent messages entirely available, e.g. the short lines of a receive buffer.
+	 *
+	 * Full groups of the widest `sha256_batch` kernel are hashed side by side. The rest, e.g. a lone line,
+	 * is hashed one message at a time if the CPU has SHA instructions: a group with few lanes filled
+	 * costs as much as a full one. Without them, the rest is a partial group of the multi-lane kernel.
+	 * @param digests output, `count` digests in the order of `messages`
+	 */
+	inline void sha256_messages(const std::string_view *messages, size_t count, sha256_batch::digest *digests) noexcept {
+		static const bool hardware = [] {
+			const auto k = sha256_native_hash::best();
+			return k == sha256_native_hash::kernel::sha_ni || k == sha256_native_hash::kernel::armv8;
+		}();
+
+		const sha256_batch::kernel k = sha256_batch::best();
+		const size_t grouped = hardware ? count - count % sha256_batch::lanes(k) : count;
+		if (grouped)
+			sha256_batch::hash(k, messages, grouped, digests);
+		for (size_t i = grouped; i < count; ++i)
+			digests[i] = sha256_native_hash::hash(messages[i]);
+	}
+}
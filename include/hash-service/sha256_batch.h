@@ -0,0 +1,386 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <string_view>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HS_SHA256_VECTOR_LANES 1
+#define HS_SHA256_ALWAYS_INLINE __attribute__((always_inline)) inline
+#if defined(__x86_64__) || defined(__i386__)
+#define HS_SHA256_X86_DISPATCH 1
+#endif
+#else
+#define HS_SHA256_ALWAYS_INLINE inline
+#endif
+
+namespace hs {
+	namespace detail {
+		constexpr uint32_t sha256_k[64] = {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+		};
+
+		constexpr std::array<uint32_t, 8> sha256_iv = {
+			0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+		};
+
+		constexpr uint32_t rotr32(uint32_t x, int n) noexcept {
+			return (x >> n) | (x << (32 - n));
+		}
+
+		inline uint32_t load_be32(const uint8_t *p) noexcept {
+			return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+		}
+
+		inline void store_be32(uint8_t *p, uint32_t v) noexcept {
+			p[0] = uint8_t(v >> 24);
+			p[1] = uint8_t(v >> 16);
+			p[2] = uint8_t(v >> 8);
+			p[3] = uint8_t(v);
+		}
+
+		/**
+		 * @brief Portable SHA-256 compression function.
+		 * Always inlined, so that the instruction set is chosen by the target of the calling function.
+		 * @param state 8 words of the intermediate hash value
+		 * @param block 64 bytes of the message
+		 */
+		HS_SHA256_ALWAYS_INLINE void sha256_compress(uint32_t *state, const uint8_t *block) noexcept {
+			uint32_t w[64];
+			for (int t = 0; t < 16; ++t)
+				w[t] = load_be32(block + t * 4);
+			for (int t = 16; t < 64; ++t)
+			{
+				const uint32_t s0 = rotr32(w[t - 15], 7) ^ rotr32(w[t - 15], 18) ^ (w[t - 15] >> 3),
+					s1 = rotr32(w[t - 2], 17) ^ rotr32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+				w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+			}
+
+			uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+				e = state[4], f = state[5], g = state[6], h = state[7];
+			for (int t = 0; t < 64; ++t)
+			{
+				const uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) +
+					sha256_k[t] + w[t];
+				const uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+				h = g;
+				g = f;
+				f = e;
+				e = d + t1;
+				d = c;
+				c = b;
+				b = a;
+				a = t1 + t2;
+			}
+
+			state[0] += a;
+			state[1] += b;
+			state[2] += c;
+			state[3] += d;
+			state[4] += e;
+			state[5] += f;
+			state[6] += g;
+			state[7] += h;
+		}
+
+		/**
+		 * @return number of 64-byte blocks of a padded message of `size` bytes.
+		 */
+		constexpr size_t sha256_blocks(size_t size) noexcept {
+			return (size + 72) / 64;
+		}
+
+		/**
+		 * @brief Writes the `index`-th block of the padded message.
+		 */
+		inline void sha256_padded_block(std::string_view message, size_t index, uint8_t *block) noexcept {
+			const size_t offset = index * 64;
+			if (offset + 64 <= message.size())
+			{
+				std::memcpy(block, message.data() + offset, 64);
+				return;
+			}
+
+			std::memset(block, 0, 64);
+			if (offset <= message.size())
+			{
+				const size_t tail = message.size() - offset;
+				if (tail)
+					std::memcpy(block, message.data() + offset, tail);
+				block[tail] = 0x80;
+			}
+
+			if (index + 1 == sha256_blocks(message.size()))
+			{
+				const uint64_t bits = uint64_t(message.size()) * 8;
+				store_be32(block + 56, uint32_t(bits >> 32));
+				store_be32(block + 60, uint32_t(bits));
+			}
+		}
+
+		using sha256_digest = std::array<uint8_t, 32>;
+
+		inline void sha256_scalar(const std::string_view *messages, size_t count, sha256_digest *digests) noexcept {
+			uint8_t block[64];
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto state = sha256_iv;
+				for (size_t b = 0, blocks = sha256_blocks(messages[i].size()); b < blocks; ++b)
+				{
+					sha256_padded_block(messages[i], b, block);
+					sha256_compress(state.data(), block);
+				}
+				for (size_t w = 0; w < state.size(); ++w)
+					store_be32(digests[i].data() + w * 4, state[w]);
+			}
+		}
+
+#ifdef HS_SHA256_VECTOR_LANES
+		typedef uint32_t sha256_v4 __attribute__((vector_size(16)));
+		typedef uint32_t sha256_v8 __attribute__((vector_size(32)));
+		typedef uint32_t sha256_v16 __attribute__((vector_size(64)));
+
+		// macros rather than functions: passing wide vectors by value would depend on the enabled ISA
+#define HS_SHA256_VROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+		/**
+		 * @brief Multi-lane SHA-256: every lane of `V` hashes its own message.
+		 *
+		 * Written with generic vector extensions and always inlined, so that the instruction set is
+		 * chosen by the target of the calling function. Lanes with fewer blocks keep their state
+		 * unchanged while the longer messages are being processed.
+		 *
+		 * @tparam V vector of `Lanes` 32-bit words
+		 * @param messages up to `Lanes` messages
+		 * @param count number of messages
+		 * @param digests output, `count` digests
+		 */
+		template <typename V, size_t Lanes>
+		HS_SHA256_ALWAYS_INLINE void sha256_lanes(const std::string_view *messages, size_t count,
+												  sha256_digest *digests) noexcept {
+			static_assert(sizeof(V) == Lanes * sizeof(uint32_t));
+
+			size_t blocks[Lanes]{};
+			size_t maxBlocks = 0;
+			for (size_t lane = 0; lane < count; ++lane)
+			{
+				blocks[lane] = sha256_blocks(messages[lane].size());
+				maxBlocks = blocks[lane] > maxBlocks ? blocks[lane] : maxBlocks;
+			}
+
+			V state[8];
+			for (size_t i = 0; i < 8; ++i)
+				state[i] = V{} + sha256_iv[i];
+
+			alignas(64) uint32_t words[16][Lanes];
+			alignas(64) uint32_t activeLanes[Lanes];
+			uint8_t block[64];
+			for (size_t b = 0; b < maxBlocks; ++b)
+			{
+				for (size_t lane = 0; lane < Lanes; ++lane)
+				{
+					const bool active = b < blocks[lane];
+					activeLanes[lane] = active ? ~uint32_t(0) : 0;
+					if (active)
+						sha256_padded_block(messages[lane], b, block);
+					for (size_t t = 0; t < 16; ++t)
+						words[t][lane] = active ? load_be32(block + t * 4) : 0;
+				}
+
+				V w[16], mask;
+				for (size_t t = 0; t < 16; ++t)
+					std::memcpy(&w[t], words[t], sizeof(V));
+				std::memcpy(&mask, activeLanes, sizeof(V));
+
+				V a = state[0], b_ = state[1], c = state[2], d = state[3],
+					e = state[4], f = state[5], g = state[6], h = state[7];
+				for (size_t t = 0; t < 64; ++t)
+				{
+					if (t >= 16)
+					{
+						const V w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+						const V s0 = HS_SHA256_VROTR(w15, 7) ^ HS_SHA256_VROTR(w15, 18) ^ (w15 >> 3),
+							s1 = HS_SHA256_VROTR(w2, 17) ^ HS_SHA256_VROTR(w2, 19) ^ (w2 >> 10);
+						w[t & 15] = w[t & 15] + s0 + w[(t - 7) & 15] + s1;
+					}
+
+					const V t1 = h + (HS_SHA256_VROTR(e, 6) ^ HS_SHA256_VROTR(e, 11) ^ HS_SHA256_VROTR(e, 25)) +
+						((e & f) ^ (~e & g)) + sha256_k[t] + w[t & 15];
+					const V t2 = (HS_SHA256_VROTR(a, 2) ^ HS_SHA256_VROTR(a, 13) ^ HS_SHA256_VROTR(a, 22)) +
+						((a & b_) ^ (a & c) ^ (b_ & c));
+					h = g;
+					g = f;
+					f = e;
+					e = d + t1;
+					d = c;
+					c = b_;
+					b_ = a;
+					a = t1 + t2;
+				}
+
+				state[0] += a & mask;
+				state[1] += b_ & mask;
+				state[2] += c & mask;
+				state[3] += d & mask;
+				state[4] += e & mask;
+				state[5] += f & mask;
+				state[6] += g & mask;
+				state[7] += h & mask;
+			}
+
+			alignas(64) uint32_t out[8][Lanes];
+			for (size_t i = 0; i < 8; ++i)
+				std::memcpy(out[i], &state[i], sizeof(V));
+			for (size_t lane = 0; lane < count; ++lane)
+				for (size_t i = 0; i < 8; ++i)
+					store_be32(digests[lane].data() + i * 4, out[i][lane]);
+		}
+
+#undef HS_SHA256_VROTR
+
+		// SSE2 on x86-64, NEON on AArch64
+		inline void sha256_lanes_4(const std::string_view *messages, size_t count, sha256_digest *digests) noexcept {
+			sha256_lanes<sha256_v4, 4>(messages, count, digests);
+		}
+
+#ifdef HS_SHA256_X86_DISPATCH
+		__attribute__((target("avx2")))
+		inline void sha256_lanes_8(const std::string_view *messages, size_t count, sha256_digest *digests) noexcept {
+			sha256_lanes<sha256_v8, 8>(messages, count, digests);
+		}
+
+		__attribute__((target("avx512f")))
+		inline void sha256_lanes_16(const std::string_view *messages, size_t count, sha256_digest *digests) noexcept {
+			sha256_lanes<sha256_v16, 16>(messages, count, digests);
+		}
+#endif
+#endif
+	}
+
+	/**
+	 * @brief Multi-buffer SHA-256 engine.
+	 *
+	 * Hashes independent messages side by side, one message per SIMD lane:
+	 * 16 lanes with AVX-512, 8 with AVX2, 4 with SSE2/NEON, one at a time otherwise.
+	 * The kernel is selected upon the first use according to the CPU.
+	 * Intended for short messages that are entirely available, e.g. complete lines of a receive buffer.
+	 */
+	class sha256_batch
+	{
+	 public:
+		constexpr static size_t digest_length = 32;
+		using digest = std::array<uint8_t, digest_length>;
+
+		/**
+		 * Kernels, from the narrowest to the widest.
+		 */
+		enum class kernel {
+			scalar,
+			lanes_4,
+			lanes_8,
+			lanes_16
+		};
+
+		/**
+		 * @return `true` if the kernel can be used on this CPU.
+		 */
+		[[nodiscard]] static bool supported(kernel k) noexcept {
+			switch (k)
+			{
+			case kernel::scalar:
+				return true;
+#ifdef HS_SHA256_VECTOR_LANES
+			case kernel::lanes_4:
+				return true;
+#ifdef HS_SHA256_X86_DISPATCH
+			case kernel::lanes_8:
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("avx2");
+			case kernel::lanes_16:
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("avx512f");
+#endif
+#endif
+			default:
+				return false;
+			}
+		}
+
+		/**
+		 * @return the widest supported kernel.
+		 */
+		[[nodiscard]] static kernel best() noexcept {
+			static const kernel k = [] {
+				for (kernel candidate : {kernel::lanes_16, kernel::lanes_8, kernel::lanes_4})
+					if (supported(candidate))
+						return candidate;
+				return kernel::scalar;
+			}();
+			return k;
+		}
+
+		[[nodiscard]] constexpr static size_t lanes(kernel k) noexcept {
+			switch (k)
+			{
+			case kernel::lanes_4:
+				return 4;
+			case kernel::lanes_8:
+				return 8;
+			case kernel::lanes_16:
+				return 16;
+			default:
+				return 1;
+			}
+		}
+
+		/**
+		 * @brief Hashes `count` messages using the best kernel.
+		 * @param messages messages to hash
+		 * @param count number of messages
+		 * @param digests output, `count` digests in the order of `messages`
+		 */
+		static void hash(const std::string_view *messages, size_t count, digest *digests) noexcept {
+			hash(best(), messages, count, digests);
+		}
+
+		/**
+		 * @brief Hashes `count` messages using the given kernel.
+		 * @pre `supported(k)`
+		 */
+		static void hash(kernel k, const std::string_view *messages, size_t count, digest *digests) noexcept {
+			const size_t width = lanes(k);
+			for (size_t i = 0; i < count; i += width)
+			{
+				const size_t group = count - i < width ? count - i : width;
+				switch (k)
+				{
+#ifdef HS_SHA256_VECTOR_LANES
+				case kernel::lanes_4:
+					detail::sha256_lanes_4(messages + i, group, digests + i);
+					break;
+#ifdef HS_SHA256_X86_DISPATCH
+				case kernel::lanes_8:
+					detail::sha256_lanes_8(messages + i, group, digests + i);
+					break;
+				case kernel::lanes_16:
+					detail::sha256_lanes_16(messages + i, group, digests + i);
+					break;
+#endif
+#endif
+				default:
+					detail::sha256_scalar(messages + i, group, digests + i);
+					break;
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	/**
+	 * Session timeouts. Zero disables a timeout.
+	 */
+	struct timeout_policy
+	{
+		// nothing received from or written to the client
+		std::chrono::milliseconds idle{0};
+		// from the first byte of a line to its terminator
+		std::chrono::milliseconds line{0};
+		// a write has not completed
+		std::chrono::milliseconds write{0};
+		// granularity of the timing wheel
+		std::chrono::milliseconds resolution{100};
+	};
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_timeout_policy
+		{
+			constexpr timeout_policy operator()(const Config&) const noexcept {
+				return timeout_policy{};
+			}
+		};
+
+		template <typename Config>
+		struct _get_timeout_policy<Config, std::void_t<decltype(std::declval<Config>().timeouts)>>
+		{
+			constexpr timeout_policy operator()(const Config& c) const noexcept {
+				return c.timeouts;
+			}
+		};
+	}
+
+	template <typename Config>
+	constexpr static timeout_policy get_timeout_policy(const Config &c) noexcept {
+		return detail::_get_timeout_policy<std::decay_t<Config>>{}(c);
+	}
+
+	class coarse_clock;
+
+	namespace detail {
+		template <typename Config, typename = void>
+		struct _get_coarse_clock
+		{
+			constexpr const coarse_clock *operator()(const Config&) const noexcept {
+				return nullptr;
+			}
+		};
+
+		template <typename Config>
+		struct _get_coarse_clock<Config, std::void_t<decltype(std::declval<Config>().clock)>>
+		{
+			constexpr const coarse_clock *operator()(const Config& c) const noexcept {
+				return c.clock;
+			}
+		};
+	}
+
+	/**
+	 * @return clock of the timing wheel tracking the session, `nullptr` if timeouts are not tracked.
+	 */
+	template <typename Config>
+	constexpr static const coarse_clock *get_coarse_clock(const Config &c) noexcept {
+		return detail::_get_coarse_clock<std::decay_t<Config>>{}(c);
+	}
+
+	enum class timeout_kind {
+		idle,
+		line,
+		write
+	};
+
+	inline const char *to_string(timeout_kind kind) noexcept {
+		switch (kind)
+		{
+		case timeout_kind::idle:
+			return "idle";
+		case timeout_kind::line:
+			return "line";
+		default:
+			return "write";
+		}
+	}
+
+	/**
+	 * @brief Coarse clock of a timing wheel: number of ticks since the wheel has started.
+	 * Reading it is a relaxed atomic load.
+	 */
+	class coarse_clock
+	{
+	 public:
+		using tick_type = uint64_t;
+
+		explicit coarse_clock(std::chrono::milliseconds resolution) noexcept
+			: _resolution(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)),
+			  _start(std::chrono::steady_clock::now())
+		{}
+
+		[[nodiscard]] tick_type now() const noexcept {
+			return _ticks.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @return number of whole ticks in `d`, rounded up.
+		 */
+		[[nodiscard]] tick_type to_ticks(std::chrono::milliseconds d) const noexcept {
+			return tick_type((d.count() + _resolution.count() - 1) / _resolution.count());
+		}
+
+		[[nodiscard]] std::chrono::milliseconds resolution() const noexcept {
+			return _resolution;
+		}
+
+		/**
+		 * @brief Advances the clock according to the steady clock.
+		 * @return the current tick.
+		 */
+		tick_type update() noexcept {
+			const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - _start);
+			return set(tick_type(elapsed.count() / _resolution.count()));
+		}
+
+		/**
+		 * @brief Sets the current tick, for a clock driven externally.
+		 * @return `ticks`
+		 */
+		tick_type set(tick_type ticks) noexcept {
+			_ticks.store(ticks, std::memory_order_relaxed);
+			return ticks;
+		}
+
+	 private:
+		std::chrono::milliseconds _resolution;
+		std::chrono::steady_clock::time_point _start;
+		std::atomic<tick_type> _ticks{0};
+	};
+
+	/**
+	 * @brief Activity timestamps of a session.
+	 *
+	 * Every update is a single relaxed store of the coarse clock's tick, the timing wheel reads them
+	 * only when a session's slot is due. A default-constructed object tracks nothing.
+	 */
+	class session_activity
+	{
+	 public:
+		using tick_type = coarse_clock::tick_type;
+
+		session_activity() = default;
+
+		session_activity(const coarse_clock *clock, timeout_policy policy) noexcept
+			: _clock(clock),
+			  _idle(clock ? clock->to_ticks(policy.idle) : 0),
+			  _line(clock ? clock->to_ticks(policy.line) : 0),
+			  _write(clock ? clock->to_ticks(policy.write) : 0)
+		{
+			received();
+		}
+
+		void received() noexcept {
+			if (_clock)
+				_lastActivity.store(_clock->now(), std::memory_order_relaxed);
+		}
+
+		void line_started() noexcept {
+			if (_clock)
+				_lineStart.store(_clock->now() + 1, std::memory_order_relaxed);
+		}
+
+		void line_finished() noexcept {
+			_lineStart.store(0, std::memory_order_relaxed);
+		}
+
+		void write_started() noexcept {
+			if (_clock)
+				_writeStart.store(_clock->now() + 1, std::memory_order_relaxed);
+		}
+
+		void write_finished() noexcept {
+			_writeStart.store(0, std::memory_order_relaxed);
+			if (_clock)
+				_lastActivity.store(_clock->now(), std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] bool enabled() const noexcept {
+			return _clock && (_idle || _line || _write);
+		}
+
+		/**
+		 * @return the earliest moment a timeout may expire and its kind, `std::nullopt` if timeouts are not tracked.
+		 */
+		[[nodiscard]] std::optional<std::pair<tick_type, timeout_kind>> deadline() const noexcept {
+			if (!enabled())
+				return std::nullopt;
+
+			std::optional<std::pair<tick_type, timeout_kind>> earliest{};
+			const auto consider = [&earliest](tick_type deadline, timeout_kind kind) noexcept {
+				if (!earliest || deadline < earliest->first)
+					earliest.emplace(deadline, kind);
+			};
+
+			// started timestamps are stored with +1 to tell them from "not started".
+			// A line or a write that has not started yet may start any moment: the session is checked again
+			// no later than its timeout could expire, since the wheel does not learn about the start.
+			const tick_type now = _clock->now(),
+				writeStart = _writeStart.load(std::memory_order_relaxed),
+				lineStart = _lineStart.load(std::memory_order_relaxed);
+			if (_write)
+				consider(writeStart ? writeStart - 1 + _write : now + _write, timeout_kind::write);
+			if (_line)
+				consider(lineStart ? lineStart - 1 + _line : now + _line, timeout_kind::line);
+			// a session waiting for its output to be consumed is not idle
+			if (_idle)
+				consider((writeStart ? now : _lastActivity.load(std::memory_order_relaxed)) + _idle, timeout_kind::idle);
+			return earliest;
+		}
+
+	 private:
+		const coarse_clock *_clock = nullptr;
+		tick_type _idle = 0,
+			_line = 0,
+			_write = 0;
+		std::atomic<tick_type> _lastActivity{0},
+			_lineStart{0},
+			_writeStart{0};
+	};
+
+	/**
+	 * @brief Hierarchical timing wheel with lazy rescheduling.
+	 *
+	 * 4 levels of 64 slots: level `l` slot covers 64^l ticks. An entry is placed into the lowest level whose
+	 * current period contains its deadline and is moved down (cascaded) as the wheel advances.
+	 *
+	 * Entries are not rescheduled on activity: when an entry's slot is due, its deadline is queried again
+	 * and the entry either expires or is placed according to the new deadline. Hence, activity costs a
+	 * timestamp store and an entry is visited about once per timeout period.
+	 *
+	 * @threadsafe `add()` and `advance()` may be called from multiple threads.
+	 *
+	 * @tparam Handle copyable type providing
+	 * `std::optional<std::pair<tick_type, Kind>> deadline() const`, `std::nullopt` to drop the entry
+	 */
+	template <typename Handle>
+	class timing_wheel
+	{
+	 public:
+		using tick_type = coarse_clock::tick_type;
+
+		constexpr static size_t slot_bits = 6;
+		constexpr static size_t slots = size_t(1) << slot_bits;
+		constexpr static size_t levels = 4;
+
+		explicit timing_wheel(std::chrono::milliseconds resolution) noexcept
+			: _clock(resolution)
+		{}
+
+		timing_wheel(const timing_wheel&) = delete;
+		timing_wheel& operator=(const timing_wheel&) = delete;
+
+		[[nodiscard]] const coarse_clock &clock() const noexcept {
+			return _clock;
+		}
+
+		/**
+		 * @brief Adds an entry, scheduling it according to its current deadline.
+		 */
+		void add(Handle handle) {
+			std::lock_guard lock{_mutex};
+			const auto deadline = handle.deadline();
+			if (deadline)
+				place(std::move(handle), deadline->first);
+		}
+
+		/**
+		 * @brief Advances the wheel up to the current tick of the steady clock.
+		 * @param onExpired invoked with `(Handle&, kind)` for every expired entry, outside of the lock.
+		 */
+		template <typename F>
+		void advance(F &&onExpired) {
+			advance_to(std::nullopt, std::forward<F>(onExpired));
+		}
+
+		/**
+		 * @brief Advances the wheel up to the tick `now`, driving the coarse clock externally.
+		 */
+		template <typename F>
+		void advance(tick_type now, F &&onExpired) {
+			advance_to(now, std::forward<F>(onExpired));
+		}
+
+		/**
+		 * @return number of scheduled entries.
+		 */
+		[[nodiscard]] size_t size() const {
+			std::lock_guard lock{_mutex};
+			return _size;
+		}
+
+	 private:
+		using deadline_type = decltype(std::declval<const Handle&>().deadline());
+		using kind_type = typename deadline_type::value_type::second_type;
+		using expired_entry = std::pair<Handle, kind_type>;
+
+		template <typename F>
+		void advance_to(std::optional<tick_type> target, F &&onExpired) {
+			std::vector<expired_entry> expired{};
+			{
+				std::lock_guard lock{_mutex};
+				const tick_type now = target ? _clock.set(*target) : _clock.update();
+				while (_current < now)
+				{
+					++_current;
+					// higher levels first, so that their entries flow down
+					for (size_t level = levels - 1; level > 0; --level)
+					{
+						const size_t shift = level * slot_bits;
+						if (_current & ((tick_type(1) << shift) - 1))
+							continue;
+						reschedule(_wheel[level][(_current >> shift) & (slots - 1)], expired);
+					}
+					reschedule(_wheel[0][_current & (slots - 1)], expired);
+				}
+			}
+
+			for (auto &[handle, kind] : expired)
+				onExpired(handle, kind);
+		}
+
+		void place(Handle &&handle, tick_type deadline) {
+			if (deadline <= _current)
+				deadline = _current + 1;
+
+			size_t level = 0;
+			while (level + 1 < levels && (deadline >> ((level + 1) * slot_bits)) != (_current >> ((level + 1) * slot_bits)))
+				++level;
+
+			// beyond the top level: parked in the top level's first slot, which is visited only when the next
+			// top level period starts, then placed again
+			constexpr size_t top_shift = levels * slot_bits;
+			if ((deadline >> top_shift) != (_current >> top_shift))
+				deadline = ((_current >> top_shift) + 1) << top_shift;
+
+			_wheel[level][(deadline >> (level * slot_bits)) & (slots - 1)].push_back(std::move(handle));
+			++_size;
+		}
+
+		void reschedule(std::vector<Handle> &slot, std::vector<expired_entry> &expired) {
+			if (slot.empty())
+				return;
+
+			std::vector<Handle> due{};
+			due.swap(slot);
+			_size -= due.size();
+			for (auto &handle : due)
+			{
+				const auto deadline = handle.deadline();
+				if (!deadline)
+					continue;
+
+				if (deadline->first <= _current)
+					expired.emplace_back(std::move(handle), deadline->second);
+				else
+					place(std::move(handle), deadline->first);
+			}
+		}
+
+		coarse_clock _clock;
+		mutable std::mutex _mutex;
+		tick_type _current = 0;
+		size_t _size = 0;
+		std::array<std::array<std::vector<Handle>, slots>, levels> _wheel{};
+	};
+}
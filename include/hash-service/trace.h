@@ -0,0 +1,326 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * `1` compiles the tracepoints in, see `hs::trace()`. Otherwise they are removed entirely.
+ */
+#ifndef HS_TRACING
+#define HS_TRACING 0
+#endif
+
+namespace hs {
+	constexpr bool tracing_compiled = HS_TRACING != 0;
+
+	/**
+	 * @brief Tracepoints of the session state machine and of the server.
+	 *
+	 * Spans are a `_begin` event followed by its `_end` event, possibly on another thread.
+	 * Spans of a kind do not overlap within a session, spans of different kinds may.
+	 */
+	enum class trace_event : uint32_t
+	{
+		// a receive is pending, including the wait for the strand once readable
+		receive_begin,
+		receive_end,
+		// receiving paused by `resource_governor`
+		budget_begin,
+		budget_end,
+		// a turn of Encoding, the argument is the bytes to consume
+		encode_begin,
+		encode_end,
+		// a chunk hashed on the I/O thread, the argument is its bytes
+		update_begin,
+		update_end,
+		// short lines hashed side by side, the argument is the number of lines
+		batch_begin,
+		batch_end,
+		// from yielding a turn to the next turn
+		yield_begin,
+		yield_end,
+		// a chunk queued for the compute pool, the argument is its bytes
+		pool_queue_begin,
+		pool_queue_end,
+		// a chunk hashed by the compute pool, the argument is its bytes
+		pool_hash_begin,
+		pool_hash_end,
+		// from a chunk hashed by the compute pool to its completion on the session's strand
+		strand_queue_begin,
+		strand_queue_end,
+		// a write is pending, the argument is its bytes
+		write_begin,
+		write_end,
+		// instants: a connection accepted, a session registered, a line hashed, the argument is its bytes,
+		// a session destroyed
+		accepted,
+		registered,
+		line_hashed,
+		closed,
+		count_
+	};
+
+	namespace detail {
+		struct trace_event_info
+		{
+			std::string_view name;
+			// Chrome trace phase: async begin, end or instant
+			char phase;
+			// name of the argument, not exported if empty
+			std::string_view arg;
+		};
+
+		constexpr std::array<trace_event_info, size_t(trace_event::count_)> trace_event_info{{
+			{"receiving", 'b', ""}, {"receiving", 'e', ""},
+			{"waiting_for_budget", 'b', ""}, {"waiting_for_budget", 'e', ""},
+			{"encoding", 'b', "bytes"}, {"encoding", 'e', ""},
+			{"hash_update", 'b', "bytes"}, {"hash_update", 'e', ""},
+			{"hash_batch", 'b', "lines"}, {"hash_batch", 'e', ""},
+			{"turn_wait", 'b', ""}, {"turn_wait", 'e', ""},
+			{"pool_queue", 'b', "bytes"}, {"pool_queue", 'e', ""},
+			{"pool_hash", 'b', "bytes"}, {"pool_hash", 'e', ""},
+			{"strand_queue", 'b', ""}, {"strand_queue", 'e', ""},
+			{"responding", 'b', "bytes"}, {"responding", 'e', ""},
+			{"accepted", 'n', ""},
+			{"registered", 'n', ""},
+			{"line_hashed", 'n', "bytes"},
+			{"closed", 'n', ""},
+		}};
+
+		/**
+		 * Fields are written by the ring's thread and may be read by a dump meanwhile.
+		 */
+		struct trace_record
+		{
+			std::atomic<uint64_t> timestamp{0};
+			std::atomic<uint64_t> session{0};
+			std::atomic<uint64_t> arg{0};
+			std::atomic<uint64_t> event{0};
+		};
+
+		struct trace_entry
+		{
+			uint64_t timestamp;
+			uint64_t session;
+			uint64_t arg;
+			trace_event event;
+			size_t thread;
+		};
+
+		/**
+		 * @brief Ring of the latest records of a thread: a single writer, any number of readers.
+		 */
+		class trace_ring
+		{
+		 public:
+			constexpr static size_t capacity = 64 * 1024;
+
+			explicit trace_ring(size_t thread)
+				: _records(std::make_unique<trace_record[]>(capacity)),
+				  _thread(thread)
+			{}
+
+			void write(uint64_t timestamp, trace_event event, uint64_t session, uint64_t arg) noexcept {
+				const uint64_t head = _head.load(std::memory_order_relaxed);
+				// a copy seeing a field of this record sees the previous head: the record is not torn unnoticed
+				std::atomic_thread_fence(std::memory_order_release);
+				trace_record &record = _records[head % capacity];
+				record.timestamp.store(timestamp, std::memory_order_relaxed);
+				record.session.store(session, std::memory_order_relaxed);
+				record.arg.store(arg, std::memory_order_relaxed);
+				record.event.store(uint64_t(event), std::memory_order_relaxed);
+				_head.store(head + 1, std::memory_order_release);
+			}
+
+			/**
+			 * @brief Appends the records, skipping those overwritten while being copied,
+			 * the one being written included.
+			 */
+			void copy(std::vector<trace_entry> &entries) const {
+				const uint64_t head = _head.load(std::memory_order_acquire);
+				const uint64_t first = head > capacity ? head - capacity : 0;
+				const size_t copied = entries.size();
+				for (uint64_t i = first; i < head; ++i)
+				{
+					const trace_record &record = _records[i % capacity];
+					entries.push_back(trace_entry{record.timestamp.load(std::memory_order_relaxed),
+												  record.session.load(std::memory_order_relaxed),
+												  record.arg.load(std::memory_order_relaxed),
+												  trace_event(record.event.load(std::memory_order_relaxed)), _thread});
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				// the record at `written` may be being written, its slot is that of `written - capacity`
+				const uint64_t written = _head.load(std::memory_order_relaxed) + 1;
+				const uint64_t overwritten = written > capacity ? written - capacity : 0;
+				if (overwritten > first)
+				{
+					const auto iBegin = entries.begin() + std::ptrdiff_t(copied);
+					entries.erase(iBegin, iBegin + std::ptrdiff_t(std::min(overwritten, head) - first));
+				}
+			}
+
+		 private:
+			std::unique_ptr<trace_record[]> _records;
+			std::atomic<uint64_t> _head{0};
+			size_t _thread;
+		};
+
+		/**
+		 * @brief Rings of all the threads that have traced. Rings outlive their threads, so that they are dumped.
+		 */
+		class trace_rings
+		{
+		 public:
+			/**
+			 * @return a new ring, `nullptr` if out of memory.
+			 */
+			trace_ring *add() noexcept {
+				try
+				{
+					std::lock_guard lock{_mutex};
+					_rings.push_back(std::make_unique<trace_ring>(_rings.size()));
+					return _rings.back().get();
+				}
+				catch (const std::bad_alloc&)
+				{
+					return nullptr;
+				}
+			}
+
+			[[nodiscard]] std::vector<trace_entry> entries() const {
+				std::vector<trace_entry> entries{};
+				std::lock_guard lock{_mutex};
+				for (const auto &ring : _rings)
+					ring->copy(entries);
+				return entries;
+			}
+
+		 private:
+			mutable std::mutex _mutex;
+			std::vector<std::unique_ptr<trace_ring>> _rings;
+		};
+
+		inline trace_rings &trace_registry() noexcept {
+			static trace_rings rings{};
+			return rings;
+		}
+
+		inline trace_ring *this_thread_trace_ring() noexcept {
+			thread_local trace_ring *ring = trace_registry().add();
+			return ring;
+		}
+
+	}
+
+	/**
+	 * @return a new id of the spans of a session, never reused unlike the session's address. `0` if tracing
+	 * is not compiled in.
+	 */
+	inline uint64_t trace_session_id() noexcept {
+		if constexpr (tracing_compiled)
+		{
+			static std::atomic<uint64_t> lastId{0};
+			return lastId.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+		return 0;
+	}
+
+	/**
+	 * @brief Records the event into the calling thread's ring, if tracing is compiled in. Wait-free.
+	 * @param session id of the session's spans, see `trace_session_id()`, `0` for none
+	 */
+	inline void trace(trace_event event, uint64_t session, uint64_t arg = 0) noexcept {
+		if constexpr (tracing_compiled)
+		{
+			if (auto *ring = detail::this_thread_trace_ring())
+			{
+				const auto now = std::chrono::steady_clock::now().time_since_epoch();
+				ring->write(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()), event,
+							session, arg);
+			}
+		}
+	}
+
+	/**
+	 * @brief Span ending with the scope, e.g. a function with several exits.
+	 */
+	class trace_span
+	{
+	 public:
+		/**
+		 * @param begin `_begin` event of the span
+		 */
+		trace_span(trace_event begin, uint64_t session, uint64_t arg = 0) noexcept
+			: _end(trace_event(uint32_t(begin) + 1)),
+			  _session(session)
+		{
+			trace(begin, session, arg);
+		}
+
+		trace_span(const trace_span&) = delete;
+		trace_span& operator=(const trace_span&) = delete;
+
+		~trace_span() {
+			trace(_end, _session);
+		}
+
+	 private:
+		trace_event _end;
+		uint64_t _session;
+	};
+
+	/**
+	 * @brief Dumps the records of all the threads as a Chrome trace, for `chrome://tracing` or Perfetto.
+	 *
+	 * Spans are async events identified by the session, so that a span may end on another thread than
+	 * its beginning. Their category is their name: every kind of span of a session has its own track.
+	 * Threads are numbered in the order of their first record. Empty if tracing is not compiled in.
+	 * @throws std::bad_alloc
+	 */
+	inline std::string trace_json() {
+		if constexpr (!tracing_compiled)
+			return std::string();
+
+		auto entries = detail::trace_registry().entries();
+		std::stable_sort(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
+			return lhs.timestamp < rhs.timestamp;
+		});
+
+		std::string json{"{\"displayTimeUnit\":\"ns\",\"traceEvents\":["};
+		json.reserve(json.size() + entries.size() * 128);
+		const uint64_t origin = entries.empty() ? 0 : entries.front().timestamp;
+		bool first = true;
+		for (const auto &entry : entries)
+		{
+			if (size_t(entry.event) >= detail::trace_event_info.size())
+				continue;
+			const auto &info = detail::trace_event_info[size_t(entry.event)];
+			const uint64_t ns = entry.timestamp - origin;
+			std::string fraction = std::to_string(ns % 1000);
+			fraction.insert(0, 3 - fraction.size(), '0');
+
+			json.append(first ? "\n" : ",\n").append("{\"name\":\"").append(info.name)
+				.append("\",\"cat\":\"").append(info.name).append("\",\"ph\":\"").append(1, info.phase)
+				.append("\",\"id\":\"").append(std::to_string(entry.session))
+				.append("\",\"ts\":").append(std::to_string(ns / 1000)).append(".").append(fraction)
+				.append(",\"pid\":1,\"tid\":").append(std::to_string(entry.thread));
+			if (!info.arg.empty())
+				json.append(",\"args\":{\"").append(info.arg).append("\":").append(std::to_string(entry.arg)).append("}");
+			json.append("}");
+			first = false;
+		}
+		json.append("\n]}\n");
+		return json;
+	}
+}
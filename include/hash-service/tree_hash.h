@@ -0,0 +1,300 @@
+#pragma once
+
+#include <asio.hpp>
+#include <openssl/sha.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hs {
+	/**
+	 * @brief Checks whether `Hasher` spreads its work over a thread pool:
+	 * - `void set_pool(asio::thread_pool*) noexcept`
+	 */
+	template <typename Hasher, typename = void>
+	struct is_parallel : std::false_type
+	{};
+
+	template <typename Hasher>
+	struct is_parallel<Hasher, std::void_t<
+		decltype(std::declval<Hasher&>().set_pool(std::declval<asio::thread_pool*>()))>> : std::true_type
+	{};
+
+	template <typename Hasher>
+	constexpr static bool is_parallel_v = is_parallel<Hasher>::value;
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+	/**
+	 * @brief SHA-256 Merkle tree hasher: the leaves of a line are hashed in parallel.
+	 *
+	 * The digest is NOT the SHA-256 of the line. The line is split into `leaf_size` leaves, the last one possibly
+	 * shorter, an empty line being a single empty leaf. The root is computed as the Merkle Tree Hash of RFC 6962:
+	 * a leaf is `SHA-256(0x00 || leaf)`, a node is `SHA-256(0x01 || left || right)`, the left subtree holding
+	 * the largest power of two of the leaves.
+	 *
+	 * `update()` hashes the complete leaves of a chunk on the pool set by `set_pool()`, the calling thread included,
+	 * and returns once they are hashed. A thread out of the pool, e.g. an I/O thread hashing a chunk below
+	 * the offload threshold, hashes fewer than `parallel_leaves` leaves by itself. Subtrees are merged as soon as they are complete: the state is a leaf
+	 * in progress and at most 64 subtree roots.
+	 */
+	class sha256_tree_hash
+	{
+	 public:
+		constexpr static size_t digest_length = SHA256_DIGEST_LENGTH;
+		constexpr static size_t leaf_size = 16 * 1024;
+		// leaves of a chunk from which a thread out of the pool hands them to the pool
+		constexpr static size_t parallel_leaves = 8;
+		using digest = std::array<uint8_t, digest_length>;
+
+		sha256_tree_hash(const sha256_tree_hash&) = delete;
+		sha256_tree_hash& operator=(const sha256_tree_hash&) = delete;
+
+		sha256_tree_hash(sha256_tree_hash&&) noexcept = default;
+		sha256_tree_hash& operator=(sha256_tree_hash&&) noexcept = default;
+
+		static std::optional<sha256_tree_hash> create() noexcept {
+			try
+			{
+				sha256_tree_hash hash{};
+				hash._subtrees.reserve(64);
+				return hash;
+			}
+			catch (...)
+			{
+				return std::nullopt;
+			}
+		}
+
+		/**
+		 * @param pool threads hashing the leaves along with the caller of `update()`, hashing is serial if not set
+		 */
+		void set_pool(asio::thread_pool *pool) noexcept {
+			_pool = pool;
+		}
+
+		bool update(std::string_view str) noexcept {
+			if (_leafBytes)
+			{
+				const size_t bytes = std::min(leaf_size - _leafBytes, str.size());
+				if (!SHA256_Update(&_leaf, str.data(), bytes))
+					return false;
+				_leafBytes += bytes;
+				str.remove_prefix(bytes);
+				if (_leafBytes == leaf_size && !finish_leaf())
+					return false;
+			}
+
+			const size_t leaves = str.size() / leaf_size;
+			if (leaves && !hash_leaves(str.substr(0, leaves * leaf_size), leaves))
+				return false;
+			str.remove_prefix(leaves * leaf_size);
+
+			if (str.empty())
+				return true;
+			if (!start_leaf() || !SHA256_Update(&_leaf, str.data(), str.size()))
+				return false;
+			_leafBytes = str.size();
+			return true;
+		}
+
+		auto finalize() noexcept -> std::optional<digest> {
+			// the rest of the line, or the empty leaf of an empty line
+			if (_leafBytes || _subtrees.empty())
+			{
+				if ((!_leafBytes && !start_leaf()) || !finish_leaf())
+				{
+					reset();
+					return std::nullopt;
+				}
+			}
+
+			digest root = _subtrees.back().root;
+			for (size_t i = _subtrees.size() - 1; i > 0; --i)
+				root = node(_subtrees[i - 1].root, root);
+			reset();
+			return root;
+		}
+
+		/**
+		 * @return digest of an inner node of the tree.
+		 */
+		static digest node(const digest &left, const digest &right) noexcept {
+			constexpr uint8_t prefix = 0x01;
+			SHA256_CTX context{};
+			digest hash{};
+			SHA256_Init(&context);
+			SHA256_Update(&context, &prefix, 1);
+			SHA256_Update(&context, left.data(), left.size());
+			SHA256_Update(&context, right.data(), right.size());
+			SHA256_Final(hash.data(), &context);
+			return hash;
+		}
+
+		/**
+		 * @return digest of a leaf of the tree.
+		 */
+		static digest leaf(std::string_view data) noexcept {
+			constexpr uint8_t prefix = 0x00;
+			SHA256_CTX context{};
+			digest hash{};
+			SHA256_Init(&context);
+			SHA256_Update(&context, &prefix, 1);
+			SHA256_Update(&context, data.data(), data.size());
+			SHA256_Final(hash.data(), &context);
+			return hash;
+		}
+
+	 private:
+		struct subtree
+		{
+			digest root;
+			// the subtree holds 2^height leaves
+			unsigned height;
+		};
+
+		/**
+		 * Leaves of a chunk shared with the pool: threads claim them one by one.
+		 * Leaves claimed by a pool thread are waited for, those never claimed are hashed by the caller,
+		 * so that a busy pool never blocks `update()`.
+		 */
+		struct leaf_batch
+		{
+			std::string_view data;
+			std::vector<digest> digests;
+			std::atomic<size_t> next{0};
+			size_t hashed = 0;
+			std::mutex mutex;
+			std::condition_variable allHashed;
+
+			void hash_claimed() noexcept {
+				size_t count = 0;
+				while (true)
+				{
+					const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+					if (i >= digests.size())
+						break;
+					digests[i] = leaf(data.substr(i * leaf_size, leaf_size));
+					++count;
+				}
+				if (!count)
+					return;
+
+				std::lock_guard lock{mutex};
+				hashed += count;
+				if (hashed == digests.size())
+					allHashed.notify_one();
+			}
+		};
+
+		sha256_tree_hash() = default;
+
+		bool start_leaf() noexcept {
+			constexpr uint8_t prefix = 0x00;
+			return SHA256_Init(&_leaf) && SHA256_Update(&_leaf, &prefix, 1);
+		}
+
+		bool finish_leaf() noexcept {
+			digest hash{};
+			if (!SHA256_Final(hash.data(), &_leaf))
+				return false;
+			_leafBytes = 0;
+			add_leaf(hash);
+			return true;
+		}
+
+		/**
+		 * @return `true` if the leaves are worth handing to the pool: the caller is a thread of the pool,
+		 * or they are enough to pay for waking the threads up. An I/O thread does not wait for the pool otherwise.
+		 */
+		[[nodiscard]] bool fanning_out(size_t leaves) const noexcept {
+			return _pool && leaves > 1 &&
+				(leaves >= parallel_leaves || _pool->get_executor().running_in_this_thread());
+		}
+
+		bool hash_leaves(std::string_view data, size_t leaves) noexcept {
+			if (!fanning_out(leaves))
+			{
+				for (size_t i = 0; i < leaves; ++i)
+					add_leaf(leaf(data.substr(i * leaf_size, leaf_size)));
+				return true;
+			}
+
+			std::shared_ptr<leaf_batch> batch{};
+			try
+			{
+				// helpers of a previous chunk may still hold their batch, they claim no leaf of it though
+				if (!_batch || _batch.use_count() > 1)
+					_batch = std::make_shared<leaf_batch>();
+				batch = _batch;
+				batch->data = data;
+				batch->next.store(0, std::memory_order_relaxed);
+				batch->hashed = 0;
+				batch->digests.resize(leaves);
+				const size_t helpers = std::min<size_t>(leaves - 1, std::max(std::thread::hardware_concurrency(), 1u));
+				for (size_t i = 0; i < helpers; ++i)
+					asio::post(*_pool, [batch]{ batch->hash_claimed(); });
+			}
+			catch (...)
+			{
+				if (!batch || batch->digests.size() != leaves)
+					return false;
+				// hashed by the posted helpers, if any, and the caller
+			}
+
+			batch->hash_claimed();
+			{
+				std::unique_lock lock{batch->mutex};
+				batch->allHashed.wait(lock, [&batch]{ return batch->hashed == batch->digests.size(); });
+			}
+			for (const auto &hash : batch->digests)
+				add_leaf(hash);
+			return true;
+		}
+
+		void add_leaf(digest hash) noexcept {
+			unsigned height = 0;
+			while (!_subtrees.empty() && _subtrees.back().height == height)
+			{
+				hash = node(_subtrees.back().root, hash);
+				_subtrees.pop_back();
+				++height;
+			}
+			// never reallocates: there are 64 heights at most
+			_subtrees.push_back(subtree{hash, height});
+		}
+
+		void reset() noexcept {
+			_leafBytes = 0;
+			_subtrees.clear();
+		}
+
+		SHA256_CTX _leaf{};
+		// bytes of the leaf in progress
+		size_t _leafBytes = 0;
+		// roots of the complete subtrees, the leftmost and highest first
+		std::vector<subtree> _subtrees;
+		asio::thread_pool *_pool = nullptr;
+		// reused by the chunks, unless still held by the helpers of the previous one
+		std::shared_ptr<leaf_batch> _batch;
+	};
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+}
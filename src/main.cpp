@@ -1,31 +1,232 @@
-
 #ifdef DEBUG_ASIO
 #define ASIO_ENABLE_HANDLER_TRACKING
 #endif
 
+#include "hash-service/admin.h"
 #include "hash-service/server.h"
+#include "hash-service/hashers.h"
+#include "hash-service/runtime.h"
 #include "hash-service/logging.h"
 
 #include <asio.hpp>
 
+#include <algorithm>
+#include <fstream>
 #include <thread>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <optional>
+
+namespace {
+	constexpr const char signature[] = "signature: server [port = 23] "
+									   "[--hash=<algorithm>] "
+									   "[--protocol=text|binary] [--listen=<port>:<algorithm>[:binary][:<class>]]... "
+									   "[--flush=immediate|batch|<bytes>,<microseconds>] "
+									   "[--nodelay=on|off] "
+									   "[--threads=<count>] [--mode=shared|sharded] "
+									   "[--compute-threads=<count>] [--offload-threshold=<bytes>] [--max-in-flight=<buffers>] "
+									   "[--max-receive-buffer=<bytes>] "
+									   "[--checkpoint-interval=<bytes>] [--checkpoint-dir=<path>] "
+									   "[--digest-cache=<bytes>] [--digest-cache-line=<bytes>] "
+									   "[--quantum=<bytes>] [--bulk-quantum=<bytes>] [--turn-budget=<microseconds>] "
+									   "[--class=<class>] [--bulk-line=<bytes>] "
+									   "[--max-sessions=<count>] [--memory-budget=<bytes>] [--max-pending-output=<bytes>] "
+									   "[--idle-timeout=<ms>] [--line-timeout=<ms>] [--write-timeout=<ms>] "
+									   "[--log=stdout|stderr|sync|<path>] [--log-level=none|errors|warnings|messages] "
+									   "[--admin=<port>] [--trace-file=<path>]\n"
+									   "algorithms: sha256 (default), sha256-resumable, sha256-tree, sha512-256, blake3, xxh3-128\n"
+									   "classes: latency, bulk, adaptive (default)\n";
+
+	struct listener
+	{
+		uint16_t port;
+		hs::hash_algorithm algorithm;
+		hs::wire_protocol protocol = hs::wire_protocol::text;
+		// `--class` if not set
+		std::optional<hs::class_mode> classes;
+	};
+
+	struct options
+	{
+		uint16_t port = 23;
+		hs::hash_algorithm algorithm = hs::hash_algorithm::sha256;
+		hs::wire_protocol protocol = hs::wire_protocol::text;
+		std::vector<listener> extraListeners;
+		hs::output_policy output{};
+		hs::runtime_config runtime{};
+		std::optional<size_t> computeThreads;
+		size_t offloadThreshold = hs::compute_policy{}.threshold;
+		size_t maxInFlight = hs::compute_policy{}.max_in_flight;
+		hs::receive_policy receive{};
+		uint64_t checkpointInterval = hs::checkpoint_policy{}.interval;
+		// checkpoints evicted from memory are dropped if empty
+		std::string checkpointDir;
+		// short lines are not cached if 0
+		size_t digestCache = 0;
+		size_t digestCacheLine = hs::digest_cache::config{}.max_line;
+		// `classes` is the class of the main port and the default of the other ones
+		hs::scheduling_policy scheduling{};
+		// no limits if both are 0
+		hs::resource_governor::config limits{};
+		// idle connections are kept: clients may hold many of them open for long
+		hs::timeout_policy timeouts{std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::seconds(10)};
+		std::string log = "stdout";
+		hs::log_level logLevel = hs::log_level::errors | hs::log_level::warnings | hs::log_level::messages;
+		// local port of the metrics endpoint, metrics are not recorded if not set
+		std::optional<uint16_t> adminPort;
+		// written on SIGUSR1 if tracing is compiled in
+		std::string traceFile = "hash-service-trace.json";
+	};
+
+	/**
+	 * @throws std::invalid_argument if an argument is not recognized or has an invalid value
+	 */
+	options parse_options(int argc, char **argv);
+
+	/**
+	 * @brief Dumps the tracepoints as a Chrome trace to the file on every signal of the set.
+	 */
+	void dump_trace_on_signal(asio::signal_set &signals, const std::string &path) {
+		signals.async_wait([&signals, &path](asio::error_code errorCode, int /*sig*/){
+			if (errorCode)
+				return;
+
+			std::ofstream file{path, std::ios::trunc};
+			file << hs::trace_json();
+			std::cout << (file ? "trace dumped to: " : "failed to dump the trace to: ") << path << '\n';
+			dump_trace_on_signal(signals, path);
+		});
+	}
+
+	/**
+	 * @brief Starts a server for the listener's algorithm.
+	 * @return handler stopping the server. Owns the server.
+	 */
+	std::function<void()> start_server(asio::io_context &ioContext, const listener &l, const options &opts,
+									   asio::thread_pool *computePool, const hs::leveled_logger &logger,
+									   hs::metrics *metrics, hs::checkpoint_store *checkpoints,
+									   hs::digest_cache *digests, hs::resource_governor *governor) {
+		const bool reusePort = opts.runtime.mode == hs::runtime_mode::sharded;
+		hs::scheduling_policy scheduling = opts.scheduling;
+		scheduling.classes = l.classes.value_or(opts.scheduling.classes);
+		return hs::visit_hash_algorithm(l.algorithm, [&](auto tag) -> std::function<void()> {
+			using server = hs::basic_server<typename decltype(tag)::type>;
+			auto hashServer = std::make_shared<server>(ioContext, typename server::config{l.port,
+																						   opts.timeouts,
+																						   logger,
+																						   opts.output,
+																						   hs::compute_policy{computePool,
+																											  opts.offloadThreshold,
+																											  opts.maxInFlight},
+																						   opts.receive,
+																						   reusePort,
+																						   metrics,
+																						   hs::checkpoint_policy{checkpoints,
+																												 opts.checkpointInterval},
+																						   digests,
+																						   l.protocol,
+																						   scheduling,
+																						   governor});
+			return [hashServer]{ hashServer->stop(); };
+		});
+	}
+}
 
 int main(int argc, char **argv) {
 	try {
-		const uint16_t port = argc < 2 ? 23 :
-			std::stoi(argv[1]);
+		const options opts = parse_options(argc, argv);
+
+		// outlives the servers and their sessions
+		std::optional<hs::log_backend> logBackend{};
+		if (opts.log == "stdout")
+			logBackend.emplace(stdout);
+		else if (opts.log == "stderr")
+			logBackend.emplace(stderr);
+		else if (opts.log != "sync")
+			logBackend.emplace(opts.log);
+		const hs::leveled_logger logger{opts.logLevel, logBackend ? &*logBackend : nullptr};
+
+		// hashing of long lines, outlives the sessions
+		const size_t computeThreads = opts.computeThreads.value_or(std::thread::hardware_concurrency());
+		std::optional<asio::thread_pool> computePool{};
+		if (computeThreads)
+			computePool.emplace(computeThreads);
+
+		// outlives the servers and their sessions
+		std::optional<hs::metrics> metrics{};
+		if (opts.adminPort)
+			metrics.emplace();
+
+		// outlives the servers and their sessions, for the resumable listeners
+		std::optional<hs::checkpoint_store> checkpoints{};
+		const auto isResumable = [](const listener &l) { return l.algorithm == hs::hash_algorithm::sha256_resumable; };
+		if (isResumable(listener{opts.port, opts.algorithm, opts.protocol, std::nullopt}) ||
+			std::any_of(opts.extraListeners.cbegin(), opts.extraListeners.cend(), isResumable))
+		{
+			hs::checkpoint_store::config storeConfig{};
+			storeConfig.directory = opts.checkpointDir;
+			checkpoints.emplace(std::move(storeConfig));
+		}
+
+		// outlives the servers and their sessions, shared by the sha256 listeners
+		std::optional<hs::digest_cache> digests{};
+		if (opts.digestCache)
+		{
+			hs::digest_cache::config cacheConfig{};
+			cacheConfig.capacity = opts.digestCache;
+			cacheConfig.max_line = opts.digestCacheLine;
+			digests.emplace(cacheConfig);
+		}
 
-		// TODO: (?) separate non-io task handling to asio::thread_pool
-		asio::io_context ioContext{int(std::thread::hardware_concurrency())};
-		hs::server hashServer{ioContext, hs::server::config{port,
-															std::chrono::seconds(10),
+		// outlives the servers and their sessions, shared by all the servers
+		std::optional<hs::resource_governor> governor{};
+		if (opts.limits.max_sessions || opts.limits.max_bytes)
+			governor.emplace(opts.limits);
 
-															// TODO: log level from CLI
-															hs::std_ostream_logger()}};
+		hs::runtime runtime{opts.runtime};
+		std::cout << "io backend: " << hs::io_backend() << ", io threads: " << runtime.threads()
+			<< ", io contexts: " << runtime.shards()
+			<< ", compute threads: " << computeThreads << '\n';
+
+		// in the sharded mode every io_context has its own servers
+		std::vector<std::function<void()>> stopServers{};
+		for (size_t shard = 0; shard < runtime.shards(); ++shard)
+		{
+			asio::io_context &ioContext = runtime.context(shard);
+			asio::thread_pool *pool = computePool ? &*computePool : nullptr;
+			hs::metrics *serverMetrics = metrics ? &*metrics : nullptr;
+			hs::checkpoint_store *store = checkpoints ? &*checkpoints : nullptr;
+			hs::digest_cache *cache = digests ? &*digests : nullptr;
+			const listener mainListener{opts.port, opts.algorithm, opts.protocol, std::nullopt};
+			hs::resource_governor *limits = governor ? &*governor : nullptr;
+			stopServers.push_back(start_server(ioContext, mainListener, opts, pool, logger, serverMetrics, store, cache,
+											   limits));
+			for (const auto &l : opts.extraListeners)
+				stopServers.push_back(start_server(ioContext, l, opts, pool, logger, serverMetrics, store, cache, limits));
+		}
+
+		if (metrics)
+		{
+			auto admin = std::make_shared<hs::admin_server>(runtime.context(0),
+														   hs::admin_server::config{*opts.adminPort, &*metrics, logger});
+			stopServers.push_back([admin]{ admin->stop(); });
+		}
+
+		asio::io_context &ioContext = runtime.context(0);
+		// cancelled on SIGINT, so that the io_context runs out of work
+		std::optional<asio::signal_set> traceSignals{};
+#ifdef SIGUSR1
+		if constexpr (hs::tracing_compiled)
+		{
+			traceSignals.emplace(ioContext, SIGUSR1);
+			dump_trace_on_signal(*traceSignals, opts.traceFile);
+		}
+#endif
 
 		asio::signal_set signals{ioContext, SIGINT};
-		signals.async_wait([&hashServer, &ioContext](asio::error_code /*errorCode*/, int sig){
+		signals.async_wait([&stopServers, &ioContext, &traceSignals](asio::error_code /*errorCode*/, int sig){
 			std::stringstream ss{};
 			ss << "[thread:" << std::this_thread::get_id() << "] handling a signal: " << sig << '\n';
 
@@ -33,15 +234,20 @@ int main(int argc, char **argv) {
 			if (sig == SIGINT)
 			{
 				std::cout << "SIGINT\n";
-				asio::post(ioContext, [&hashServer]{hashServer.stop();});
+				if (traceSignals)
+					traceSignals->cancel();
+				asio::post(ioContext, [&stopServers]{
+					for (auto &stop : stopServers)
+						stop();
+				});
 			}
 		});
 
-		ioContext.run();
+		runtime.run();
 	}
-	catch (const std::invalid_argument &)
+	catch (const std::invalid_argument &e)
 	{
-		std::cerr << "invalid port.\nsignature: server [port = 23]\n";
+		std::cerr << "invalid argument: " << e.what() << '\n' << signature;
 		return 0;
 	}
 	catch (const std::exception &e)
@@ -52,4 +258,180 @@ int main(int argc, char **argv) {
 
 	std::cout << "THE END!\n";
 	return 0;
-}
\ No newline at end of file
+}
+
+namespace {
+	hs::flush_policy parse_flush_policy(std::string_view value) {
+		if (value == "immediate")
+			return hs::flush_policy{hs::flush_mode::immediate};
+		if (value == "batch")
+			return hs::flush_policy{hs::flush_mode::end_of_batch};
+
+		const size_t iComma = value.find(',');
+		if (iComma == std::string_view::npos)
+			throw std::invalid_argument(std::string("--flush=") + std::string(value));
+
+		return hs::flush_policy{hs::flush_mode::threshold,
+								std::stoul(std::string(value.substr(0, iComma))),
+								std::chrono::microseconds(std::stol(std::string(value.substr(iComma + 1))))};
+	}
+
+	hs::hash_algorithm parse_algorithm(std::string_view value) {
+		const auto algorithm = hs::parse_hash_algorithm(value);
+		if (!algorithm)
+			throw std::invalid_argument(std::string("unknown or unsupported hash algorithm: ") + std::string(value));
+		return *algorithm;
+	}
+
+	hs::wire_protocol parse_protocol(std::string_view value) {
+		const auto protocol = hs::parse_wire_protocol(value);
+		if (!protocol)
+			throw std::invalid_argument(std::string("unknown protocol: ") + std::string(value));
+		return *protocol;
+	}
+
+	hs::class_mode parse_class(std::string_view value) {
+		const auto classes = hs::parse_class_mode(value);
+		if (!classes)
+			throw std::invalid_argument(std::string("unknown class: ") + std::string(value));
+		return *classes;
+	}
+
+	listener parse_listener(std::string_view value) {
+		const size_t iColon = value.find(':');
+		if (iColon == std::string_view::npos)
+			throw std::invalid_argument(std::string("--listen=") + std::string(value));
+
+		const std::string_view port = value.substr(0, iColon);
+		std::string_view rest = value.substr(iColon + 1);
+		size_t iOption = rest.find(':');
+		listener l{uint16_t(std::stoi(std::string(port))), parse_algorithm(rest.substr(0, iOption)),
+				   hs::wire_protocol::text, std::nullopt};
+		// a protocol and a class, in any order
+		while (iOption != std::string_view::npos)
+		{
+			rest.remove_prefix(iOption + 1);
+			iOption = rest.find(':');
+			const std::string_view option = rest.substr(0, iOption);
+			if (hs::parse_wire_protocol(option))
+				l.protocol = parse_protocol(option);
+			else
+				l.classes = parse_class(option);
+		}
+		return l;
+	}
+
+	hs::runtime_mode parse_runtime_mode(std::string_view value) {
+		const auto mode = hs::parse_runtime_mode(value);
+		if (!mode)
+			throw std::invalid_argument(std::string("--mode=") + std::string(value));
+		return *mode;
+	}
+
+	hs::log_level parse_log_level(std::string_view value) {
+		if (value == "none")
+			return hs::log_level(0);
+		if (value == "errors")
+			return hs::log_level::errors;
+		if (value == "warnings")
+			return hs::log_level::errors | hs::log_level::warnings;
+		if (value == "messages")
+			return hs::log_level::errors | hs::log_level::warnings | hs::log_level::messages;
+		throw std::invalid_argument(std::string("--log-level=") + std::string(value));
+	}
+
+	bool parse_switch(std::string_view name, std::string_view value) {
+		if (value == "on")
+			return true;
+		if (value == "off")
+			return false;
+		throw std::invalid_argument(std::string(name) + "=" + std::string(value));
+	}
+
+	options parse_options(int argc, char **argv) {
+		options opts{};
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string_view arg{argv[i]};
+			if (arg.substr(0, 2) != "--")
+			{
+				if (i != 1)
+					throw std::invalid_argument(std::string(arg));
+				opts.port = uint16_t(std::stoi(std::string(arg)));
+				continue;
+			}
+
+			const size_t iEq = arg.find('=');
+			const std::string_view name = arg.substr(0, iEq),
+				value = iEq == std::string_view::npos ? std::string_view() : arg.substr(iEq + 1);
+
+			if (name == "--hash")
+				opts.algorithm = parse_algorithm(value);
+			else if (name == "--protocol")
+				opts.protocol = parse_protocol(value);
+			else if (name == "--listen")
+				opts.extraListeners.push_back(parse_listener(value));
+			else if (name == "--flush")
+				opts.output.flush = parse_flush_policy(value);
+			else if (name == "--nodelay")
+				opts.output.no_delay = parse_switch(name, value);
+			else if (name == "--threads")
+				opts.runtime.threads = std::stoul(std::string(value));
+			else if (name == "--mode")
+				opts.runtime.mode = parse_runtime_mode(value);
+			else if (name == "--compute-threads")
+				opts.computeThreads = std::stoul(std::string(value));
+			else if (name == "--offload-threshold")
+				opts.offloadThreshold = std::stoul(std::string(value));
+			else if (name == "--max-in-flight")
+				opts.maxInFlight = std::stoul(std::string(value));
+			else if (name == "--max-receive-buffer")
+			{
+				opts.receive.max_size = std::stoul(std::string(value));
+				if (opts.receive.max_size > hs::buffer_pool::max_size)
+					throw std::invalid_argument(std::string(arg));
+			}
+			else if (name == "--checkpoint-interval")
+				opts.checkpointInterval = std::stoull(std::string(value));
+			else if (name == "--checkpoint-dir")
+				opts.checkpointDir = std::string(value);
+			else if (name == "--digest-cache")
+				opts.digestCache = std::stoul(std::string(value));
+			else if (name == "--digest-cache-line")
+				opts.digestCacheLine = std::stoul(std::string(value));
+			else if (name == "--quantum")
+				opts.scheduling.quantum = std::stoul(std::string(value));
+			else if (name == "--bulk-quantum")
+				opts.scheduling.bulk_quantum = std::stoul(std::string(value));
+			else if (name == "--turn-budget")
+				opts.scheduling.time_budget = std::chrono::microseconds(std::stoul(std::string(value)));
+			else if (name == "--class")
+				opts.scheduling.classes = parse_class(value);
+			else if (name == "--bulk-line")
+				opts.scheduling.bulk_line = std::stoull(std::string(value));
+			else if (name == "--max-sessions")
+				opts.limits.max_sessions = std::stoul(std::string(value));
+			else if (name == "--memory-budget")
+				opts.limits.max_bytes = std::stoul(std::string(value));
+			else if (name == "--max-pending-output")
+				opts.output.max_pending = std::stoul(std::string(value));
+			else if (name == "--idle-timeout")
+				opts.timeouts.idle = std::chrono::milliseconds(std::stoul(std::string(value)));
+			else if (name == "--line-timeout")
+				opts.timeouts.line = std::chrono::milliseconds(std::stoul(std::string(value)));
+			else if (name == "--write-timeout")
+				opts.timeouts.write = std::chrono::milliseconds(std::stoul(std::string(value)));
+			else if (name == "--log")
+				opts.log = std::string(value);
+			else if (name == "--log-level")
+				opts.logLevel = parse_log_level(value);
+			else if (name == "--admin")
+				opts.adminPort = uint16_t(std::stoi(std::string(value)));
+			else if (name == "--trace-file")
+				opts.traceFile = std::string(value);
+			else
+				throw std::invalid_argument(std::string(arg));
+		}
+		return opts;
+	}
+}
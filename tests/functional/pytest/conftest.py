@@ -11,6 +11,12 @@ def pytest_addoption(parser):
         type=pathlib.Path,
         help="Path to the local server's executable"
     )
+    parser.addoption(
+        "--load_generator",
+        action="store",
+        type=pathlib.Path,
+        help="Path to the load generator's executable"
+    )
     parser.addoption(
         "--server_ip",
         action="store",
@@ -40,6 +46,14 @@ def local_server(request):
     return server_executable
 
 
+@pytest.fixture
+def load_generator(request):
+    load_generator_executable = request.config.option.load_generator
+
+    assert load_generator_executable.exists(), f"'{load_generator_executable}' doesn't exist"
+    return load_generator_executable
+
+
 @pytest.fixture
 def server_executable(request):
     return request.config.option.server_executable
@@ -0,0 +1,44 @@
+import json
+import subprocess
+import time
+from pathlib import Path
+
+import pytest
+
+from test_local_server import kill_server
+
+
+@pytest.mark.parametrize('load_args', [['--connections=8', '--lines=2000', '--size=uniform:1,1024'],
+                                       ['--connections=4', '--lines=1000', '--size=lognormal:64,2', '--pipeline=1'],
+                                       ['--connections=2', '--lines=2', '--size=fixed:8M', '--threads=2'],
+                                       ['--connections=4', '--lines=64', '--size=uniform:1,512K', '--pipeline=4']],
+                         ids=['uniform', 'lognormal-unpipelined', 'long-lines', 'mixed-long-lines'])
+def test_load_generator(local_server: Path, load_generator: Path, server_port: int, load_args: list):
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--log-level=errors']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        load = subprocess.run(
+            [load_generator, f'--port={server_port}', f'--server-pid={server_process.pid}', '--format=json'] + load_args,
+            capture_output=True, text=True, timeout=60
+        )
+        assert load.returncode == 0, f'load generator failed: {load.stdout}{load.stderr}'
+
+        report = json.loads(load.stdout)
+        assert report['mismatches'] == 0
+        assert report['errors'] == 0
+        assert report['latency_us']['p50'] <= report['latency_us']['p999']
+        assert report['server_peak_rss_kib'] > 0
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
@@ -108,9 +108,13 @@ def create_tcp_connection(server_port, rand_seed: int):
         return ResultSingleLine(rand_seed, error=e)
 
 
-def test_local_server_multiple_connections(local_server: Path, server_port: int):
+@pytest.mark.parametrize('server_args', [[],
+                                         ['--threads=4'],
+                                         ['--threads=4', '--mode=sharded']],
+                         ids=['default', 'shared', 'sharded'])
+def test_local_server_multiple_connections(local_server: Path, server_port: int, server_args: list):
     server_process = subprocess.Popen(
-        [local_server, str(server_port)]
+        [local_server, str(server_port)] + server_args
     )
 
     # Wait for the process to start up
@@ -145,3 +149,375 @@ def test_local_server_multiple_connections(local_server: Path, server_port: int)
 
     assert server_process.returncode == 0, \
         f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def scrape_metrics(admin_port: int, path: str) -> str:
+    with socket.create_connection(('127.0.0.1', admin_port), timeout=2) as sock:
+        sock.sendall(f'GET {path} HTTP/1.1\r\nHost: localhost\r\n\r\n'.encode())
+        response = b''
+        while chunk := sock.recv(65536):
+            response += chunk
+    head, _, body = response.decode().partition('\r\n\r\n')
+    assert head.startswith('HTTP/1.1 200'), head
+    return body
+
+
+def test_local_server_admin_metrics(local_server: Path, server_port: int):
+    admin_port = server_port + 1
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), f'--admin={admin_port}']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        results = [create_tcp_connection(server_port, seed) for seed in range(1, 4)]
+        assert all(r.error is None and r.hex_received == r.hex_expected for r in results)
+
+        # sessions are closed asynchronously
+        time.sleep(0.5)
+        metrics = dict(line.rsplit(' ', 1) for line in scrape_metrics(admin_port, '/metrics').splitlines()
+                       if not line.startswith('#'))
+        assert metrics['hs_sessions_accepted_total'] == '3'
+        assert metrics['hs_active_sessions'] == '0'
+        assert metrics['hs_received_bytes_total'] == str(3 * 10001)
+        assert metrics['hs_lines_hashed_total'] == '3'
+        assert metrics['hs_line_size_bytes_count'] == '3'
+        assert metrics['hs_line_latency_seconds_count'] == '3'
+
+        import json
+        json_metrics = json.loads(scrape_metrics(admin_port, '/metrics.json'))
+        assert json_metrics['hs_sent_bytes_total'] == 3 * 65
+        assert json_metrics['hs_lines_hashed_total'] == 3
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def read_lines(sock: socket.socket, count: int) -> list:
+    data = b''
+    while data.count(b'\n') < count:
+        chunk = sock.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    return data.decode().splitlines()
+
+
+def test_local_server_resume_line(local_server: Path, server_port: int, tmp_path: Path):
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--hash=sha256-resumable', '--checkpoint-interval=65536',
+         f'--checkpoint-dir={tmp_path}']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        import random
+        rand = random.Random(815)
+        line = bytes(rand.choice(b'0123456789abcdef') for _ in range(300000))
+
+        # the connection drops in the middle of the line, after its checkpoints
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+            sock.sendall(line[:200000])
+            lines = read_lines(sock, 1)
+            sock.settimeout(0.5)
+            try:
+                while True:
+                    lines += read_lines(sock, 1)
+            except socket.timeout:
+                pass
+        notices = [notice.split(' ') for notice in lines]
+        assert notices and all(kind == '#checkpoint' for kind, _, _ in notices)
+        token, offset = notices[-1][1], int(notices[-1][2])
+        assert all(t == token for _, t, _ in notices)
+        assert 65536 <= int(notices[0][2]) <= offset <= 200000
+
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+            sock.sendall(f'#resume {token} {offset}\n'.encode())
+            assert read_lines(sock, 1) == [f'#resumed {token} {offset}']
+            sock.sendall(line[offset:] + b'\n')
+            responses = read_lines(sock, 1)
+            # checkpoints of the rest of the line may precede the digest
+            while not responses or responses[-1].startswith('#'):
+                responses += read_lines(sock, 1)
+            assert responses[-1] == hashlib.sha256(line).hexdigest()
+
+        # the checkpoints of a complete line are gone, other lines are not affected
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+            sock.sendall(f'#resume {token} {offset}\n'.encode())
+            assert read_lines(sock, 1) == ['#error unknown checkpoint']
+            sock.sendall(b'#res\n')
+            assert read_lines(sock, 1) == [hashlib.sha256(b'#res').hexdigest()]
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def test_local_server_digest_cache(local_server: Path, server_port: int):
+    admin_port = server_port + 1
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--digest-cache=1048576', '--digest-cache-line=32', f'--admin={admin_port}']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        import random
+        rand = random.Random(815)
+        # hot keys, some of them too long to be cached
+        keys = [f'key-{i}'.encode() * rand.randint(1, 8) for i in range(10)]
+        lines = [rand.choice(keys) for _ in range(300)]
+        expected = [hashlib.sha256(line).hexdigest() for line in lines]
+
+        for _ in range(2):
+            with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+                sock.sendall(b''.join(line + b'\n' for line in lines))
+                assert read_lines(sock, len(lines)) == expected
+
+        time.sleep(0.5)
+        metrics = dict(line.rsplit(' ', 1) for line in scrape_metrics(admin_port, '/metrics').splitlines()
+                       if not line.startswith('#'))
+        hits, misses = int(metrics['hs_digest_cache_hits_total']), int(metrics['hs_digest_cache_misses_total'])
+        assert hits > 0
+        assert hits + misses <= 2 * len(lines)
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def varint(value: int) -> bytes:
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def binary_request(message: bytes, request_id=None) -> bytes:
+    if request_id is None:
+        return varint(len(message) << 1) + message
+    return varint(len(message) << 1 | 1) + varint(request_id) + message
+
+
+def read_bytes(sock: socket.socket, size: int) -> bytes:
+    data = b''
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def test_local_server_binary_protocol(local_server: Path, server_port: int):
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--protocol=binary']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        # short, empty, with terminators and long enough for the compute threads, with and without ids
+        requests = [(b'oceanic 815', None), (b'', 4), (b'line\nwith\nterminators', 2 ** 40),
+                    (bytes(range(256)) * 1000, 815), (b'#resume', None)]
+        expected = b''.join((b'' if request_id is None else varint(request_id)) + hashlib.sha256(message).digest()
+                            for message, request_id in requests)
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+            sock.sendall(b''.join(binary_request(message, request_id) for message, request_id in requests))
+            assert read_bytes(sock, len(expected)) == expected
+
+        # a malformed header ends the connection
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+            sock.sendall(b'\xff' * 11)
+            assert sock.recv(64) == b''
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def tree_hash(line: bytes, leaf_size: int = 16 * 1024) -> str:
+    # Merkle Tree Hash of RFC 6962
+    def root(leaves: list) -> bytes:
+        if len(leaves) == 1:
+            return hashlib.sha256(b'\x00' + leaves[0]).digest()
+        split = 1
+        while split * 2 < len(leaves):
+            split *= 2
+        return hashlib.sha256(b'\x01' + root(leaves[:split]) + root(leaves[split:])).digest()
+
+    return root([line[i:i + leaf_size] for i in range(0, len(line), leaf_size)] or [b'']).hex()
+
+
+def test_local_server_tree_hash(local_server: Path, server_port: int):
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--hash=sha256-tree', '--compute-threads=4']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        import random
+        rand = random.Random(815)
+        lines = [b'', b'oceanic 815', bytes(rand.choice(b'0123456789abcdef') for _ in range(1000000))]
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as sock:
+            sock.sendall(b''.join(line + b'\n' for line in lines))
+            assert read_lines(sock, len(lines)) == [tree_hash(line) for line in lines]
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def test_local_server_fair_scheduling(local_server: Path, server_port: int):
+    admin_port = server_port + 1
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--compute-threads=0', '--quantum=4096', '--bulk-quantum=1024',
+         '--bulk-line=8192', f'--listen={server_port + 2}:sha256:latency', f'--admin={admin_port}']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        import random
+        rand = random.Random(815)
+        long_line = bytes(rand.choice(b'0123456789abcdef') for _ in range(2000000))
+        short_lines = [f'short {i}'.encode() for i in range(2000)]
+        with socket.create_connection(('127.0.0.1', server_port), timeout=5) as bulk, \
+                socket.create_connection(('127.0.0.1', server_port + 2), timeout=5) as latency:
+            sender = threading.Thread(target=bulk.sendall, args=(long_line + b'\n',))
+            sender.start()
+            latency.sendall(b''.join(line + b'\n' for line in short_lines))
+            assert read_lines(latency, len(short_lines)) == [hashlib.sha256(line).hexdigest() for line in short_lines]
+            sender.join()
+            assert read_lines(bulk, 1) == [hashlib.sha256(long_line).hexdigest()]
+
+        time.sleep(0.5)
+        metrics = dict(line.rsplit(' ', 1) for line in scrape_metrics(admin_port, '/metrics').splitlines()
+                       if not line.startswith('#'))
+        # the long line is hashed in bulk turns, the short lines exceed the latency quantum
+        assert int(metrics['hs_turns_yielded_total']) > 0
+        assert int(metrics['hs_bulk_wait_seconds_count']) > 0
+        assert int(metrics['hs_latency_wait_seconds_count']) > 0
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def test_local_server_session_limit(local_server: Path, server_port: int):
+    admin_port = server_port + 1
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--max-sessions=2', f'--admin={admin_port}']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        first = socket.create_connection(('127.0.0.1', server_port), timeout=2)
+        second = socket.create_connection(('127.0.0.1', server_port), timeout=2)
+        for sock in (first, second):
+            sock.sendall(b'oceanic 815\n')
+            assert read_lines(sock, 1) == [hashlib.sha256(b'oceanic 815').hexdigest()]
+
+        # waits in the listen backlog
+        with socket.create_connection(('127.0.0.1', server_port), timeout=2) as third:
+            third.sendall(b'oceanic 815\n')
+            third.settimeout(0.5)
+            with pytest.raises(socket.timeout):
+                third.recv(512)
+
+            first.close()
+            third.settimeout(2)
+            assert read_lines(third, 1) == [hashlib.sha256(b'oceanic 815').hexdigest()]
+        second.close()
+
+        metrics = dict(line.rsplit(' ', 1) for line in scrape_metrics(admin_port, '/metrics').splitlines()
+                       if not line.startswith('#'))
+        assert int(metrics['hs_session_limit_hits_total']) > 0
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
+
+
+def test_local_server_memory_budget(local_server: Path, server_port: int):
+    admin_port = server_port + 1
+    server_process = subprocess.Popen(
+        [local_server, str(server_port), '--memory-budget=65536', f'--admin={admin_port}']
+    )
+
+    # Wait for the process to start up
+    for _ in range(2):
+        code = server_process.poll()
+        if code is not None:
+            pytest.fail(f"Server process failed to start up properly, returned: {code}")
+        time.sleep(1)
+
+    try:
+        lines = [f'line {i}'.encode() for i in range(100000)]
+        with socket.create_connection(('127.0.0.1', server_port), timeout=5) as sock:
+            # the responses are not read until the server has stopped reading
+            sender = threading.Thread(target=sock.sendall, args=(b''.join(line + b'\n' for line in lines),))
+            sender.start()
+            time.sleep(1)
+            assert read_lines(sock, len(lines)) == [hashlib.sha256(line).hexdigest() for line in lines]
+            sender.join()
+
+        time.sleep(0.5)
+        metrics = dict(line.rsplit(' ', 1) for line in scrape_metrics(admin_port, '/metrics').splitlines()
+                       if not line.startswith('#'))
+        assert int(metrics['hs_memory_limit_hits_total']) > 0
+        assert metrics['hs_output_bytes'] == '0'
+    finally:
+        kill_server(server_process)
+
+    assert server_process.returncode == 0, \
+        f'failed to shutdown the server properly, return code: {server_process.returncode}'
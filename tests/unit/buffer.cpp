@@ -0,0 +1,184 @@
+#include "hash-service/buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <string_view>
+
+namespace {
+	template <typename Buffer>
+	void fill(Buffer &buffer, std::string_view data) {
+		ASSERT_LE(data.size(), buffer.capacity());
+		ASSERT_TRUE(buffer.empty());
+		std::copy(data.cbegin(), data.cend(), buffer.data());
+		buffer.commit(data.size());
+	}
+
+	/**
+	 * Drains the buffer, collecting every chunk.
+	 */
+	template <typename Buffer>
+	std::vector<std::pair<std::string, bool>> drain(Buffer &buffer) {
+		std::vector<std::pair<std::string, bool>> chunks{};
+		while (!buffer.empty())
+		{
+			const auto [data, complete] = buffer.next_chunk('\n');
+			chunks.emplace_back(std::string(data), complete);
+		}
+		return chunks;
+	}
+
+	TEST(LineBuffer, Empty) {
+		hs::line_buffer<16> buffer{};
+		EXPECT_TRUE(buffer.empty());
+		EXPECT_EQ(buffer.pending(), 0u);
+
+		buffer.commit(0);
+		EXPECT_TRUE(buffer.empty());
+	}
+
+	TEST(LineBuffer, SingleLine) {
+		hs::line_buffer<16> buffer{};
+		ASSERT_NO_FATAL_FAILURE(fill(buffer, "oceanic 815\n"));
+		EXPECT_EQ(buffer.pending(), 12u);
+
+		const auto chunks = drain(buffer);
+		ASSERT_EQ(chunks.size(), 1u);
+		EXPECT_EQ(chunks[0].first, "oceanic 815");
+		EXPECT_TRUE(chunks[0].second);
+		EXPECT_TRUE(buffer.empty());
+	}
+
+	TEST(LineBuffer, SeveralLinesAndTail) {
+		hs::line_buffer<32> buffer{};
+		ASSERT_NO_FATAL_FAILURE(fill(buffer, "a\nbc\n\ndef"));
+
+		const auto chunks = drain(buffer);
+		const std::vector<std::pair<std::string, bool>> expected{
+			{"a", true},
+			{"bc", true},
+			{"", true},
+			{"def", false}
+		};
+		EXPECT_EQ(chunks, expected);
+	}
+
+	TEST(LineBuffer, RefillAfterConsumption) {
+		hs::line_buffer<8> buffer{};
+		ASSERT_NO_FATAL_FAILURE(fill(buffer, "1234567"));
+		auto chunks = drain(buffer);
+		ASSERT_EQ(chunks.size(), 1u);
+		EXPECT_EQ(chunks[0].first, "1234567");
+		EXPECT_FALSE(chunks[0].second);
+
+		ASSERT_NO_FATAL_FAILURE(fill(buffer, "89\n0\n"));
+		chunks = drain(buffer);
+		ASSERT_EQ(chunks.size(), 2u);
+		EXPECT_EQ(chunks[0].first, "89");
+		EXPECT_EQ(chunks[1].first, "0");
+	}
+
+	TEST(LineBuffer, LimitSplitsLines) {
+		hs::line_buffer<32> buffer{};
+		ASSERT_NO_FATAL_FAILURE(fill(buffer, "abcdef\ngh\n"));
+
+		// the terminator is found only within the limit
+		hs::line_chunk chunk = buffer.next_chunk('\n', 4);
+		EXPECT_EQ(chunk.data, "abcd");
+		EXPECT_FALSE(chunk.complete);
+		EXPECT_EQ(buffer.pending(), 6u);
+
+		chunk = buffer.next_chunk('\n', 4);
+		EXPECT_EQ(chunk.data, "ef");
+		EXPECT_TRUE(chunk.complete);
+
+		chunk = buffer.next_chunk('\n', 3);
+		EXPECT_EQ(chunk.data, "gh");
+		EXPECT_TRUE(chunk.complete);
+		EXPECT_TRUE(buffer.empty());
+	}
+
+	TEST(LineBuffer, CommitIsClamped) {
+		hs::line_buffer<4> buffer{};
+		buffer.commit(100);
+		EXPECT_EQ(buffer.pending(), 4u);
+	}
+
+	TEST(PooledLineBuffer, HoldsStorageUntilConsumed) {
+		hs::pooled_line_buffer buffer{};
+		EXPECT_FALSE(buffer.acquired());
+		EXPECT_EQ(buffer.capacity(), 0u);
+
+		buffer.acquire();
+		ASSERT_TRUE(buffer.acquired());
+		EXPECT_EQ(buffer.capacity(), hs::buffer_pool::min_size);
+		ASSERT_NO_FATAL_FAILURE(fill(buffer, "a\nbc"));
+
+		EXPECT_EQ(buffer.next_chunk('\n').data, "a");
+		buffer.release();
+		EXPECT_TRUE(buffer.acquired());
+
+		const auto chunks = drain(buffer);
+		ASSERT_EQ(chunks.size(), 1u);
+		EXPECT_EQ(chunks[0].first, "bc");
+		EXPECT_FALSE(chunks[0].second);
+		buffer.release();
+		EXPECT_FALSE(buffer.acquired());
+	}
+
+	TEST(PooledLineBuffer, GrowsOnFullReadsUpToMax) {
+		hs::pooled_line_buffer buffer{hs::receive_policy{2 * 1024, 8 * 1024}};
+		const std::vector<size_t> expected{2 * 1024, 4 * 1024, 8 * 1024, 8 * 1024};
+		for (size_t size : expected)
+		{
+			buffer.acquire();
+			EXPECT_EQ(buffer.capacity(), size);
+			buffer.commit(buffer.capacity());
+			drain(buffer);
+			buffer.release();
+		}
+		EXPECT_EQ(buffer.target_size(), 8u * 1024);
+	}
+
+	TEST(PooledLineBuffer, ShrinksOnSmallReads) {
+		hs::pooled_line_buffer buffer{hs::receive_policy{2 * 1024, 16 * 1024}};
+		for (int i = 0; i < 3; ++i)
+		{
+			buffer.acquire();
+			buffer.commit(buffer.capacity());
+			drain(buffer);
+			buffer.release();
+		}
+		ASSERT_EQ(buffer.target_size(), 16u * 1024);
+
+		// a half-full read keeps the size
+		buffer.acquire();
+		buffer.commit(buffer.capacity() / 2);
+		drain(buffer);
+		buffer.release();
+		EXPECT_EQ(buffer.target_size(), 16u * 1024);
+
+		for (size_t size : {8 * 1024, 4 * 1024, 2 * 1024, 2 * 1024})
+		{
+			buffer.acquire();
+			buffer.commit(10);
+			drain(buffer);
+			buffer.release();
+			EXPECT_EQ(buffer.target_size(), size);
+		}
+	}
+
+	TEST(PooledLineBuffer, CommitIsClamped) {
+		hs::pooled_line_buffer buffer{};
+		buffer.acquire();
+		buffer.commit(buffer.capacity() + 100);
+		EXPECT_EQ(buffer.pending(), buffer.capacity());
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
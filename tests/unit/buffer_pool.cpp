@@ -0,0 +1,85 @@
+#include "hash-service/buffer_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+	TEST(BufferPool, RoundsUpToSizeClass) {
+		EXPECT_EQ(hs::buffer_pool::acquire(1).size(), hs::buffer_pool::min_size);
+		EXPECT_EQ(hs::buffer_pool::acquire(2048).size(), 2048u);
+		EXPECT_EQ(hs::buffer_pool::acquire(2049).size(), 4096u);
+		EXPECT_EQ(hs::buffer_pool::acquire(300 * 1024).size(), 512u * 1024);
+		EXPECT_EQ(hs::buffer_pool::acquire(16 * 1024 * 1024).size(), hs::buffer_pool::max_size);
+	}
+
+	TEST(BufferPool, ReusesBuffersOfTheThread) {
+		const uint8_t *first = nullptr;
+		{
+			const auto buffer = hs::buffer_pool::acquire(64 * 1024);
+			first = buffer.data();
+		}
+		const auto cached = hs::buffer_pool::stats().bytes_cached;
+		EXPECT_GE(cached, 64u * 1024);
+
+		const auto buffer = hs::buffer_pool::acquire(64 * 1024);
+		EXPECT_EQ(buffer.data(), first);
+		EXPECT_EQ(hs::buffer_pool::stats().bytes_cached, cached - 64 * 1024);
+	}
+
+	TEST(BufferPool, AccountsUsage) {
+		const auto before = hs::buffer_pool::stats();
+		{
+			std::vector<hs::pooled_buffer> buffers{};
+			buffers.push_back(hs::buffer_pool::acquire(4096));
+			buffers.push_back(hs::buffer_pool::acquire(8192));
+
+			const auto stats = hs::buffer_pool::stats();
+			EXPECT_EQ(stats.buffers_in_use, before.buffers_in_use + 2);
+			EXPECT_EQ(stats.bytes_in_use, before.bytes_in_use + 4096 + 8192);
+			EXPECT_GE(stats.peak_bytes_in_use, stats.bytes_in_use);
+
+			hs::pooled_buffer moved = std::move(buffers.back());
+			EXPECT_FALSE(buffers.back());
+			EXPECT_EQ(hs::buffer_pool::stats().buffers_in_use, before.buffers_in_use + 2);
+		}
+
+		const auto after = hs::buffer_pool::stats();
+		EXPECT_EQ(after.buffers_in_use, before.buffers_in_use);
+		EXPECT_EQ(after.bytes_in_use, before.bytes_in_use);
+		EXPECT_GE(after.peak_bytes_in_use, before.bytes_in_use + 4096 + 8192);
+	}
+
+	TEST(BufferPool, CachesAreBounded) {
+		std::thread([] {
+			const auto before = hs::buffer_pool::stats().bytes_cached;
+			{
+				std::vector<hs::pooled_buffer> buffers{};
+				for (int i = 0; i < 8; ++i)
+					buffers.push_back(hs::buffer_pool::acquire(hs::buffer_pool::max_size));
+			}
+			// a couple of the largest buffers at most
+			EXPECT_EQ(hs::buffer_pool::stats().bytes_cached - before, 2 * hs::buffer_pool::max_size);
+		}).join();
+	}
+
+	TEST(BufferPool, ReleasedByAnotherThread) {
+		auto buffer = hs::buffer_pool::acquire(4096);
+		const auto before = hs::buffer_pool::stats();
+		std::thread([buffer = std::move(buffer)]() mutable {
+			buffer.reset();
+		}).join();
+
+		// the thread's cache is freed with the thread
+		const auto after = hs::buffer_pool::stats();
+		EXPECT_EQ(after.buffers_in_use, before.buffers_in_use - 1);
+		EXPECT_EQ(after.bytes_cached, before.bytes_cached);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
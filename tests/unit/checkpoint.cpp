@@ -0,0 +1,225 @@
+#include "hash-service/checkpoint.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+	hs::sha256_checkpoint make_checkpoint(uint64_t bytes) {
+		hs::sha256_checkpoint cp{};
+		for (size_t i = 0; i < cp.state.size(); ++i)
+			cp.state[i] = uint32_t(0x01020304 * (i + 1) + bytes);
+		cp.bytes = bytes;
+		for (size_t i = 0; i < bytes % 64; ++i)
+			cp.tail[i] = uint8_t('a' + i % 26);
+		return cp;
+	}
+
+	bool equal(const hs::sha256_checkpoint &lhs, const hs::sha256_checkpoint &rhs) {
+		return lhs.state == rhs.state && lhs.bytes == rhs.bytes && lhs.tail == rhs.tail;
+	}
+
+	hs::checkpoint_store::config memory_config(size_t capacity) {
+		hs::checkpoint_store::config conf{};
+		conf.capacity = capacity;
+		return conf;
+	}
+
+	/**
+	 * Temporary directory removed with its files.
+	 */
+	struct temp_directory
+	{
+		temp_directory()
+			: path(std::filesystem::temp_directory_path() / ("hs-checkpoints-" + hs::checkpoint_store::make_token()))
+		{
+			std::filesystem::create_directories(path);
+		}
+
+		~temp_directory() {
+			std::error_code errorCode{};
+			std::filesystem::remove_all(path, errorCode);
+		}
+
+		std::filesystem::path path;
+	};
+
+	TEST(CheckpointStore, Tokens) {
+		const std::string token = hs::checkpoint_store::make_token();
+		EXPECT_EQ(token.size(), hs::checkpoint_store::token_length);
+		EXPECT_TRUE(hs::checkpoint_store::valid_token(token));
+		EXPECT_NE(token, hs::checkpoint_store::make_token());
+
+		EXPECT_FALSE(hs::checkpoint_store::valid_token(""));
+		EXPECT_FALSE(hs::checkpoint_store::valid_token(token.substr(1)));
+		EXPECT_FALSE(hs::checkpoint_store::valid_token("../../../../../../../../etc/passwd"));
+		EXPECT_FALSE(hs::checkpoint_store::valid_token(std::string(32, 'A')));
+	}
+
+	TEST(CheckpointStore, PutGetErase) {
+		hs::checkpoint_store store{memory_config(4)};
+		const std::string token = hs::checkpoint_store::make_token();
+		EXPECT_FALSE(store.get(token));
+
+		ASSERT_TRUE(store.put(token, make_checkpoint(100)));
+		auto cp = store.get(token);
+		ASSERT_TRUE(cp);
+		EXPECT_TRUE(equal(*cp, make_checkpoint(100)));
+
+		// replaced by the next checkpoint of the line
+		ASSERT_TRUE(store.put(token, make_checkpoint(200)));
+		EXPECT_EQ(store.size(), 1u);
+		cp = store.get(token);
+		ASSERT_TRUE(cp);
+		EXPECT_EQ(cp->bytes, 200u);
+
+		store.erase(token);
+		EXPECT_FALSE(store.get(token));
+		EXPECT_EQ(store.size(), 0u);
+
+		EXPECT_FALSE(store.put("invalid", make_checkpoint(1)));
+	}
+
+	TEST(CheckpointStore, DropsLeastRecentlyUsed) {
+		hs::checkpoint_store store{memory_config(2)};
+		const std::vector<std::string> tokens{hs::checkpoint_store::make_token(), hs::checkpoint_store::make_token(),
+											  hs::checkpoint_store::make_token()};
+		ASSERT_TRUE(store.put(tokens[0], make_checkpoint(1)));
+		ASSERT_TRUE(store.put(tokens[1], make_checkpoint(2)));
+		// the first one becomes the most recently used
+		ASSERT_TRUE(store.get(tokens[0]));
+		ASSERT_TRUE(store.put(tokens[2], make_checkpoint(3)));
+
+		EXPECT_EQ(store.size(), 2u);
+		EXPECT_TRUE(store.get(tokens[0]));
+		EXPECT_FALSE(store.get(tokens[1]));
+		EXPECT_TRUE(store.get(tokens[2]));
+	}
+
+	TEST(CheckpointStore, SpillsToDisk) {
+		const temp_directory dir{};
+		hs::checkpoint_store::config conf = memory_config(1);
+		conf.directory = dir.path.string();
+		const std::string first = hs::checkpoint_store::make_token(),
+			second = hs::checkpoint_store::make_token();
+		{
+			hs::checkpoint_store store{conf};
+			ASSERT_TRUE(store.put(first, make_checkpoint(1000)));
+			ASSERT_TRUE(store.put(second, make_checkpoint(2047)));
+			EXPECT_EQ(store.size(), 1u);
+			EXPECT_TRUE(store.flush_due());
+			store.flush();
+			EXPECT_FALSE(store.flush_due());
+			EXPECT_TRUE(std::filesystem::exists(dir.path / first));
+
+			const auto cp = store.get(first);
+			ASSERT_TRUE(cp);
+			EXPECT_TRUE(equal(*cp, make_checkpoint(1000)));
+		}
+
+		// spilled checkpoints survive the store
+		hs::checkpoint_store store{conf};
+		const auto cp = store.get(first);
+		ASSERT_TRUE(cp);
+		EXPECT_TRUE(equal(*cp, make_checkpoint(1000)));
+		EXPECT_FALSE(store.get(second));
+
+		store.erase(first);
+		store.flush();
+		EXPECT_FALSE(std::filesystem::exists(dir.path / first));
+		EXPECT_FALSE(store.get(first));
+	}
+
+	TEST(CheckpointStore, BoundsSpilledFiles) {
+		const temp_directory dir{};
+		hs::checkpoint_store::config conf = memory_config(1);
+		conf.directory = dir.path.string();
+		conf.disk_capacity = 2;
+		hs::checkpoint_store store{conf};
+
+		std::vector<std::string> tokens{};
+		for (uint64_t i = 0; i < 5; ++i)
+		{
+			tokens.push_back(hs::checkpoint_store::make_token());
+			ASSERT_TRUE(store.put(tokens.back(), make_checkpoint(i)));
+			store.flush();
+		}
+
+		const auto files = std::distance(std::filesystem::directory_iterator(dir.path),
+										 std::filesystem::directory_iterator());
+		EXPECT_EQ(files, 2);
+		EXPECT_FALSE(store.get(tokens[0]));
+		EXPECT_TRUE(store.get(tokens[2]));
+		EXPECT_TRUE(store.get(tokens[3]));
+		EXPECT_TRUE(store.get(tokens[4]));
+	}
+
+	TEST(CheckpointStore, SpillsResumedLinesAgain) {
+		const temp_directory dir{};
+		hs::checkpoint_store::config conf = memory_config(1);
+		conf.directory = dir.path.string();
+		conf.disk_capacity = 2;
+		hs::checkpoint_store store{conf};
+
+		const std::vector<std::string> tokens{hs::checkpoint_store::make_token(), hs::checkpoint_store::make_token(),
+											  hs::checkpoint_store::make_token()};
+		ASSERT_TRUE(store.put(tokens[0], make_checkpoint(1)));
+		ASSERT_TRUE(store.put(tokens[1], make_checkpoint(2)));
+		store.flush();
+		// resumed from its file, checkpointed again and spilled again
+		ASSERT_TRUE(store.get(tokens[0]));
+		ASSERT_TRUE(store.put(tokens[0], make_checkpoint(3)));
+		store.flush();
+		ASSERT_TRUE(store.put(tokens[2], make_checkpoint(4)));
+		store.flush();
+
+		// the file written first is not counted twice
+		const auto cp = store.get(tokens[0]);
+		ASSERT_TRUE(cp);
+		EXPECT_EQ(cp->bytes, 3u);
+		EXPECT_TRUE(store.get(tokens[1]));
+	}
+
+	TEST(CheckpointStore, ReadsEvictedCheckpointsBeforeTheirFiles) {
+		const temp_directory dir{};
+		hs::checkpoint_store::config conf = memory_config(1);
+		conf.directory = dir.path.string();
+		hs::checkpoint_store store{conf};
+
+		const std::string first = hs::checkpoint_store::make_token(),
+			second = hs::checkpoint_store::make_token();
+		ASSERT_TRUE(store.put(first, make_checkpoint(1)));
+		ASSERT_TRUE(store.put(second, make_checkpoint(2)));
+
+		// not written until flushed
+		EXPECT_FALSE(std::filesystem::exists(dir.path / first));
+		const auto cp = store.get(first);
+		ASSERT_TRUE(cp);
+		EXPECT_EQ(cp->bytes, 1u);
+
+		// erased before written
+		store.erase(first);
+		EXPECT_FALSE(store.get(first));
+		store.flush();
+		EXPECT_FALSE(std::filesystem::exists(dir.path / first));
+		EXPECT_FALSE(store.get(first));
+	}
+
+	TEST(CheckpointStore, RejectsCorruptFiles) {
+		const temp_directory dir{};
+		hs::checkpoint_store::config conf = memory_config(1);
+		conf.directory = dir.path.string();
+		hs::checkpoint_store store{conf};
+
+		const std::string token = hs::checkpoint_store::make_token();
+		std::ofstream(dir.path / token, std::ios::binary) << "not a checkpoint";
+		EXPECT_FALSE(store.get(token));
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
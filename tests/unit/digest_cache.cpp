@@ -0,0 +1,145 @@
+#include "hash-service/digest_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+	using response = std::array<uint8_t, hs::digest_cache::response_size>;
+
+	response hex_line(std::string_view line) {
+		hs::sha256_batch::digest digest{};
+		hs::sha256_batch::hash(&line, 1, &digest);
+		response out{};
+		hs::hex_encoder::encode_lines(&digest, 1, out.data());
+		return out;
+	}
+
+	hs::digest_cache::config single_shard(size_t slots, size_t maxLine = 16) {
+		hs::digest_cache::config conf{};
+		// a slot costs its bytes and an index entry
+		conf.capacity = slots * (maxLine + hs::digest_cache::response_size + 64);
+		conf.max_line = maxLine;
+		conf.shards = 1;
+		return conf;
+	}
+
+	TEST(DigestCache, HitAfterInsert) {
+		hs::digest_cache cache{hs::digest_cache::config{}};
+		response out{};
+		EXPECT_FALSE(cache.find("oceanic 815", out.data()));
+
+		cache.insert("oceanic 815", hex_line("oceanic 815").data());
+		ASSERT_TRUE(cache.find("oceanic 815", out.data()));
+		EXPECT_EQ(out, hex_line("oceanic 815"));
+		EXPECT_EQ(out.back(), '\n');
+		EXPECT_EQ(cache.size(), 1u);
+
+		EXPECT_FALSE(cache.find("oceanic 816", out.data()));
+		EXPECT_FALSE(cache.find("oceanic 81", out.data()));
+		EXPECT_FALSE(cache.find("", out.data()));
+	}
+
+	TEST(DigestCache, EmptyLine) {
+		hs::digest_cache cache{hs::digest_cache::config{}};
+		cache.insert("", hex_line("").data());
+		response out{};
+		ASSERT_TRUE(cache.find("", out.data()));
+		EXPECT_EQ(out, hex_line(""));
+	}
+
+	TEST(DigestCache, SkipsLongLines) {
+		hs::digest_cache cache{single_shard(4, 8)};
+		cache.insert("123456789", hex_line("123456789").data());
+		EXPECT_EQ(cache.size(), 0u);
+		response out{};
+		EXPECT_FALSE(cache.find("123456789", out.data()));
+
+		cache.insert("12345678", hex_line("12345678").data());
+		EXPECT_TRUE(cache.find("12345678", out.data()));
+	}
+
+	TEST(DigestCache, BoundedBySlots) {
+		hs::digest_cache cache{single_shard(4)};
+		ASSERT_EQ(cache.slots(), 4u);
+		for (int i = 0; i < 100; ++i)
+		{
+			const std::string line = std::to_string(i);
+			cache.insert(line, hex_line(line).data());
+			EXPECT_LE(cache.size(), 4u);
+		}
+		EXPECT_EQ(cache.size(), 4u);
+
+		// the latest line is always cached, with the right response
+		response out{};
+		ASSERT_TRUE(cache.find("99", out.data()));
+		EXPECT_EQ(out, hex_line("99"));
+	}
+
+	TEST(DigestCache, ClockKeepsReferencedLines) {
+		hs::digest_cache cache{single_shard(4)};
+		ASSERT_EQ(cache.slots(), 4u);
+		for (const char *line : {"a", "b", "c", "d"})
+			cache.insert(line, hex_line(line).data());
+
+		response out{};
+		ASSERT_TRUE(cache.find("a", out.data()));
+		ASSERT_TRUE(cache.find("c", out.data()));
+
+		// "b" and "d" are evicted first
+		cache.insert("e", hex_line("e").data());
+		cache.insert("f", hex_line("f").data());
+		EXPECT_TRUE(cache.find("a", out.data()));
+		EXPECT_TRUE(cache.find("c", out.data()));
+		EXPECT_FALSE(cache.find("b", out.data()));
+		EXPECT_FALSE(cache.find("d", out.data()));
+		EXPECT_TRUE(cache.find("e", out.data()));
+		EXPECT_TRUE(cache.find("f", out.data()));
+	}
+
+	TEST(DigestCache, ConcurrentAccess) {
+		hs::digest_cache::config conf{};
+		conf.capacity = 64 * 1024;
+		hs::digest_cache cache{conf};
+
+		constexpr int threads = 4;
+		constexpr int lines = 512;
+		std::vector<response> expected(lines);
+		for (int i = 0; i < lines; ++i)
+			expected[size_t(i)] = hex_line(std::to_string(i));
+
+		std::atomic<int> wrong{0};
+		std::vector<std::thread> workers{};
+		for (int t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&, t]{
+				response out{};
+				for (int round = 0; round < 20; ++round)
+					for (int i = 0; i < lines; ++i)
+					{
+						const int n = (i * (t + 1) + round) % lines;
+						const std::string line = std::to_string(n);
+						if (!cache.find(line, out.data()))
+							cache.insert(line, expected[size_t(n)].data());
+						else if (out != expected[size_t(n)])
+							++wrong;
+					}
+			});
+		}
+		for (auto &worker : workers)
+			worker.join();
+
+		EXPECT_EQ(wrong.load(), 0);
+		EXPECT_LE(cache.size(), cache.slots());
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
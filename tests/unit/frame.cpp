@@ -0,0 +1,141 @@
+#include "hash-service/frame.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+	std::string varint(uint64_t value) {
+		std::array<uint8_t, hs::detail::max_varint_size> bytes{};
+		const uint8_t *end = hs::detail::write_varint(value, bytes.data());
+		return std::string(reinterpret_cast<const char*>(bytes.data()), size_t(end - bytes.data()));
+	}
+
+	std::string request(std::string_view message) {
+		return varint(uint64_t(message.size()) << 1) + std::string(message);
+	}
+
+	std::string request(std::string_view message, uint64_t id) {
+		return varint(uint64_t(message.size()) << 1 | 1) + varint(id) + std::string(message);
+	}
+
+	struct parsed
+	{
+		std::string data;
+		bool complete;
+		hs::request_id id;
+	};
+
+	/**
+	 * Feeds the bytes to the reader in pieces of `step` bytes, collecting every chunk.
+	 */
+	std::vector<parsed> parse(hs::frame_reader &reader, std::string_view bytes, size_t step) {
+		std::vector<parsed> chunks{};
+		for (size_t offset = 0; offset < bytes.size(); offset += step)
+		{
+			std::string_view pending = bytes.substr(offset, step);
+			while (!pending.empty())
+			{
+				size_t consumed = 0;
+				const auto chunk = reader.next(pending, consumed);
+				EXPECT_LE(consumed, pending.size());
+				pending.remove_prefix(consumed);
+				if (!chunk)
+				{
+					EXPECT_TRUE(pending.empty() || reader.failed());
+					if (reader.failed())
+						return chunks;
+					continue;
+				}
+				chunks.push_back(parsed{std::string(chunk->data), chunk->complete, reader.id()});
+			}
+		}
+		return chunks;
+	}
+
+	TEST(Varint, Encoding) {
+		EXPECT_EQ(varint(0), std::string(1, '\0'));
+		EXPECT_EQ(varint(127), "\x7F");
+		EXPECT_EQ(varint(128), "\x80\x01");
+		EXPECT_EQ(varint(300), "\xAC\x02");
+		EXPECT_EQ(varint(UINT64_MAX).size(), hs::detail::max_varint_size);
+		for (uint64_t value : {uint64_t(0), uint64_t(127), uint64_t(128), uint64_t(1) << 35, UINT64_MAX})
+			EXPECT_EQ(varint(value).size(), hs::detail::varint_size(value));
+	}
+
+	TEST(FrameReader, BackToBackRequests) {
+		hs::frame_reader reader{};
+		const std::string bytes = request("oceanic") + request("", 7) + request("line\nwith\nterminators", 300);
+		const auto chunks = parse(reader, bytes, bytes.size());
+		ASSERT_EQ(chunks.size(), 3u);
+		EXPECT_EQ(chunks[0].data, "oceanic");
+		EXPECT_TRUE(chunks[0].complete);
+		EXPECT_FALSE(chunks[0].id.present);
+
+		EXPECT_EQ(chunks[1].data, "");
+		EXPECT_TRUE(chunks[1].complete);
+		EXPECT_TRUE(chunks[1].id.present);
+		EXPECT_EQ(chunks[1].id.value, 7u);
+
+		EXPECT_EQ(chunks[2].data, "line\nwith\nterminators");
+		EXPECT_TRUE(chunks[2].complete);
+		EXPECT_EQ(chunks[2].id.value, 300u);
+	}
+
+	TEST(FrameReader, SplitAnywhere) {
+		const std::string message(1000, 'x');
+		const std::string bytes = request(message, uint64_t(1) << 40) + request("815");
+		for (size_t step : {1, 2, 3, 7, 64, 999})
+		{
+			hs::frame_reader reader{};
+			// chunks joined into messages
+			std::vector<parsed> messages(1);
+			for (const auto &chunk : parse(reader, bytes, step))
+			{
+				messages.back().data += chunk.data;
+				messages.back().id = chunk.id;
+				if (chunk.complete)
+					messages.emplace_back();
+			}
+			ASSERT_EQ(messages.size(), 3u) << "step: " << step;
+			EXPECT_EQ(messages[0].data, message) << "step: " << step;
+			EXPECT_EQ(messages[0].id.value, uint64_t(1) << 40);
+			EXPECT_EQ(messages[1].data, "815") << "step: " << step;
+			EXPECT_FALSE(messages[1].id.present);
+			EXPECT_TRUE(messages[2].data.empty());
+		}
+	}
+
+	TEST(FrameReader, RejectsOverlongVarint) {
+		hs::frame_reader reader{};
+		const std::string bytes(11, '\xFF');
+		const auto chunks = parse(reader, bytes, bytes.size());
+		EXPECT_TRUE(chunks.empty());
+		EXPECT_TRUE(reader.failed());
+
+		size_t consumed = 0;
+		EXPECT_FALSE(reader.next(request("a"), consumed));
+		EXPECT_EQ(consumed, 0u);
+	}
+
+	TEST(FrameReader, LargestLength) {
+		hs::frame_reader reader{};
+		// length 2^63 - 1 with an id: the header takes all the 10 bytes
+		const std::string header = varint(UINT64_MAX) + varint(1);
+		size_t consumed = 0;
+		const auto chunk = reader.next(header + "abc", consumed);
+		ASSERT_TRUE(chunk);
+		EXPECT_FALSE(reader.failed());
+		EXPECT_EQ(chunk->data, "abc");
+		EXPECT_FALSE(chunk->complete);
+		EXPECT_EQ(reader.id().value, 1u);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,106 @@
+#include "hash-service/governor.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+namespace {
+	TEST(Governor, NoLimits) {
+		hs::resource_governor governor{hs::resource_governor::config{}};
+		for (int i = 0; i < 100; ++i)
+			governor.session_opened();
+		EXPECT_TRUE(governor.admitting());
+
+		governor.add_output(1 << 30);
+		EXPECT_FALSE(governor.over_budget());
+		EXPECT_FALSE(governor.wait_for_budget([]{}));
+	}
+
+	TEST(Governor, SessionLimit) {
+		hs::resource_governor governor{hs::resource_governor::config{2, 0}};
+		governor.session_opened();
+		EXPECT_TRUE(governor.admitting());
+		governor.session_opened();
+		EXPECT_FALSE(governor.admitting());
+		EXPECT_EQ(governor.sessions(), 2u);
+
+		governor.session_closed();
+		EXPECT_TRUE(governor.admitting());
+	}
+
+	TEST(Governor, OutputBudget) {
+		hs::resource_governor governor{hs::resource_governor::config{0, 800}};
+		const uint64_t received = hs::buffer_pool::stats().bytes_in_use;
+		governor.add_output(799 - int64_t(received));
+		EXPECT_FALSE(governor.over_budget());
+		governor.add_output(1);
+		EXPECT_TRUE(governor.over_budget());
+		EXPECT_EQ(governor.bytes(), 800u);
+	}
+
+	TEST(Governor, ReceiveBuffersCount) {
+		hs::resource_governor governor{hs::resource_governor::config{0, 4096}};
+		EXPECT_FALSE(governor.over_budget());
+		{
+			auto buffer = hs::buffer_pool::acquire(4096);
+			EXPECT_TRUE(governor.over_budget());
+		}
+		EXPECT_FALSE(governor.over_budget());
+	}
+
+	TEST(Governor, ResumesUnderTheMark) {
+		hs::resource_governor governor{hs::resource_governor::config{0, 800}};
+		governor.add_output(1000);
+
+		int resumed = 0;
+		EXPECT_TRUE(governor.wait_for_budget([&resumed]{ ++resumed; }));
+		EXPECT_TRUE(governor.wait_for_budget([&resumed]{ ++resumed; }));
+
+		// under the budget, above the resume mark
+		governor.add_output(-250);
+		governor.relieved();
+		EXPECT_EQ(resumed, 0);
+
+		governor.add_output(-51);
+		governor.relieved();
+		EXPECT_EQ(resumed, 2);
+
+		// resumed once
+		governor.relieved();
+		EXPECT_EQ(resumed, 2);
+	}
+
+	TEST(Governor, ReleaseDuringRegistration) {
+		// the memory is released while a session registers: the session is resumed or not paused at all
+		for (int i = 0; i < 2000; ++i)
+		{
+			hs::resource_governor governor{hs::resource_governor::config{0, 800}};
+			governor.add_output(1000);
+
+			std::atomic<bool> go{false}, resumed{false};
+			bool registered = false;
+			std::thread waiter([&] {
+				while (!go.load())
+					;
+				registered = governor.wait_for_budget([&resumed]{ resumed = true; });
+			});
+			std::thread releaser([&] {
+				while (!go.load())
+					;
+				governor.add_output(-1000);
+				governor.relieved();
+			});
+			go = true;
+			waiter.join();
+			releaser.join();
+
+			ASSERT_TRUE(!registered || resumed) << "iteration " << i;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
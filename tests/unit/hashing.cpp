@@ -1,5 +1,6 @@
 
 #include "hash-service/hash.h"
+#include "hash-service/hashers.h"
 
 #include <gtest/gtest.h>
 
@@ -67,6 +68,63 @@ namespace {
 		ASSERT_NO_FATAL_FAILURE(test_case_chunks(lorem));
 	}
 
+	TEST(Hashing, HasherTraits) {
+		static_assert(hs::is_hasher_v<hs::sha256_hash>);
+		static_assert(hs::is_hasher_v<hs::sha512_256_hash>);
+		static_assert(!hs::is_hasher_v<int>);
+		static_assert(!hs::is_hasher_v<std::string>);
+	}
+
+	TEST(Hashing, ResumableFromCheckpoint) {
+		static_assert(hs::is_hasher_v<hs::sha256_resumable_hash>);
+		static_assert(hs::is_checkpointable_v<hs::sha256_resumable_hash>);
+		static_assert(!hs::is_checkpointable_v<hs::sha256_hash>);
+
+		// every split point within a block, and a few blocks further
+		for (size_t split : {size_t(0), size_t(1), size_t(63), size_t(64), size_t(65), size_t(200), lorem.line.size()})
+		{
+			auto first = hs::sha256_resumable_hash::create();
+			ASSERT_TRUE(first);
+			ASSERT_TRUE(first->update(std::string_view(lorem.line).substr(0, split)));
+			const hs::sha256_checkpoint cp = first->checkpoint();
+			EXPECT_EQ(cp.bytes, split);
+
+			auto second = hs::sha256_resumable_hash::create();
+			ASSERT_TRUE(second);
+			ASSERT_TRUE(second->update("discarded"));
+			ASSERT_TRUE(second->restore(cp));
+			ASSERT_TRUE(second->update(std::string_view(lorem.line).substr(split)));
+			const auto optRes = second->finalize();
+			ASSERT_TRUE(optRes);
+			const auto hexLine = hs::to_hex(*optRes);
+			EXPECT_EQ(std::string_view((const char*)hexLine.data(), hexLine.size()), lorem.expected) << split;
+		}
+	}
+
+	TEST(Hashing, Sha512_256) {
+		auto optHash = hs::sha512_256_hash::create();
+		ASSERT_TRUE(optHash);
+		ASSERT_TRUE(optHash->update("abc"));
+		const auto optRes = optHash->finalize();
+		ASSERT_TRUE(optRes);
+		const auto hexLine = hs::to_hex(*optRes);
+		ASSERT_EQ(std::string_view((const char*)hexLine.data(), hexLine.size()),
+				  "53048e2681941ef99b2e29b76b4c7dabe4c2d0c634fc6d46e0e2f13107e7af23");
+	}
+
+	TEST(Hashing, AlgorithmNames) {
+		EXPECT_EQ(hs::parse_hash_algorithm("sha256"), hs::hash_algorithm::sha256);
+		EXPECT_EQ(hs::parse_hash_algorithm("sha512-256"), hs::hash_algorithm::sha512_256);
+		EXPECT_EQ(hs::parse_hash_algorithm("sha256-resumable"), hs::hash_algorithm::sha256_resumable);
+		EXPECT_EQ(hs::parse_hash_algorithm("sha256-tree"), hs::hash_algorithm::sha256_tree);
+		EXPECT_FALSE(hs::parse_hash_algorithm("md5"));
+
+		const size_t digestLength = hs::visit_hash_algorithm(hs::hash_algorithm::sha512_256, [](auto tag) {
+			return decltype(tag)::type::digest_length;
+		});
+		EXPECT_EQ(digestLength, 32u);
+	}
+
 	// not sure if gtest supports such cases
 	TEST(Hashing, Multithreaded) {
 		const size_t threadsCount = std::thread::hardware_concurrency();
@@ -0,0 +1,95 @@
+#include "hash-service/hex.h"
+#include "hash-service/hash.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	using kernel = hs::hex_encoder::kernel;
+
+	std::string encode(kernel k, const std::vector<uint8_t> &bytes) {
+		std::string hex(bytes.size() * 2, '\0');
+		hs::hex_encoder::encode(k, bytes.data(), bytes.size(), reinterpret_cast<uint8_t*>(hex.data()));
+		return hex;
+	}
+
+	class HexEncoder : public ::testing::TestWithParam<kernel>
+	{
+	 protected:
+		void SetUp() override {
+			if (!hs::hex_encoder::supported(GetParam()))
+				GTEST_SKIP() << "not supported by the CPU";
+		}
+	};
+
+	TEST_P(HexEncoder, AllByteValues) {
+		std::vector<uint8_t> bytes(256);
+		for (size_t i = 0; i < bytes.size(); ++i)
+			bytes[i] = uint8_t(i);
+
+		std::string expected{};
+		for (const uint8_t byte : bytes)
+		{
+			expected += "0123456789abcdef"[byte >> 4];
+			expected += "0123456789abcdef"[byte & 0x0F];
+		}
+		EXPECT_EQ(encode(GetParam(), bytes), expected);
+	}
+
+	TEST_P(HexEncoder, MatchesScalarForAllSizes) {
+		std::mt19937 rng{815};
+		for (size_t size = 0; size <= 100; ++size)
+		{
+			std::vector<uint8_t> bytes(size);
+			for (auto &byte : bytes)
+				byte = uint8_t(rng());
+			EXPECT_EQ(encode(GetParam(), bytes), encode(kernel::scalar, bytes)) << size;
+		}
+	}
+
+	TEST_P(HexEncoder, LinesOfDigests) {
+		std::vector<std::array<uint8_t, 32>> digests(5);
+		std::mt19937 rng{42};
+		for (auto &digest : digests)
+			for (auto &byte : digest)
+				byte = uint8_t(rng());
+
+		std::string lines(digests.size() * hs::hex_encoder::line_size<32>, '\0');
+		auto *out = reinterpret_cast<uint8_t*>(lines.data());
+		EXPECT_EQ(hs::hex_encoder::encode_lines(GetParam(), digests.data(), digests.size(), out), out + lines.size());
+
+		std::string expected{};
+		for (const auto &digest : digests)
+		{
+			const auto hex = hs::to_hex(digest);
+			expected.append(hex.begin(), hex.end()).push_back('\n');
+		}
+		EXPECT_EQ(lines, expected);
+	}
+
+	INSTANTIATE_TEST_SUITE_P(Kernels, HexEncoder, ::testing::Values(kernel::scalar, kernel::ssse3, kernel::avx2),
+							 [](const ::testing::TestParamInfo<kernel> &info) {
+								 switch (info.param)
+								 {
+								 case kernel::ssse3:
+									 return "ssse3";
+								 case kernel::avx2:
+									 return "avx2";
+								 default:
+									 return "scalar";
+								 }
+							 });
+
+	TEST(HexEncoder, BestIsSupported) {
+		EXPECT_TRUE(hs::hex_encoder::supported(hs::hex_encoder::best()));
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,95 @@
+#include "hash-service/logging.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+	template <typename ... Args>
+	std::string format(const Args &... args) {
+		hs::detail::log_record record{};
+		hs::detail::encode_log_record(record, hs::log_level::messages, args...);
+		std::string out{};
+		record.format(record.payload, record.payloadSize, out);
+		return out;
+	}
+
+	std::string read_all(std::FILE *file) {
+		std::rewind(file);
+		std::string content{};
+		char chunk[256];
+		for (size_t read = 0; (read = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+			content.append(chunk, read);
+		return content;
+	}
+
+	size_t count(const std::string &text, const std::string &what) {
+		size_t n = 0;
+		for (size_t i = text.find(what); i != std::string::npos; i = text.find(what, i + what.size()))
+			++n;
+		return n;
+	}
+
+	TEST(LogRecord, FormatsDeferredArguments) {
+		const std::string owned = "owned";
+		EXPECT_EQ(format("port: ", uint16_t(23), ' ', owned, ' ', std::string_view("view"), ' ', true, ' ', -5),
+				  "port: 23 owned view true -5");
+	}
+
+	TEST(LogRecord, LooksUpErrorMessagesLater) {
+		const auto errorCode = std::make_error_code(std::errc::connection_reset);
+		EXPECT_EQ(format("error: ", errorCode), "error: " + errorCode.message());
+	}
+
+	TEST(LogRecord, TruncatesLongLines) {
+		const std::string longLine(1000, 'x');
+		const std::string formatted = format(longLine, " tail");
+		EXPECT_LT(formatted.size(), hs::detail::log_record::size);
+		EXPECT_EQ(formatted.find("tail"), std::string::npos);
+		EXPECT_EQ(formatted.substr(0, 10), std::string(10, 'x'));
+	}
+
+	TEST(LogBackend, DrainsAllThreads) {
+		std::FILE *file = std::tmpfile();
+		ASSERT_NE(file, nullptr);
+		{
+			hs::log_backend backend{file};
+			const hs::leveled_logger logger{hs::log_level::errors | hs::log_level::messages, &backend};
+
+			std::vector<std::thread> threads{};
+			for (int t = 0; t < 4; ++t)
+				threads.emplace_back([&logger, t] {
+					for (int i = 0; i < 100; ++i)
+					{
+						logger.message("thread ", t, " record ", i);
+						logger.warning("filtered out");
+					}
+					logger.error("thread ", t, " done");
+				});
+			for (auto &thread : threads)
+				thread.join();
+		}
+
+		const std::string content = read_all(file);
+		std::fclose(file);
+		EXPECT_EQ(count(content, " record "), 400u);
+		EXPECT_EQ(count(content, "ERROR [thread:"), 4u);
+		EXPECT_EQ(count(content, "filtered out"), 0u);
+		EXPECT_EQ(count(content, "thread 3 record 99\n"), 1u);
+	}
+
+	TEST(LeveledLogger, DisabledLevels) {
+		const hs::leveled_logger logger{hs::log_level::errors};
+		EXPECT_TRUE(logger.is_enabled(hs::log_level::errors));
+		EXPECT_FALSE(logger.is_enabled(hs::log_level::messages));
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,148 @@
+#include "hash-service/metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using buckets = hs::detail::log_buckets;
+
+	TEST(LogBuckets, BoundsContainValues) {
+		const std::vector<uint64_t> values{0, 1, 7, 8, 9, 15, 16, 17, 100, 1000, 4095, 4096, 123456789,
+										   uint64_t(1) << 40, UINT64_MAX - 1, UINT64_MAX};
+		for (const uint64_t value : values)
+		{
+			const size_t index = buckets::index(value);
+			ASSERT_LT(index, buckets::count) << value;
+			EXPECT_LE(buckets::lower_bound(index), value) << value;
+			EXPECT_GE(buckets::upper_bound(index), value) << value;
+		}
+	}
+
+	TEST(LogBuckets, AreContiguous) {
+		for (size_t i = 0; i + 1 < buckets::count; ++i)
+		{
+			ASSERT_EQ(buckets::upper_bound(i) + 1, buckets::lower_bound(i + 1)) << i;
+			ASSERT_EQ(buckets::index(buckets::lower_bound(i)), i) << i;
+			ASSERT_EQ(buckets::index(buckets::upper_bound(i)), i) << i;
+		}
+	}
+
+	TEST(LogBuckets, RelativeErrorIsBounded) {
+		for (size_t i = buckets::sub_buckets; i + 1 < buckets::count; ++i)
+		{
+			const double width = double(buckets::upper_bound(i) - buckets::lower_bound(i) + 1);
+			EXPECT_LE(width / double(buckets::lower_bound(i)), 1.0 / buckets::sub_buckets) << i;
+		}
+	}
+
+	TEST(Metrics, MergesThreads) {
+		hs::metrics metrics{};
+		constexpr size_t threads = 4, records = 10000;
+
+		std::vector<std::thread> workers{};
+		for (size_t t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&metrics] {
+				for (size_t i = 0; i < records; ++i)
+				{
+					metrics.add(hs::counter::bytes_received, 2);
+					metrics.add(hs::gauge::line_backlog, 1);
+					metrics.record(hs::histogram::line_size, i % 100);
+				}
+				metrics.add(hs::gauge::line_backlog, -int64_t(records / 2));
+			});
+		}
+		for (auto &worker : workers)
+			worker.join();
+
+		const auto snap = metrics.snapshot();
+		EXPECT_EQ(snap[hs::counter::bytes_received], threads * records * 2);
+		EXPECT_EQ(snap[hs::gauge::line_backlog], int64_t(threads * records / 2));
+		EXPECT_EQ(snap[hs::counter::sessions_accepted], 0u);
+
+		const auto &lineSize = snap[hs::histogram::line_size];
+		EXPECT_EQ(lineSize.count(), threads * records);
+		EXPECT_EQ(lineSize.sum(), threads * (records / 100) * (99 * 100 / 2));
+		EXPECT_EQ(lineSize.max(), 103u);
+	}
+
+	TEST(Metrics, GaugesDecrementedByAnotherThread) {
+		hs::metrics metrics{};
+		metrics.add(hs::gauge::active_sessions, 1);
+		std::thread([&metrics]{ metrics.add(hs::gauge::active_sessions, -1); }).join();
+		EXPECT_EQ(metrics.snapshot()[hs::gauge::active_sessions], 0);
+	}
+
+	TEST(HistogramSnapshot, Quantiles) {
+		hs::histogram_snapshot hist{};
+		EXPECT_EQ(hist.quantile(0.5), 0u);
+
+		for (uint64_t value = 1; value <= 1000; ++value)
+			hist.add(buckets::index(value), 1);
+
+		// within the buckets' relative error
+		EXPECT_NEAR(double(hist.quantile(0.5)), 500.0, 500.0 / buckets::sub_buckets);
+		EXPECT_NEAR(double(hist.quantile(0.99)), 990.0, 990.0 / buckets::sub_buckets);
+		EXPECT_GE(hist.quantile(1.0), 1000u);
+		EXPECT_EQ(hist.quantile(0.0), 1u);
+	}
+
+	TEST(Exposition, Prometheus) {
+		hs::metrics metrics{};
+		metrics.add(hs::counter::sessions_accepted, 3);
+		metrics.add(hs::counter::encoding_ns, 1'500'000'000);
+		metrics.record(hs::histogram::line_size, 5);
+		metrics.record(hs::histogram::line_size, 100);
+
+		const std::string text = hs::to_prometheus(metrics.snapshot());
+		EXPECT_NE(text.find("# TYPE hs_sessions_accepted_total counter\nhs_sessions_accepted_total 3\n"), std::string::npos);
+		EXPECT_NE(text.find("hs_encoding_seconds_total 1.500000000\n"), std::string::npos);
+		EXPECT_NE(text.find("hs_line_size_bytes_bucket{le=\"7\"} 1\n"), std::string::npos);
+		EXPECT_NE(text.find("hs_line_size_bytes_bucket{le=\"127\"} 2\n"), std::string::npos);
+		EXPECT_EQ(text.find("hs_line_size_bytes_bucket{le=\"255\"}"), std::string::npos);
+		EXPECT_NE(text.find("hs_line_size_bytes_bucket{le=\"+Inf\"} 2\n"), std::string::npos);
+		EXPECT_NE(text.find("hs_line_size_bytes_sum 105\nhs_line_size_bytes_count 2\n"), std::string::npos);
+		EXPECT_NE(text.find("hs_line_latency_seconds_count 0\n"), std::string::npos);
+	}
+
+	TEST(Exposition, Json) {
+		hs::metrics metrics{};
+		metrics.add(hs::gauge::active_sessions, 2);
+		metrics.record(hs::histogram::line_latency_ns, 1000);
+
+		const std::string json = hs::to_json(metrics.snapshot());
+		EXPECT_EQ(json.front(), '{');
+		EXPECT_EQ(json.back(), '}');
+		EXPECT_NE(json.find("\"hs_active_sessions\":2"), std::string::npos);
+		EXPECT_NE(json.find("\"hs_line_latency_ns\":{\"count\":1,\"sum\":1000,"), std::string::npos);
+	}
+
+	TEST(Exposition, BufferPool) {
+		hs::metrics metrics{};
+		const auto buffer = hs::buffer_pool::acquire(8 * 1024);
+
+		const auto snap = metrics.snapshot();
+		EXPECT_GE(snap.buffers.buffers_in_use, 1u);
+		EXPECT_GE(snap.buffers.peak_bytes_in_use, 8u * 1024);
+
+		const std::string text = hs::to_prometheus(snap);
+		EXPECT_NE(text.find("# TYPE hs_receive_buffers gauge\nhs_receive_buffers " +
+							std::to_string(snap.buffers.buffers_in_use) + "\n"), std::string::npos);
+		EXPECT_NE(text.find("hs_receive_buffer_bytes " + std::to_string(snap.buffers.bytes_in_use) + "\n"),
+				  std::string::npos);
+		EXPECT_NE(text.find("hs_receive_buffer_peak_bytes "), std::string::npos);
+
+		const std::string json = hs::to_json(snap);
+		EXPECT_NE(json.find("\"hs_receive_buffer_cached_bytes\":" + std::to_string(snap.buffers.bytes_cached)),
+				  std::string::npos);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
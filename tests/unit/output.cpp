@@ -0,0 +1,83 @@
+#include "hash-service/output.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+namespace {
+	void push(hs::output_queue &queue, std::string_view line) {
+		queue.push(reinterpret_cast<const uint8_t*>(line.data()), line.size());
+	}
+
+	std::string_view view(const hs::output_queue::buffer_type &bytes) {
+		return std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	}
+
+	TEST(OutputQueue, CoalescesStagedLines) {
+		hs::output_queue queue{};
+		push(queue, "a\n");
+		push(queue, "b\n");
+		EXPECT_EQ(queue.staged(), 4u);
+		EXPECT_FALSE(queue.writing());
+
+		const auto &written = queue.begin_write();
+		EXPECT_TRUE(queue.writing());
+		EXPECT_EQ(view(written), "a\nb\n");
+		EXPECT_EQ(queue.staged(), 0u);
+		EXPECT_EQ(queue.in_flight(), 4u);
+
+		queue.end_write();
+		EXPECT_FALSE(queue.writing());
+		EXPECT_EQ(queue.in_flight(), 0u);
+	}
+
+	TEST(OutputQueue, StagesWhileWriting) {
+		hs::output_queue queue{8};
+		push(queue, "first\n");
+		const auto &inFlight = queue.begin_write();
+
+		push(queue, "second\n");
+		queue.push('\n');
+		EXPECT_EQ(view(inFlight), "first\n");
+		EXPECT_EQ(queue.staged(), 8u);
+
+		queue.end_write();
+		EXPECT_EQ(view(queue.begin_write()), "second\n\n");
+	}
+
+	TEST(OutputQueue, AppendsInPlace) {
+		hs::output_queue queue{};
+		push(queue, "a\n");
+		uint8_t *line = queue.append(3);
+		line[0] = 'b';
+		line[1] = 'c';
+		line[2] = '\n';
+		EXPECT_EQ(queue.staged(), 5u);
+		EXPECT_EQ(view(queue.begin_write()), "a\nbc\n");
+	}
+
+	struct config_with_output
+	{
+		hs::output_policy output;
+	};
+
+	struct config_without_output
+	{
+	};
+
+	TEST(OutputQueue, PolicyFromConfig) {
+		config_with_output conf{};
+		conf.output.flush.mode = hs::flush_mode::immediate;
+		conf.output.no_delay = false;
+		EXPECT_EQ(hs::get_output_policy(conf).flush.mode, hs::flush_mode::immediate);
+		EXPECT_FALSE(hs::get_output_policy(conf).no_delay);
+
+		EXPECT_EQ(hs::get_output_policy(config_without_output{}).flush.mode, hs::flush_mode::end_of_batch);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,84 @@
+#include "hash-service/pool.h"
+
+#include <asio.hpp>
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace {
+	TEST(BlockCache, ReusesFreedBlocksOfTheSameClass) {
+		hs::detail::block_cache cache{};
+		void *a = cache.allocate(100);
+		cache.deallocate(a, 100);
+
+		// 100 and 128 bytes are in the same 64-byte class
+		void *b = cache.allocate(128);
+		EXPECT_EQ(a, b);
+
+		void *c = cache.allocate(129);
+		EXPECT_NE(b, c);
+		cache.deallocate(b, 128);
+		cache.deallocate(c, 129);
+	}
+
+	TEST(BlockCache, LargeBlocksBypassTheCache) {
+		hs::detail::block_cache cache{};
+		void *a = cache.allocate(hs::detail::block_cache::max_block_size + 1);
+		ASSERT_NE(a, nullptr);
+		cache.deallocate(a, hs::detail::block_cache::max_block_size + 1);
+	}
+
+	TEST(BlockCache, UncachedBlocksFitTheirClass) {
+		// allocated by a thread whose cache is destroyed, freed to another thread's cache
+		void *a = hs::detail::block_cache::allocate_uncached(100);
+		hs::detail::block_cache cache{};
+		cache.deallocate(a, 100);
+
+		void *b = cache.allocate(128);
+		ASSERT_EQ(a, b);
+		std::memset(b, 0xff, 128);
+		cache.deallocate(b, 128);
+	}
+
+	struct object
+	{
+		explicit object(int value) noexcept
+			: value(value)
+		{}
+
+		int value;
+		char payload[200];
+	};
+
+	TEST(PoolAllocator, RecyclesSharedObjects) {
+		const object *first = nullptr;
+		{
+			auto p = std::allocate_shared<object>(hs::pool_allocator<object>(), 1);
+			first = p.get();
+			EXPECT_EQ(p->value, 1);
+		}
+
+		auto p = std::allocate_shared<object>(hs::pool_allocator<object>(), 2);
+		EXPECT_EQ(p.get(), first);
+		EXPECT_EQ(p->value, 2);
+	}
+
+	TEST(PooledHandler, AssociatesPoolAllocator) {
+		int calls = 0;
+		auto handler = hs::bind_pool_allocator([&calls](int n) { calls += n; });
+		using handler_type = decltype(handler);
+		EXPECT_TRUE((std::is_same_v<asio::associated_allocator_t<handler_type>, handler_type::allocator_type>));
+
+		asio::io_context ioContext{};
+		asio::post(ioContext, hs::bind_pool_allocator([&handler]{ handler(2); }));
+		ioContext.run();
+		EXPECT_EQ(calls, 2);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+#include "hash-service/registry.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct node;
+	using registry_type = hs::session_registry<node>;
+
+	struct node : std::enable_shared_from_this<node>, hs::registry_hook
+	{
+		explicit node(registry_type &registry) noexcept
+			: registry(registry)
+		{}
+
+		~node() {
+			registry.unlink(*this);
+		}
+
+		registry_type &registry;
+	};
+
+	std::shared_ptr<node> make_node(registry_type &registry) {
+		auto n = std::make_shared<node>(registry);
+		registry.link(*n);
+		return n;
+	}
+
+	TEST(SessionRegistry, UnlinksOnDestruction) {
+		registry_type registry{4};
+		auto a = make_node(registry);
+		auto b = make_node(registry);
+		EXPECT_TRUE(a->linked());
+		EXPECT_EQ(registry.size(), 2u);
+
+		a.reset();
+		EXPECT_EQ(registry.size(), 1u);
+
+		const auto nodes = registry.snapshot();
+		ASSERT_EQ(nodes.size(), 1u);
+		EXPECT_EQ(nodes.front(), b);
+	}
+
+	TEST(SessionRegistry, SnapshotOutlivesTheOwners) {
+		registry_type registry{2};
+		std::vector<std::shared_ptr<node>> nodes{};
+		for (int i = 0; i < 10; ++i)
+			nodes.push_back(make_node(registry));
+
+		auto snapshot = registry.snapshot();
+		EXPECT_EQ(snapshot.size(), 10u);
+
+		// the last references are dropped outside of the registry's locks
+		nodes.clear();
+		EXPECT_EQ(registry.size(), 10u);
+		snapshot.clear();
+		EXPECT_EQ(registry.size(), 0u);
+	}
+
+	TEST(SessionRegistry, LinksFromMultipleThreads) {
+		registry_type registry{4};
+		constexpr int threads = 4, per_thread = 1000;
+
+		std::vector<std::vector<std::shared_ptr<node>>> nodes(threads);
+		std::vector<std::thread> workers{};
+		for (int t = 0; t < threads; ++t)
+			workers.emplace_back([&registry, &owned = nodes[t]] {
+				for (int i = 0; i < per_thread; ++i)
+				{
+					owned.push_back(make_node(registry));
+					// destroyed from another thread than the one linking it, if any
+					if (i % 2)
+						owned.erase(owned.begin());
+				}
+			});
+		for (auto &worker : workers)
+			worker.join();
+
+		size_t alive = 0;
+		for (const auto &owned : nodes)
+			alive += owned.size();
+		EXPECT_EQ(registry.size(), alive);
+		EXPECT_EQ(registry.snapshot().size(), alive);
+
+		nodes.clear();
+		EXPECT_EQ(registry.size(), 0u);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,92 @@
+#include "hash-service/scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+namespace {
+	TEST(Scheduler, ParseClassMode) {
+		EXPECT_EQ(hs::parse_class_mode("latency"), hs::class_mode::latency);
+		EXPECT_EQ(hs::parse_class_mode("bulk"), hs::class_mode::bulk);
+		EXPECT_EQ(hs::parse_class_mode("adaptive"), hs::class_mode::adaptive);
+		EXPECT_FALSE(hs::parse_class_mode("fast"));
+	}
+
+	TEST(Scheduler, PolicyGetter) {
+		struct empty_config
+		{};
+		struct config
+		{
+			hs::scheduling_policy scheduling;
+		};
+
+		EXPECT_EQ(hs::get_scheduling_policy(empty_config{}).quantum, hs::scheduling_policy{}.quantum);
+		config conf{};
+		conf.scheduling.quantum = 1;
+		EXPECT_EQ(hs::get_scheduling_policy(conf).quantum, 1u);
+	}
+
+	TEST(TurnBudget, ConsumesQuantum) {
+		hs::turn_budget turn{};
+		EXPECT_TRUE(turn.exhausted());
+
+		turn.start(100, std::chrono::microseconds(0));
+		EXPECT_EQ(turn.remaining(), 100u);
+		turn.consume(60);
+		EXPECT_FALSE(turn.exhausted());
+		EXPECT_EQ(turn.remaining(), 40u);
+		turn.consume(40);
+		EXPECT_TRUE(turn.exhausted());
+	}
+
+	TEST(TurnBudget, OverdraftIsPaidByTheNextTurn) {
+		hs::turn_budget turn{};
+		turn.start(100, std::chrono::microseconds(0));
+		turn.consume(250);
+		EXPECT_EQ(turn.remaining(), 0u);
+
+		turn.start(100, std::chrono::microseconds(0));
+		EXPECT_TRUE(turn.exhausted());
+		turn.start(100, std::chrono::microseconds(0));
+		EXPECT_EQ(turn.remaining(), 50u);
+	}
+
+	TEST(TurnBudget, IdleForgetsTheQuantum) {
+		hs::turn_budget turn{};
+		turn.start(100, std::chrono::microseconds(0));
+		turn.consume(10);
+		turn.idle();
+		EXPECT_TRUE(turn.exhausted());
+
+		turn.start(100, std::chrono::microseconds(0));
+		EXPECT_EQ(turn.remaining(), 100u);
+
+		// the overdraft is kept
+		turn.consume(150);
+		turn.idle();
+		turn.start(100, std::chrono::microseconds(0));
+		EXPECT_EQ(turn.remaining(), 50u);
+	}
+
+	TEST(TurnBudget, TimeBudget) {
+		hs::turn_budget turn{};
+		turn.start(100, std::chrono::microseconds(0));
+		turn.check_time();
+		EXPECT_EQ(turn.remaining(), 100u);
+
+		turn.start(0, std::chrono::hours(1));
+		turn.check_time();
+		EXPECT_EQ(turn.remaining(), 100u);
+
+		turn.start(0, std::chrono::microseconds(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		turn.check_time();
+		EXPECT_TRUE(turn.exhausted());
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+#include "hash-service/sha256.h"
+#include "hash-service/hash.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+#include <string>
+#include <string_view>
+
+namespace {
+	using kernel = hs::sha256_native_hash::kernel;
+
+	static_assert(hs::is_hasher_v<hs::sha256_native_hash>);
+	static_assert(hs::has_one_shot_v<hs::sha256_native_hash>);
+	static_assert(!hs::has_one_shot_v<hs::evp_sha256_hash>);
+	static_assert(!hs::is_checkpointable_v<hs::sha256_native_hash>);
+
+	std::array<uint8_t, 32> reference(std::string_view message) {
+		auto optHash = hs::evp_sha256_hash::create();
+		EXPECT_TRUE(optHash);
+		EXPECT_TRUE(optHash->update(message));
+		const auto optRes = optHash->finalize();
+		EXPECT_TRUE(optRes);
+		return optRes.value_or(std::array<uint8_t, 32>{});
+	}
+
+	/**
+	 * Messages of lengths around the padding and block boundaries, followed by random ones.
+	 */
+	std::vector<std::string> get_messages() {
+		std::vector<std::string> messages{};
+		for (size_t length : {0, 1, 3, 54, 55, 56, 57, 63, 64, 65, 119, 120, 127, 128, 129, 1000, 4096, 100000})
+			messages.emplace_back(length, 'x');
+		messages.emplace_back("oceanic 815");
+
+		std::mt19937_64 rng(815);
+		std::uniform_int_distribution<size_t> length{0, 3000};
+		std::uniform_int_distribution<int> symbol{0, 255};
+		for (size_t i = 0; i < 50; ++i)
+		{
+			std::string message(length(rng), '\0');
+			for (auto &ch : message)
+				ch = char(symbol(rng));
+			messages.push_back(std::move(message));
+		}
+		return messages;
+	}
+
+	class Sha256Native : public ::testing::TestWithParam<kernel>
+	{};
+
+	TEST_P(Sha256Native, OneShotMatchesOpenSSL) {
+		if (!hs::sha256_native_hash::supported(GetParam()))
+			GTEST_SKIP() << "kernel is not supported by the CPU";
+
+		for (const auto &message : get_messages())
+			EXPECT_EQ(hs::sha256_native_hash::hash(GetParam(), message), reference(message))
+				<< "message of length " << message.size();
+	}
+
+	TEST_P(Sha256Native, ChunksMatchOpenSSL) {
+		if (!hs::sha256_native_hash::supported(GetParam()))
+			GTEST_SKIP() << "kernel is not supported by the CPU";
+
+		auto optHash = hs::sha256_native_hash::create(GetParam());
+		ASSERT_TRUE(optHash);
+		// the hasher is reused: finalizing resets it
+		for (const auto &message : get_messages())
+		{
+			for (size_t chunkSize : {1, 7, 63, 64, 65, 1000})
+			{
+				const std::string_view view{message};
+				for (size_t offset = 0; offset < view.size(); offset += chunkSize)
+					ASSERT_TRUE(optHash->update(view.substr(offset, chunkSize)));
+
+				const auto optRes = optHash->finalize();
+				ASSERT_TRUE(optRes);
+				EXPECT_EQ(*optRes, reference(message)) << "message of length " << message.size()
+					<< " in chunks of " << chunkSize;
+			}
+		}
+	}
+
+	TEST_P(Sha256Native, KnownDigest) {
+		if (!hs::sha256_native_hash::supported(GetParam()))
+			GTEST_SKIP() << "kernel is not supported by the CPU";
+
+		const auto hex = hs::to_hex(hs::sha256_native_hash::hash(GetParam(), "oceanic 815"));
+		EXPECT_EQ(std::string_view((const char*)hex.data(), hex.size()),
+				  "ae6a9df8bdf4545392e6b1354252af8546282b49033a9118b12e9511892197c6");
+	}
+
+	INSTANTIATE_TEST_SUITE_P(Kernels, Sha256Native,
+							 ::testing::Values(kernel::portable, kernel::avx2, kernel::sha_ni, kernel::armv8));
+
+	TEST(Sha256Messages, MatchOpenSSL) {
+		const auto messages = get_messages();
+		const std::vector<std::string_view> views(messages.cbegin(), messages.cend());
+		// from a lone message to several full groups and a partial one
+		for (size_t count : {size_t(0), size_t(1), size_t(3), size_t(16), size_t(17), views.size()})
+		{
+			std::vector<hs::sha256_batch::digest> digests(count);
+			hs::sha256_messages(views.data(), count, digests.data());
+			for (size_t i = 0; i < count; ++i)
+				EXPECT_EQ(digests[i], reference(views[i])) << "message #" << i << " of " << count;
+		}
+	}
+
+	TEST(Sha256Native, BestIsSupported) {
+		EXPECT_TRUE(hs::sha256_native_hash::supported(hs::sha256_native_hash::best()));
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
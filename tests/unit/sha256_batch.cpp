@@ -0,0 +1,84 @@
+#include "hash-service/sha256_batch.h"
+#include "hash-service/hash.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+#include <string>
+#include <string_view>
+
+namespace {
+	using kernel = hs::sha256_batch::kernel;
+
+	std::array<uint8_t, 32> reference(std::string_view message) {
+		auto optHash = hs::evp_sha256_hash::create();
+		EXPECT_TRUE(optHash);
+		EXPECT_TRUE(optHash->update(message));
+		const auto optRes = optHash->finalize();
+		EXPECT_TRUE(optRes);
+		return optRes.value_or(std::array<uint8_t, 32>{});
+	}
+
+	/**
+	 * Messages of lengths around the padding boundaries, followed by random ones.
+	 */
+	std::vector<std::string> get_messages() {
+		std::vector<std::string> messages{};
+		for (size_t length : {0, 1, 3, 54, 55, 56, 57, 63, 64, 65, 119, 120, 127, 128, 129, 1000})
+			messages.emplace_back(length, 'x');
+		messages.emplace_back("oceanic 815");
+
+		std::mt19937_64 rng(815);
+		std::uniform_int_distribution<size_t> length{0, 300};
+		std::uniform_int_distribution<int> symbol{'0', 'z'};
+		for (size_t i = 0; i < 77; ++i)
+		{
+			std::string message(length(rng), '\0');
+			for (auto &ch : message)
+				ch = char(symbol(rng));
+			messages.push_back(std::move(message));
+		}
+		return messages;
+	}
+
+	class Sha256Batch : public ::testing::TestWithParam<kernel>
+	{};
+
+	TEST_P(Sha256Batch, MatchesOpenSSL) {
+		if (!hs::sha256_batch::supported(GetParam()))
+			GTEST_SKIP() << "kernel is not supported by the CPU";
+
+		const auto messages = get_messages();
+		const std::vector<std::string_view> views(messages.cbegin(), messages.cend());
+		std::vector<hs::sha256_batch::digest> digests(views.size());
+		hs::sha256_batch::hash(GetParam(), views.data(), views.size(), digests.data());
+
+		for (size_t i = 0; i < views.size(); ++i)
+			EXPECT_EQ(digests[i], reference(views[i])) << "message #" << i << " of length " << views[i].size();
+	}
+
+	TEST_P(Sha256Batch, PartialGroup) {
+		if (!hs::sha256_batch::supported(GetParam()))
+			GTEST_SKIP() << "kernel is not supported by the CPU";
+
+		const std::string_view line = "oceanic 815";
+		hs::sha256_batch::digest digest{};
+		hs::sha256_batch::hash(GetParam(), &line, 1, &digest);
+		const auto hex = hs::to_hex(digest);
+		EXPECT_EQ(std::string_view((const char*)hex.data(), hex.size()),
+				  "ae6a9df8bdf4545392e6b1354252af8546282b49033a9118b12e9511892197c6");
+	}
+
+	INSTANTIATE_TEST_SUITE_P(Kernels, Sha256Batch,
+							 ::testing::Values(kernel::scalar, kernel::lanes_4, kernel::lanes_8, kernel::lanes_16));
+
+	TEST(Sha256Batch, BestIsSupported) {
+		EXPECT_TRUE(hs::sha256_batch::supported(hs::sha256_batch::best()));
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,175 @@
+#include "hash-service/timing_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace {
+	using tick_type = hs::coarse_clock::tick_type;
+
+	struct fake_entry
+	{
+		std::optional<tick_type> deadline;
+	};
+
+	class fake_handle
+	{
+	 public:
+		explicit fake_handle(std::shared_ptr<fake_entry> entry) noexcept
+			: _entry(std::move(entry))
+		{}
+
+		[[nodiscard]] std::optional<std::pair<tick_type, hs::timeout_kind>> deadline() const noexcept {
+			if (!_entry->deadline)
+				return std::nullopt;
+			return std::make_pair(*_entry->deadline, hs::timeout_kind::idle);
+		}
+
+		[[nodiscard]] const fake_entry *entry() const noexcept {
+			return _entry.get();
+		}
+
+	 private:
+		std::shared_ptr<fake_entry> _entry;
+	};
+
+	using wheel_type = hs::timing_wheel<fake_handle>;
+
+	std::vector<const fake_entry*> advance(wheel_type &wheel, tick_type now) {
+		std::vector<const fake_entry*> expired{};
+		wheel.advance(now, [&expired](fake_handle &handle, hs::timeout_kind) {
+			expired.push_back(handle.entry());
+		});
+		return expired;
+	}
+
+	TEST(TimingWheel, ExpiresAtDeadline) {
+		wheel_type wheel{std::chrono::milliseconds(100)};
+		auto entry = std::make_shared<fake_entry>(fake_entry{5});
+		wheel.add(fake_handle(entry));
+		EXPECT_EQ(wheel.size(), 1u);
+
+		EXPECT_TRUE(advance(wheel, 4).empty());
+		EXPECT_EQ(advance(wheel, 5), std::vector<const fake_entry*>{entry.get()});
+		EXPECT_EQ(wheel.size(), 0u);
+	}
+
+	TEST(TimingWheel, CascadesFromHigherLevels) {
+		wheel_type wheel{std::chrono::milliseconds(1)};
+		const std::vector<tick_type> deadlines{1, 63, 64, 65, 100, 4095, 4096, 5000, 262144, 300000};
+		std::vector<std::shared_ptr<fake_entry>> entries{};
+		for (const tick_type deadline : deadlines)
+		{
+			entries.push_back(std::make_shared<fake_entry>(fake_entry{deadline}));
+			wheel.add(fake_handle(entries.back()));
+		}
+
+		for (size_t i = 0; i < deadlines.size(); ++i)
+		{
+			EXPECT_TRUE(advance(wheel, deadlines[i] - 1).empty()) << deadlines[i];
+			EXPECT_EQ(advance(wheel, deadlines[i]), std::vector<const fake_entry*>{entries[i].get()}) << deadlines[i];
+		}
+		EXPECT_EQ(wheel.size(), 0u);
+	}
+
+	TEST(TimingWheel, ReschedulesLazily) {
+		wheel_type wheel{std::chrono::milliseconds(100)};
+		auto entry = std::make_shared<fake_entry>(fake_entry{10});
+		wheel.add(fake_handle(entry));
+
+		// activity moves the deadline without touching the wheel
+		advance(wheel, 5);
+		entry->deadline = 20;
+		EXPECT_TRUE(advance(wheel, 10).empty());
+		EXPECT_EQ(wheel.size(), 1u);
+		EXPECT_TRUE(advance(wheel, 19).empty());
+		EXPECT_EQ(advance(wheel, 20).size(), 1u);
+	}
+
+	TEST(TimingWheel, DropsEntriesWithoutDeadline) {
+		wheel_type wheel{std::chrono::milliseconds(100)};
+		auto entry = std::make_shared<fake_entry>(fake_entry{3});
+		wheel.add(fake_handle(entry));
+		entry->deadline.reset();
+
+		EXPECT_TRUE(advance(wheel, 3).empty());
+		EXPECT_EQ(wheel.size(), 0u);
+
+		wheel.add(fake_handle(entry));
+		EXPECT_EQ(wheel.size(), 0u);
+	}
+
+	TEST(TimingWheel, ParksDeadlinesBeyondTopLevel) {
+		wheel_type wheel{std::chrono::milliseconds(1)};
+		const tick_type deadline = (tick_type(1) << 24) + 10;
+		auto entry = std::make_shared<fake_entry>(fake_entry{deadline});
+		wheel.add(fake_handle(entry));
+
+		EXPECT_TRUE(advance(wheel, deadline - 1).empty());
+		EXPECT_EQ(wheel.size(), 1u);
+		EXPECT_EQ(advance(wheel, deadline).size(), 1u);
+	}
+
+	using deadline = std::pair<tick_type, hs::timeout_kind>;
+
+	hs::timeout_policy make_policy(int idle, int line, int write) {
+		return hs::timeout_policy{std::chrono::milliseconds(idle),
+								  std::chrono::milliseconds(line),
+								  std::chrono::milliseconds(write),
+								  std::chrono::milliseconds(100)};
+	}
+
+	TEST(SessionActivity, IdleSinceLastActivity) {
+		hs::coarse_clock clock{std::chrono::milliseconds(100)};
+		hs::session_activity activity{&clock, make_policy(1000, 0, 0)};
+		EXPECT_EQ(activity.deadline(), deadline(10, hs::timeout_kind::idle));
+
+		clock.set(3);
+		activity.received();
+		EXPECT_EQ(activity.deadline(), deadline(13, hs::timeout_kind::idle));
+
+		// a pending write suspends the idle timeout
+		activity.write_started();
+		clock.set(20);
+		EXPECT_EQ(activity.deadline(), deadline(30, hs::timeout_kind::idle));
+		clock.set(25);
+		activity.write_finished();
+		EXPECT_EQ(activity.deadline(), deadline(35, hs::timeout_kind::idle));
+	}
+
+	TEST(SessionActivity, LineAndWriteSinceTheirStart) {
+		hs::coarse_clock clock{std::chrono::milliseconds(100)};
+		hs::session_activity activity{&clock, make_policy(10000, 500, 2000)};
+
+		clock.set(3);
+		activity.line_started();
+		clock.set(6);
+		EXPECT_EQ(activity.deadline(), deadline(8, hs::timeout_kind::line));
+
+		activity.line_finished();
+		activity.write_started();
+		clock.set(20);
+		EXPECT_EQ(activity.deadline(), deadline(25, hs::timeout_kind::line));
+		EXPECT_EQ(hs::session_activity(&clock, make_policy(0, 0, 2000)).deadline(),
+				  deadline(40, hs::timeout_kind::write));
+
+		hs::session_activity writing{&clock, make_policy(0, 0, 2000)};
+		writing.write_started();
+		clock.set(30);
+		EXPECT_EQ(writing.deadline(), deadline(40, hs::timeout_kind::write));
+	}
+
+	TEST(SessionActivity, NotTracked) {
+		hs::coarse_clock clock{std::chrono::milliseconds(100)};
+		EXPECT_FALSE(hs::session_activity{}.deadline());
+		EXPECT_FALSE(hs::session_activity(&clock, hs::timeout_policy{}).deadline());
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+// the tracepoints are tested whether or not they are compiled into the server
+#undef HS_TRACING
+#define HS_TRACING 1
+#include "hash-service/trace.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	size_t count(const std::string &text, const std::string &pattern) {
+		size_t n = 0;
+		for (size_t i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + 1))
+			++n;
+		return n;
+	}
+
+	TEST(Trace, RingKeepsTheLatestRecords) {
+		constexpr size_t capacity = hs::detail::trace_ring::capacity;
+		hs::detail::trace_ring ring{7};
+		for (uint64_t i = 0; i < capacity + 10; ++i)
+			ring.write(i, hs::trace_event::line_hashed, 1, i);
+
+		std::vector<hs::detail::trace_entry> entries{};
+		ring.copy(entries);
+		// the oldest record shares its slot with the next one to be written: it may be torn
+		ASSERT_EQ(entries.size(), capacity - 1);
+		EXPECT_EQ(entries.front().timestamp, 11u);
+		EXPECT_EQ(entries.back().arg, capacity + 9);
+		EXPECT_EQ(entries.back().thread, 7u);
+		EXPECT_EQ(entries.back().event, hs::trace_event::line_hashed);
+	}
+
+	TEST(Trace, RingSkipsTheRecordBeingWritten) {
+		constexpr size_t capacity = hs::detail::trace_ring::capacity;
+		hs::detail::trace_ring ring{0};
+		for (uint64_t i = 0; i < capacity - 1; ++i)
+			ring.write(i, hs::trace_event::line_hashed, 1, i);
+
+		// not full yet: the next record goes to a free slot
+		std::vector<hs::detail::trace_entry> entries{};
+		ring.copy(entries);
+		EXPECT_EQ(entries.size(), capacity - 1);
+
+		ring.write(capacity - 1, hs::trace_event::line_hashed, 1, 0);
+		entries.clear();
+		ring.copy(entries);
+		ASSERT_EQ(entries.size(), capacity - 1);
+		EXPECT_EQ(entries.front().timestamp, 1u);
+	}
+
+	TEST(Trace, SessionIdsAreNotReused) {
+		const uint64_t first = hs::trace_session_id(), second = hs::trace_session_id();
+		EXPECT_NE(first, 0u);
+		EXPECT_GT(second, first);
+	}
+
+	TEST(Trace, SpansAreDumped) {
+		const uint64_t session = hs::trace_session_id();
+		{
+			const hs::trace_span span{hs::trace_event::encode_begin, session, 4096};
+			hs::trace(hs::trace_event::line_hashed, session, 815);
+		}
+
+		const std::string json = hs::trace_json();
+		ASSERT_EQ(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0u);
+		const std::string id = "\"id\":\"" + std::to_string(session) + "\"";
+		EXPECT_NE(json.find("{\"name\":\"encoding\",\"cat\":\"encoding\",\"ph\":\"b\"," + id), std::string::npos);
+		EXPECT_NE(json.find("{\"name\":\"encoding\",\"cat\":\"encoding\",\"ph\":\"e\"," + id), std::string::npos);
+		EXPECT_NE(json.find("\"args\":{\"bytes\":4096}"), std::string::npos);
+		EXPECT_NE(json.find("\"args\":{\"bytes\":815}"), std::string::npos);
+		// the end follows the beginning
+		EXPECT_LT(json.find("\"ph\":\"b\"," + id), json.find("\"ph\":\"e\"," + id));
+	}
+
+	TEST(Trace, ThreadsHaveTheirOwnRings) {
+		const uint64_t session = hs::trace_session_id();
+		hs::trace(hs::trace_event::registered, session);
+		std::thread([session]{ hs::trace(hs::trace_event::closed, session); }).join();
+
+		const std::string json = hs::trace_json();
+		const size_t iRegistered = json.find("\"name\":\"registered\""),
+			iClosed = json.find("\"name\":\"closed\"");
+		ASSERT_NE(iRegistered, std::string::npos);
+		ASSERT_NE(iClosed, std::string::npos);
+		const auto tid = [&json](size_t from) {
+			const size_t iTid = json.find("\"tid\":", from) + 6;
+			return json.substr(iTid, json.find_first_not_of("0123456789", iTid) - iTid);
+		};
+		EXPECT_NE(tid(iRegistered), tid(iClosed));
+		EXPECT_EQ(count(json, "\"name\":\"closed\""), 1u);
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
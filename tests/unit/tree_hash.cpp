@@ -0,0 +1,122 @@
+#include "hash-service/tree_hash.h"
+
+#include <gtest/gtest.h>
+
+#include <asio.hpp>
+
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+	using digest = hs::sha256_tree_hash::digest;
+	constexpr size_t leaf_size = hs::sha256_tree_hash::leaf_size;
+
+	/**
+	 * Merkle Tree Hash of RFC 6962, by its recursive definition.
+	 */
+	digest reference_root(const std::vector<std::string_view> &leaves, size_t begin, size_t end) {
+		if (end - begin == 1)
+			return hs::sha256_tree_hash::leaf(leaves[begin]);
+
+		size_t split = 1;
+		while (split * 2 < end - begin)
+			split *= 2;
+		return hs::sha256_tree_hash::node(reference_root(leaves, begin, begin + split),
+										  reference_root(leaves, begin + split, end));
+	}
+
+	digest reference_root(std::string_view line) {
+		std::vector<std::string_view> leaves{};
+		for (size_t offset = 0; offset < line.size(); offset += leaf_size)
+			leaves.push_back(line.substr(offset, leaf_size));
+		if (leaves.empty())
+			leaves.emplace_back();
+		return reference_root(leaves, 0, leaves.size());
+	}
+
+	std::string make_line(size_t size) {
+		std::string line(size, '\0');
+		for (size_t i = 0; i < size; ++i)
+			line[i] = char('a' + (i * 7 + i / 13) % 26);
+		return line;
+	}
+
+	digest hash_in_chunks(hs::sha256_tree_hash &hash, std::string_view line, size_t chunkSize) {
+		for (size_t offset = 0; offset < line.size(); offset += chunkSize)
+			EXPECT_TRUE(hash.update(line.substr(offset, chunkSize)));
+		const auto root = hash.finalize();
+		EXPECT_TRUE(root);
+		return root.value_or(digest{});
+	}
+
+	const std::vector<size_t> line_sizes{0, 1, leaf_size - 1, leaf_size, leaf_size + 1, 3 * leaf_size,
+										 5 * leaf_size + 7, 17 * leaf_size, 64 * leaf_size + leaf_size / 2};
+
+	TEST(TreeHash, Traits) {
+		static_assert(hs::is_parallel_v<hs::sha256_tree_hash>);
+		static_assert(!hs::is_parallel_v<int>);
+	}
+
+	TEST(TreeHash, SingleLeafIsPrefixedSha256) {
+		auto hash = hs::sha256_tree_hash::create();
+		ASSERT_TRUE(hash);
+		ASSERT_TRUE(hash->update("oceanic 815"));
+		EXPECT_EQ(hash->finalize(), hs::sha256_tree_hash::leaf("oceanic 815"));
+		// empty line
+		EXPECT_EQ(hash->finalize(), hs::sha256_tree_hash::leaf(""));
+	}
+
+	TEST(TreeHash, MatchesReferenceSerially) {
+		auto hash = hs::sha256_tree_hash::create();
+		ASSERT_TRUE(hash);
+		for (size_t size : line_sizes)
+		{
+			const std::string line = make_line(size);
+			const digest expected = reference_root(line);
+			for (size_t chunkSize : {size_t(1000), leaf_size, 3 * leaf_size + 5, size_t(1) << 20})
+				EXPECT_EQ(hash_in_chunks(*hash, line, chunkSize), expected) << "size: " << size << ", chunk: " << chunkSize;
+		}
+	}
+
+	TEST(TreeHash, MatchesReferenceOnPool) {
+		asio::thread_pool pool{4};
+		auto hash = hs::sha256_tree_hash::create();
+		ASSERT_TRUE(hash);
+		hash->set_pool(&pool);
+		for (size_t size : line_sizes)
+		{
+			const std::string line = make_line(size);
+			const digest expected = reference_root(line);
+			for (size_t chunkSize : {size_t(1000), 3 * leaf_size + 5, size_t(1) << 20})
+				EXPECT_EQ(hash_in_chunks(*hash, line, chunkSize), expected) << "size: " << size << ", chunk: " << chunkSize;
+		}
+		pool.join();
+	}
+
+	TEST(TreeHash, MatchesReferenceWithinPool) {
+		// a thread of the pool fans out few leaves as well
+		asio::thread_pool pool{4};
+		auto hash = hs::sha256_tree_hash::create();
+		ASSERT_TRUE(hash);
+		hash->set_pool(&pool);
+		for (size_t size : line_sizes)
+		{
+			const std::string line = make_line(size);
+			const digest expected = reference_root(line);
+			for (size_t chunkSize : {3 * leaf_size + 5, size_t(1) << 20})
+			{
+				std::promise<digest> root{};
+				asio::post(pool, [&]{ root.set_value(hash_in_chunks(*hash, line, chunkSize)); });
+				EXPECT_EQ(root.get_future().get(), expected) << "size: " << size << ", chunk: " << chunkSize;
+			}
+		}
+		pool.join();
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}